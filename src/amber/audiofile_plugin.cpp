@@ -1,8 +1,10 @@
 #include "audiofile_plugin.hpp"
 
+#include <algorithm>
 #include <imgui.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <stdexcept>
+#include <string>
 
 using namespace amber;
 
@@ -14,13 +16,25 @@ AudioFilePlugin::AudioFilePlugin(PluginContext &pluggy, std::string_view filenam
         throw std::runtime_error("Unable to load audio file");
     }
 
-    auto ts = std::make_shared<database::TimeSeriesDense>(0.0, 1.0 / m_audioFile.getSampleRate());
-    pluggy.get_database().register_timeseries(std::string(filename), ts);
-    m_ts = ts;
+    // Every channel shares the same timebase, so they're pushed together as frames
+    auto &db = pluggy.get_database();
+    const auto num_channels = static_cast<std::size_t>(m_audioFile.getNumChannels());
+    m_group = std::make_shared<database::TimeSeriesGroup<float>>(
+        num_channels, 0.0, 1.0 / m_audioFile.getSampleRate(), db.arena());
+    for (std::size_t channel = 0; channel < num_channels; ++channel)
+    {
+        auto name = std::string(filename);
+        if (num_channels > 1)
+        {
+            name += " [" + std::to_string(channel) + "]";
+        }
+        db.register_timeseries(name, m_group->channel(channel));
+    }
 
     m_logger = spdlog::stdout_color_mt("AudioFilePlugin");
     m_logger->info("Loaded audio file {}", filename);
     m_logger->info("Sample rate: {}", m_audioFile.getSampleRate());
+    m_logger->info("Channels: {}", m_audioFile.getNumChannels());
     m_logger->info("Total samples: {}", m_audioFile.getNumSamplesPerChannel());
     m_logger->info("Initialized");
 }
@@ -40,6 +54,15 @@ void AudioFilePlugin::background_worker()
     using namespace std::chrono;
     using namespace std::chrono_literals;
 
+    // A file without any frames has nothing to play, and would never use up the count below
+    const auto &channels = m_audioFile.samples;
+    const auto total_samples = static_cast<std::size_t>(m_audioFile.getNumSamplesPerChannel());
+    if (channels.empty() || total_samples == 0)
+    {
+        m_logger->warn("Nothing to play in {}", m_filename);
+        return;
+    }
+
     const auto sample_period = std::chrono::duration<double>(1s) / m_audioFile.getSampleRate();
     auto prevtime = std::chrono::steady_clock::now();
 
@@ -51,17 +74,36 @@ void AudioFilePlugin::background_worker()
         auto delta = std::chrono::duration<double>(now - prevtime);
         prevtime = now;
 
+        std::size_t count = 0;
         while (delta > seconds(0))
         {
-            if (m_current_sample >= static_cast<std::size_t>(m_audioFile.getNumSamplesPerChannel()))
+            ++count;
+            delta -= sample_period;
+        }
+
+        // Push the samples in contiguous runs of frames, wrapping around to the start of the file
+        // when we run off the end. The audio buffer holds each channel separately, so each run is
+        // interleaved into frames first.
+        while (count)
+        {
+            if (m_current_sample >= total_samples)
             {
                 m_current_sample = 0;
             }
 
-            auto sample = m_audioFile.samples[0][m_current_sample++];
-            m_ts->push_sample(sample);
-
-            delta -= sample_period;
+            const auto run = std::min(count, total_samples - m_current_sample);
+            m_frames.resize(run * channels.size());
+            for (std::size_t i = 0; i < run; ++i)
+            {
+                for (std::size_t channel = 0; channel < channels.size(); ++channel)
+                {
+                    m_frames[i * channels.size() + channel] =
+                        channels[channel][m_current_sample + i];
+                }
+            }
+            m_group->push_frames(m_frames.data(), run);
+            m_current_sample += run;
+            count -= run;
         }
     }
 }
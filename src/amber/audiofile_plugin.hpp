@@ -3,10 +3,11 @@
 #include "plugin.hpp"
 #include "plugin_context.hpp"
 #include <database/timeseries.hpp>
-#include <database/timeseries_dense.hpp>
+#include <database/timeseries_group.hpp>
 #include <AudioFile.h>
 #include <spdlog/logger.h>
 #include <thread>
+#include <vector>
 
 namespace amber
 {
@@ -27,7 +28,8 @@ class AudioFilePlugin : public Plugin
     AudioFile<float> m_audioFile;
     std::thread m_thread;
     std::atomic<bool> m_running;
-    std::shared_ptr<database::TimeSeriesDense> m_ts;
+    std::shared_ptr<database::TimeSeriesGroup<float>> m_group;
+    std::vector<float> m_frames;
     std::shared_ptr<spdlog::logger> m_logger;
     std::size_t m_current_sample;
     std::string m_filename;
@@ -1,44 +1,129 @@
 #include <benchmark/benchmark.h>
+#include <atomic>
 #include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
 #include <database/timeseries_dense.hpp>
 
+using namespace amber::database;
+
 static void TimeseriesDense_Push(benchmark::State &state)
 {
     const int TOTAL_SAMPLES = state.range(0);
+    const int BATCH_SIZE = state.range(1);
+
+    std::vector<double> batch(BATCH_SIZE);
+    for (auto _ : state)
+    {
+        TimeSeriesDense ts(0, 1.0);
+        for (int i = 0; i < TOTAL_SAMPLES; i += BATCH_SIZE)
+        {
+            for (int j = 0; j < BATCH_SIZE; j++)
+            {
+                batch[j] = i + j;
+            }
+            ts.push_samples(batch.data(), batch.size());
+        }
+    }
+    auto items = int64_t(state.iterations()) * int64_t(state.range(0));
+    state.counters["samples/sec"] =
+        benchmark::Counter(static_cast<double>(items), benchmark::Counter::kIsRate);
+}
+BENCHMARK(TimeseriesDense_Push)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgNames({"samples", "batch"})
+    ->ArgsProduct({{1'000'000, 10'000'000, 100'000'000}, {1, 64, 4096}});
+
+static void TimeseriesDense_PushContended(benchmark::State &state)
+{
+    const int TOTAL_SAMPLES = 1'000'000;
+    const int NUM_READERS = state.range(0);
+    const int TOTAL_BINS = 1'000;
 
     for (auto _ : state)
     {
+        state.PauseTiming();
         TimeSeriesDense ts(0, 1.0);
+        std::atomic<bool> running = true;
+        std::vector<std::thread> readers;
+        for (int i = 0; i < NUM_READERS; i++)
+        {
+            readers.emplace_back([&ts, &running]() {
+                std::vector<TSSample> samples(TOTAL_BINS);
+                while (running.load(std::memory_order_relaxed))
+                {
+                    // Keep the whole series in view, like a graph following the latest data
+                    const auto span = ts.get_span();
+                    const auto bin_width = std::max((span.second - span.first) / TOTAL_BINS, 1.0);
+                    benchmark::DoNotOptimize(
+                        ts.get_samples(samples.data(), span.first, bin_width, TOTAL_BINS));
+                }
+            });
+        }
+        state.ResumeTiming();
+
         for (int i = 0; i < TOTAL_SAMPLES; i++)
         {
             ts.push_sample(i);
         }
+
+        state.PauseTiming();
+        running = false;
+        for (auto &reader : readers)
+        {
+            reader.join();
+        }
+        state.ResumeTiming();
+    }
+    auto items = int64_t(state.iterations()) * int64_t(TOTAL_SAMPLES);
+    state.counters["samples/sec"] =
+        benchmark::Counter(static_cast<double>(items), benchmark::Counter::kIsRate);
+}
+BENCHMARK(TimeseriesDense_PushContended)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgName("readers")
+    ->Arg(0)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->UseRealTime();
+
+static void TimeseriesDense_Init(benchmark::State &state)
+{
+    const int TOTAL_SAMPLES = state.range(0);
+
+    for (auto _ : state)
+    {
+        std::vector<double> data(TOTAL_SAMPLES, 0.0);
+        TimeSeriesDense ts(0, 1.0, data);
     }
     auto items = int64_t(state.iterations()) * int64_t(state.range(0));
     state.counters["samples/sec"] =
         benchmark::Counter(static_cast<double>(items), benchmark::Counter::kIsRate);
 }
-BENCHMARK(TimeseriesDense_Push)
+BENCHMARK(TimeseriesDense_Init)
     ->Unit(benchmark::kMillisecond)
     ->ArgName("samples")
     ->Arg(1'000'000)
     ->Arg(10'000'000)
     ->Arg(100'000'000);
 
-static void TimeseriesDense_Init(benchmark::State &state)
+static void TimeseriesDense_InitMove(benchmark::State &state)
 {
     const int TOTAL_SAMPLES = state.range(0);
 
     for (auto _ : state)
     {
         std::vector<double> data(TOTAL_SAMPLES, 0.0);
-        TimeSeriesDense ts(0, 1.0, data);
+        TimeSeriesDense ts(0, 1.0, std::move(data));
     }
     auto items = int64_t(state.iterations()) * int64_t(state.range(0));
     state.counters["samples/sec"] =
         benchmark::Counter(static_cast<double>(items), benchmark::Counter::kIsRate);
 }
-BENCHMARK(TimeseriesDense_Init)
+BENCHMARK(TimeseriesDense_InitMove)
     ->Unit(benchmark::kMillisecond)
     ->ArgName("samples")
     ->Arg(1'000'000)
@@ -50,15 +135,18 @@ static void TimeseriesDense_Reduce(benchmark::State &state)
     const int TOTAL_SAMPLES = state.range(0);
     const int TOTAL_BINS = state.range(1);
 
+    // Offset of the first bin in hundredths of a sample, so bins don't line up with blocks
+    const double start = state.range(2) / 100.0;
+    const double bin_width = static_cast<double>(TOTAL_SAMPLES) / TOTAL_BINS;
+
     // TODO is this step excluded from timing?
     std::vector<double> data(TOTAL_SAMPLES, 0.0);
     TimeSeriesDense ts(0, 1.0, data);
+    std::vector<TSSample> samples(TOTAL_BINS);
 
     for (auto _ : state)
     {
-        TSSample sample[TOTAL_BINS];
-        benchmark::DoNotOptimize(
-            ts.get_samples(&sample[0], 0.0, TOTAL_SAMPLES / TOTAL_BINS, TOTAL_BINS));
+        benchmark::DoNotOptimize(ts.get_samples(samples.data(), start, bin_width, TOTAL_BINS));
     }
     auto items = int64_t(state.iterations()) * int64_t(TOTAL_BINS);
     state.counters["bins/sec"] =
@@ -66,9 +154,59 @@ static void TimeseriesDense_Reduce(benchmark::State &state)
 }
 BENCHMARK(TimeseriesDense_Reduce)
     ->Unit(benchmark::kMicrosecond)
-    ->ArgNames({"samples", "bins"})
-    ->Args({1'000'000, 1'000})
-    ->Args({10'000'000, 1'000})
-    ->Args({100'000'000, 1'000});
+    ->ArgNames({"samples", "bins", "offset"})
+    ->Args({1'000'000, 1'000, 0})
+    ->Args({10'000'000, 1'000, 0})
+    ->Args({100'000'000, 1'000, 0})
+    // As many bins as a wide window has pixel columns, or twice that
+    ->Args({10'000'000, 4096, 37})
+    ->Args({10'000'000, 8192, 37})
+    ->Args({100'000'000, 4096, 37})
+    ->Args({100'000'000, 8192, 37})
+    // Narrow, unaligned bins where most of the time goes on scanning raw samples
+    ->Args({4096 * 2, 4096, 37})
+    ->Args({4096 * 3, 4096, 37})
+    ->Args({4096 * 5, 4096, 37})
+    ->Args({4096 * 8, 4096, 37})
+    ->Args({4096 * 13, 4096, 37})
+    ->Args({4096 * 24, 4096, 37})
+    ->Args({4096 * 33, 4096, 37})
+    ->Args({4096 * 64, 4096, 37});
+
+static void TimeseriesDense_Geometry(benchmark::State &state)
+{
+    const int TOTAL_SAMPLES = 10'000'000;
+    const int TOTAL_BINS = state.range(2);
+    const double bin_width = static_cast<double>(TOTAL_SAMPLES) / TOTAL_BINS;
+
+    // Memory against query latency for each shape of pyramid, to pick one per channel. Noise
+    // doesn't compress, so the ragged ends of bins are read straight from the raw samples.
+    TimeSeriesDense ts(0, 1.0);
+    ts.set_geometry({static_cast<unsigned int>(state.range(0)),
+                     static_cast<unsigned int>(state.range(1))});
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> noise(-1.0, 1.0);
+    std::vector<double> data(TOTAL_SAMPLES);
+    for (auto &value : data)
+    {
+        value = noise(rng);
+    }
+    ts.push_samples(data.data(), data.size());
+    std::vector<TSSample> samples(TOTAL_BINS);
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(ts.get_samples(samples.data(), 0.37, bin_width, TOTAL_BINS));
+    }
+    auto items = int64_t(state.iterations()) * int64_t(TOTAL_BINS);
+    state.counters["bins/sec"] =
+        benchmark::Counter(static_cast<double>(items), benchmark::Counter::kIsRate);
+    state.counters["bytes/sample"] =
+        static_cast<double>(ts.logical_memory_usage()) / static_cast<double>(TOTAL_SAMPLES);
+}
+BENCHMARK(TimeseriesDense_Geometry)
+    ->Unit(benchmark::kMicrosecond)
+    ->ArgNames({"block_shift", "fan_in_shift", "bins"})
+    ->ArgsProduct({{3, 5, 8}, {1, 2, 3, 4}, {1'000, 4096}});
 
 BENCHMARK_MAIN();
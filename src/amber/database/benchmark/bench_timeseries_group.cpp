@@ -0,0 +1,94 @@
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <vector>
+#include <database/timeseries_dense.hpp>
+#include <database/timeseries_group.hpp>
+
+using namespace amber::database;
+
+static void TimeseriesGroup_PushFrame(benchmark::State &state)
+{
+    const int TOTAL_FRAMES = 100'000;
+    const int CHANNELS = state.range(0);
+
+    std::vector<float> frame(CHANNELS);
+    for (auto _ : state)
+    {
+        auto group = std::make_shared<TimeSeriesGroup<float>>(CHANNELS, 0, 1.0);
+        for (int i = 0; i < TOTAL_FRAMES; i++)
+        {
+            std::fill(frame.begin(), frame.end(), static_cast<float>(i));
+            group->push_frame(frame.data());
+        }
+    }
+    auto items = int64_t(state.iterations()) * TOTAL_FRAMES;
+    state.counters["frames/sec"] =
+        benchmark::Counter(static_cast<double>(items), benchmark::Counter::kIsRate);
+}
+BENCHMARK(TimeseriesGroup_PushFrame)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgName("channels")
+    ->Arg(8)
+    ->Arg(64);
+
+// The same as above, but with a separate timeseries for each channel
+static void TimeseriesGroup_PushSeparate(benchmark::State &state)
+{
+    const int TOTAL_FRAMES = 100'000;
+    const int CHANNELS = state.range(0);
+
+    for (auto _ : state)
+    {
+        std::vector<std::unique_ptr<TimeSeriesDense<float>>> channels;
+        for (int channel = 0; channel < CHANNELS; channel++)
+        {
+            channels.push_back(std::make_unique<TimeSeriesDense<float>>(0, 1.0));
+        }
+        for (int i = 0; i < TOTAL_FRAMES; i++)
+        {
+            for (auto &ts : channels)
+            {
+                ts->push_sample(static_cast<float>(i));
+            }
+        }
+    }
+    auto items = int64_t(state.iterations()) * TOTAL_FRAMES;
+    state.counters["frames/sec"] =
+        benchmark::Counter(static_cast<double>(items), benchmark::Counter::kIsRate);
+}
+BENCHMARK(TimeseriesGroup_PushSeparate)
+    ->Unit(benchmark::kMillisecond)
+    ->ArgName("channels")
+    ->Arg(8)
+    ->Arg(64);
+
+static void TimeseriesGroup_Reduce(benchmark::State &state)
+{
+    const int TOTAL_FRAMES = 1'000'000;
+    const int TOTAL_BINS = 1'000;
+    const int CHANNELS = state.range(0);
+
+    auto group = std::make_shared<TimeSeriesGroup<float>>(CHANNELS, 0, 1.0);
+    std::vector<float> frames(static_cast<std::size_t>(CHANNELS) * 4096, 0.0f);
+    for (int i = 0; i < TOTAL_FRAMES; i += 4096)
+    {
+        group->push_frames(frames.data(), 4096);
+    }
+
+    std::vector<std::vector<TSSample>> samples(CHANNELS, std::vector<TSSample>(TOTAL_BINS));
+    std::vector<TSSample *> outputs;
+    for (auto &channel : samples)
+    {
+        outputs.push_back(channel.data());
+    }
+
+    const double bin_width = static_cast<double>(TOTAL_FRAMES) / TOTAL_BINS;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(group->get_samples(outputs.data(), 0.37, bin_width, TOTAL_BINS));
+    }
+    auto items = int64_t(state.iterations()) * int64_t(TOTAL_BINS) * CHANNELS;
+    state.counters["bins/sec"] =
+        benchmark::Counter(static_cast<double>(items), benchmark::Counter::kIsRate);
+}
+BENCHMARK(TimeseriesGroup_Reduce)->Unit(benchmark::kMicrosecond)->ArgName("channels")->Arg(64);
@@ -0,0 +1,43 @@
+#include <benchmark/benchmark.h>
+#include <vector>
+#include <database/timeseries_sparse.hpp>
+
+using namespace amber::database;
+
+static void TimeseriesSparse_Reduce(benchmark::State &state)
+{
+    const int TOTAL_SAMPLES = state.range(0);
+    const int TOTAL_BINS = state.range(1);
+
+    // Irregularly spaced samples, averaging one per second
+    TimeSeriesSparse ts;
+    std::vector<double> timestamps(4096);
+    std::vector<double> values(4096, 0.0);
+    double timestamp = 0.0;
+    for (int i = 0; i < TOTAL_SAMPLES; i += timestamps.size())
+    {
+        for (auto &t : timestamps)
+        {
+            timestamp += 0.5 + (i % 3) * 0.5;
+            t = timestamp;
+        }
+        ts.push_samples(timestamps.data(), values.data(), timestamps.size());
+    }
+
+    const auto span = ts.get_span();
+    std::vector<TSSample> samples(TOTAL_BINS);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(ts.get_samples(
+            samples.data(), span.first, (span.second - span.first) / TOTAL_BINS, TOTAL_BINS));
+    }
+    auto items = int64_t(state.iterations()) * int64_t(TOTAL_BINS);
+    state.counters["bins/sec"] =
+        benchmark::Counter(static_cast<double>(items), benchmark::Counter::kIsRate);
+}
+BENCHMARK(TimeseriesSparse_Reduce)
+    ->Unit(benchmark::kMicrosecond)
+    ->ArgNames({"samples", "bins"})
+    ->Args({1'000'000, 1'000})
+    ->Args({10'000'000, 1'000})
+    ->Args({100'000'000, 1'000});
@@ -0,0 +1,31 @@
+# Fails if the object of an instruction set's kernels defines a weak symbol other than its own
+# entry points. The linker keeps one copy of each weak symbol for every caller, so a shared helper
+# built with e.g. AVX instructions could end up being called on a CPU which doesn't have them.
+#
+# Run with -DNM=<nm> -DOBJECTS=<objects of the database library>.
+
+foreach(object IN LISTS OBJECTS)
+	if (NOT object MATCHES "kernels_(sse2|avx2|avx512)\\.cpp")
+		continue()
+	endif()
+	set(isa ${CMAKE_MATCH_1})
+
+	execute_process(
+		COMMAND ${NM} --defined-only ${object}
+		OUTPUT_VARIABLE symbols
+		RESULT_VARIABLE result
+	)
+	if (NOT result EQUAL 0)
+		message(FATAL_ERROR "Unable to list the symbols of ${object}")
+	endif()
+
+	string(REPLACE "\n" ";" symbols "${symbols}")
+	foreach(symbol IN LISTS symbols)
+		if (symbol MATCHES " [WVu] (.*)$")
+			set(name ${CMAKE_MATCH_1})
+			if (NOT name MATCHES "(reduce|fold)_${isa}I")
+				message(SEND_ERROR "${object} exports the weak symbol ${name}")
+			endif()
+		endif()
+	endforeach()
+endforeach()
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+namespace amber::database
+{
+/**
+ * @brief Describes how samples of type T are aggregated. Sums are kept in a wider type so they
+ * can't overflow or lose precision, while mins and maxes are just samples themselves.
+ */
+template <typename T> struct SampleTraits
+{
+    static_assert(std::is_arithmetic_v<T>, "Samples must be numeric");
+    typedef std::conditional_t<std::is_integral_v<T>, std::int64_t, double> Sum;
+};
+
+/**
+ * @brief Picks which aggregates the mip-map levels of a dense timeseries keep, on top of the min
+ * and max which are always kept. Every aggregate kept costs memory in every level, so a series
+ * should only keep the ones it's going to be asked for.
+ *
+ * Only the sets named below are supported.
+ */
+template <bool Sum, bool SumSquares, bool FirstLast> struct AggregateSet
+{
+    static constexpr bool sum = Sum;
+    static constexpr bool sum_squares = SumSquares;
+    static constexpr bool first_last = FirstLast;
+
+    // Identifies the set in snapshots
+    static constexpr std::uint32_t id = (Sum ? 1 : 0) | (SumSquares ? 2 : 0) | (FirstLast ? 4 : 0);
+};
+
+// Just the min and max, for channels which are only ever drawn as an envelope
+typedef AggregateSet<false, false, false> EnvelopeAggregates;
+
+// The sum as well, so the average is known
+typedef AggregateSet<true, false, false> DefaultAggregates;
+
+// The sum of squares as well, for the RMS and standard deviation
+typedef AggregateSet<true, true, false> MomentAggregates;
+
+// The first and last samples as well, for open-high-low-close style plots
+typedef AggregateSet<true, false, true> OhlcAggregates;
+
+// The part of a set which a plotted sample is drawn from, the envelope and the sum for its average
+template <typename Set> using SampleAggregates = AggregateSet<Set::sum, false, false>;
+
+/**
+ * @brief The aggregates of a range of samples, with one field per aggregate in the set.
+ */
+template <typename T, typename Set = DefaultAggregates> struct DataStore;
+
+template <typename T> struct DataStore<T, EnvelopeAggregates>
+{
+    T min;
+    T max;
+};
+
+template <typename T> struct DataStore<T, DefaultAggregates>
+{
+    typename SampleTraits<T>::Sum sum;
+    T min;
+    T max;
+};
+
+template <typename T> struct DataStore<T, MomentAggregates>
+{
+    typename SampleTraits<T>::Sum sum;
+
+    // Kept as a double even for integer samples, where it would overflow all too soon
+    double sum_squares;
+    T min;
+    T max;
+};
+
+template <typename T> struct DataStore<T, OhlcAggregates>
+{
+    typename SampleTraits<T>::Sum sum;
+    T min;
+    T max;
+    T first;
+    T last;
+};
+} // namespace amber::database
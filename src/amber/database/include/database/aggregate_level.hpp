@@ -0,0 +1,373 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+#include "aggregate.hpp"
+#include "chunked_vector.hpp"
+#include "kernels.hpp"
+#include "snapshot.hpp"
+
+namespace amber::database
+{
+/**
+ * @brief One level of a mip-map pyramid, which stores each aggregate of its elements in an array
+ * of its own rather than storing DataStores one after the other.
+ *
+ * Each aggregate is a ChunkedVector of its own, e.g. for the default aggregates there is a vector
+ * of sums, one of mins and one of maxes. Element i of the level is made up of element i of every
+ * column, and all the columns are chunked in the same way. Scans along the level only pull the
+ * aggregates they need through the cache, see combine(), and there is no padding between fields, so
+ * e.g. the levels of 16-bit samples take 12 bytes per element rather than 16.
+ *
+ * Like ChunkedVector, the level has a single writer, and publishes its size once every column has
+ * been written up to it.
+ */
+template <typename T, typename Set, unsigned int ChunkSize> class AggregateLevel
+{
+    typedef typename SampleTraits<T>::Sum Sum;
+
+    // Stands in for the columns of aggregates which the set doesn't keep
+    struct NoColumn
+    {
+        explicit NoColumn(const std::shared_ptr<ChunkArena> &)
+        {
+        }
+    };
+
+    template <bool Keep, typename U>
+    using Column = std::conditional_t<Keep, ChunkedVector<U, ChunkSize>, NoColumn>;
+
+  public:
+    // The number of bytes each element takes across all of its columns
+    static constexpr std::size_t ELEMENT_SIZE = 2 * sizeof(T) + (Set::sum ? sizeof(Sum) : 0) +
+                                                (Set::sum_squares ? sizeof(double) : 0) +
+                                                (Set::first_last ? 2 * sizeof(T) : 0);
+
+    explicit AggregateLevel(std::shared_ptr<ChunkArena> arena = ChunkArena::global())
+        : _sum(arena), _sum_squares(arena), _min(arena), _max(arena), _first(arena), _last(arena),
+          _size(0)
+    {
+    }
+
+    AggregateLevel(const AggregateLevel &) = delete;
+    AggregateLevel &operator=(const AggregateLevel &) = delete;
+
+    /**
+     * @brief The number of elements which have been written to every column.
+     */
+    std::size_t size() const
+    {
+        return _size.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Gather the aggregates of a single element from the columns.
+     */
+    DataStore<T, Set> operator[](std::size_t index) const
+    {
+        DataStore<T, Set> result;
+        result.min = _min[index];
+        result.max = _max[index];
+        if constexpr (Set::sum)
+        {
+            result.sum = _sum[index];
+        }
+        if constexpr (Set::sum_squares)
+        {
+            result.sum_squares = _sum_squares[index];
+        }
+        if constexpr (Set::first_last)
+        {
+            result.first = _first[index];
+            result.last = _last[index];
+        }
+        return result;
+    }
+
+    /**
+     * @brief Find the aggregates of the elements between begin and end, which mustn't be empty, by
+     * scanning along each column in turn.
+     *
+     * Only the columns of the aggregates in Wanted, which must be part of the level's set, are
+     * scanned, e.g. a plot only needs the mins and maxes. The aggregates it leaves out are zero.
+     */
+    template <typename Wanted = Set>
+    DataStore<T, Set> combine(std::size_t begin, std::size_t end) const
+    {
+        static_assert((Set::sum || !Wanted::sum) && (Set::sum_squares || !Wanted::sum_squares) &&
+                          (Set::first_last || !Wanted::first_last),
+                      "Can only combine aggregates which the level keeps");
+
+        DataStore<T, Set> result{};
+        result.min = fold<kernels::Fold::Min>(_min, begin, end);
+        result.max = fold<kernels::Fold::Max>(_max, begin, end);
+        if constexpr (Wanted::sum)
+        {
+            result.sum = fold<kernels::Fold::Sum>(_sum, begin, end);
+        }
+        if constexpr (Wanted::sum_squares)
+        {
+            result.sum_squares = fold<kernels::Fold::Sum>(_sum_squares, begin, end);
+        }
+        if constexpr (Wanted::first_last)
+        {
+            result.first = _first[begin];
+            result.last = _last[end - 1];
+        }
+        return result;
+    }
+
+    /**
+     * @brief Append elements, scattering their aggregates into the columns.
+     */
+    void push(const DataStore<T, Set> *values, std::size_t count)
+    {
+        const auto size = _size.load(std::memory_order_relaxed);
+        resize_columns(size + count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            set(size + i, values[i]);
+        }
+        _size.store(size + count, std::memory_order_release);
+    }
+
+    /**
+     * @brief Grow the level to hold size elements, to be filled in with set() or combine_from().
+     * Elements in different chunks may be filled from different threads.
+     */
+    void resize(std::size_t size)
+    {
+        resize_columns(size);
+        if (size > _size.load(std::memory_order_relaxed))
+        {
+            _size.store(size, std::memory_order_release);
+        }
+    }
+
+    void set(std::size_t index, const DataStore<T, Set> &value)
+    {
+        _min[index] = value.min;
+        _max[index] = value.max;
+        if constexpr (Set::sum)
+        {
+            _sum[index] = value.sum;
+        }
+        if constexpr (Set::sum_squares)
+        {
+            _sum_squares[index] = value.sum_squares;
+        }
+        if constexpr (Set::first_last)
+        {
+            _first[index] = value.first;
+            _last[index] = value.last;
+        }
+    }
+
+    /**
+     * @brief Append every element which the level below now has enough elements for, each of which
+     * combines 2^fan_in_shift elements of it.
+     */
+    void push_combined(const AggregateLevel &below, std::size_t fan_in_shift)
+    {
+        const auto size = _size.load(std::memory_order_relaxed);
+        const auto end = below.size() >> fan_in_shift;
+        if (end <= size)
+        {
+            return;
+        }
+        resize_columns(end);
+        combine_from(below, fan_in_shift, size, end);
+        _size.store(end, std::memory_order_release);
+    }
+
+    /**
+     * @brief Fill in the elements between begin and end, which must be within size(), from the
+     * level below, a column at a time.
+     */
+    void combine_from(const AggregateLevel &below,
+                      std::size_t fan_in_shift,
+                      std::size_t begin,
+                      std::size_t end)
+    {
+        combine_column(below._min, _min, fan_in_shift, begin, end, [](T a, T b) {
+            return std::min(a, b);
+        });
+        combine_column(below._max, _max, fan_in_shift, begin, end, [](T a, T b) {
+            return std::max(a, b);
+        });
+        if constexpr (Set::sum)
+        {
+            combine_column(below._sum, _sum, fan_in_shift, begin, end, [](Sum a, Sum b) {
+                return a + b;
+            });
+        }
+        if constexpr (Set::sum_squares)
+        {
+            combine_column(below._sum_squares,
+                           _sum_squares,
+                           fan_in_shift,
+                           begin,
+                           end,
+                           [](double a, double b) { return a + b; });
+        }
+        if constexpr (Set::first_last)
+        {
+            combine_column(below._first, _first, fan_in_shift, begin, end, [](T a, T) {
+                return a;
+            });
+            combine_column(below._last, _last, fan_in_shift, begin, end, [](T, T b) {
+                return b;
+            });
+        }
+    }
+
+    /**
+     * @brief Only keep a window of the newest elements, see ChunkedVector::set_window().
+     */
+    void set_window(std::size_t elements)
+    {
+        for_each_column([elements](auto &column) { column.set_window(elements); });
+    }
+
+    /**
+     * @brief Drop every chunk which lies entirely before the given element, see
+     * ChunkedVector::trim().
+     */
+    void trim(std::size_t first)
+    {
+        for_each_column([first](auto &column) { column.trim(first); });
+    }
+
+    /**
+     * @brief Write the first count elements to a snapshot, one column after another.
+     */
+    void save(SnapshotWriter &writer, std::size_t count) const
+    {
+        for_each_column([&writer, count](const auto &column) { writer.write(column, count); });
+    }
+
+    /**
+     * @brief Fill an empty level from a snapshot written by save(), using the mapped file for
+     * storage.
+     *
+     * @throws std::runtime_error if the columns aren't all the same length.
+     */
+    void load(SnapshotReader &reader)
+    {
+        for_each_column([&reader](auto &column) { reader.read(column); });
+        const auto size = _min.size();
+        for_each_column([size](const auto &column) {
+            if (column.size() != size)
+            {
+                throw std::runtime_error("Snapshot level has columns of different lengths");
+            }
+        });
+        _size.store(size, std::memory_order_release);
+    }
+
+  private:
+    // Each chunk's run of the column is folded by the vector kernels, then the runs are joined up
+    template <kernels::Fold F, typename U>
+    static U fold(const ChunkedVector<U, ChunkSize> &column, std::size_t begin, std::size_t end)
+    {
+        std::optional<U> result;
+        for (const auto span : column.spans(begin, end))
+        {
+            const auto value = kernels::fold<F>(span.data(), span.size());
+            result = result ? join<F>(*result, value) : value;
+        }
+        return *result;
+    }
+
+    template <kernels::Fold F, typename U> static U join(U a, U b)
+    {
+        if constexpr (F == kernels::Fold::Min)
+        {
+            return std::min(a, b);
+        }
+        else if constexpr (F == kernels::Fold::Max)
+        {
+            return std::max(a, b);
+        }
+        else
+        {
+            return a + b;
+        }
+    }
+
+    // Chunks of the level below cover whole runs of elements of this level, so each one is
+    // combined into a contiguous run of one of this level's chunks
+    template <typename U, typename Op>
+    static void combine_column(const ChunkedVector<U, ChunkSize> &from,
+                               ChunkedVector<U, ChunkSize> &to,
+                               std::size_t fan_in_shift,
+                               std::size_t begin,
+                               std::size_t end,
+                               Op op)
+    {
+        const auto fan_in = std::size_t(1) << fan_in_shift;
+        auto index = begin;
+        for (const auto span : from.spans(begin << fan_in_shift, end << fan_in_shift))
+        {
+            auto *out = &to[index];
+            const auto count = span.size() >> fan_in_shift;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                const auto *in = span.data() + (i << fan_in_shift);
+                auto result = in[0];
+                for (std::size_t j = 1; j < fan_in; ++j)
+                {
+                    result = op(result, in[j]);
+                }
+                out[i] = result;
+            }
+            index += count;
+        }
+    }
+
+    void resize_columns(std::size_t size)
+    {
+        for_each_column([size](auto &column) { column.resize(size); });
+    }
+
+    template <typename Visit> void for_each_column(Visit &&visit)
+    {
+        if constexpr (Set::sum)
+        {
+            visit(_sum);
+        }
+        if constexpr (Set::sum_squares)
+        {
+            visit(_sum_squares);
+        }
+        visit(_min);
+        visit(_max);
+        if constexpr (Set::first_last)
+        {
+            visit(_first);
+            visit(_last);
+        }
+    }
+
+    template <typename Visit> void for_each_column(Visit &&visit) const
+    {
+        const_cast<AggregateLevel *>(this)->for_each_column(
+            [&visit](const auto &column) { visit(column); });
+    }
+
+    Column<Set::sum, Sum> _sum;
+    Column<Set::sum_squares, double> _sum_squares;
+    ChunkedVector<T, ChunkSize> _min;
+    ChunkedVector<T, ChunkSize> _max;
+    Column<Set::first_last, T> _first;
+    Column<Set::first_last, T> _last;
+
+    // The number of elements which every column has been written up to
+    std::atomic<std::size_t> _size;
+};
+} // namespace amber::database
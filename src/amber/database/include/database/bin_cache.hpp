@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "timeseries.hpp"
+
+namespace amber::database
+{
+/**
+ * @brief Remembers the bins produced by a timeseries from one frame to the next.
+ *
+ * Bins are snapped to a global grid of the requested width, i.e. bin K always covers
+ * [K * bin_width, (K + 1) * bin_width), so bin edges don't move while the view pans. Only bins
+ * which haven't been seen before are fetched from the timeseries, so panning by a few pixels only
+ * costs a few bins. Bins which may still receive samples, i.e. anything which isn't entirely
+ * before the newest sample, are never kept and are fetched again every time.
+ *
+ * Changing the bin width (e.g. by zooming) throws the cache away. Widths within a tiny relative
+ * tolerance of the cached width count as the same width, so rounding noise in the view transform
+ * doesn't defeat the cache.
+ *
+ * The cache assumes samples are only ever added to the end of the timeseries, or dropped from the
+ * start of it (see TimeSeriesDense::set_retention). When the oldest sample moves on, bins starting
+ * before it are fetched again. It is not thread safe, each reader should keep its own.
+ */
+class BinCache
+{
+  public:
+    /**
+     * @brief Same as TimeSeries::get_samples(), except the first bin starts on the grid line at or
+     * before timestamp_start.
+     *
+     * @param ts The timeseries to read, which should be the same one every time.
+     * @param samples Where to put the samples.
+     * @param timestamp_start Timestamp within the first bin.
+     * @param bin_width The width of each bin in seconds.
+     * @param num_bins The number of bins.
+     * @return std::size_t The number of non-empty bins written to samples.
+     */
+    std::size_t get_samples(const TimeSeries &ts,
+                            TSSample *samples,
+                            double timestamp_start,
+                            double bin_width,
+                            std::size_t num_bins);
+
+    /**
+     * @brief Same as above, but as of the given TimeSeries::published() count, e.g. from a
+     * ReadView. Bins are only kept once they're complete as of that count.
+     */
+    std::size_t get_samples(const TimeSeries &ts,
+                            std::size_t published,
+                            TSSample *samples,
+                            double timestamp_start,
+                            double bin_width,
+                            std::size_t num_bins);
+
+    /**
+     * @brief Forget every bin.
+     */
+    void clear();
+
+    /**
+     * @brief The number of bins which have been served from the cache.
+     */
+    std::size_t hits() const;
+
+    /**
+     * @brief The number of bins which have had to be fetched from the timeseries.
+     */
+    std::size_t misses() const;
+
+  private:
+    static constexpr double WIDTH_TOLERANCE = 1e-6;
+
+    enum class State : std::uint8_t
+    {
+        Missing,
+        Empty,
+        Full
+    };
+
+    struct Bin
+    {
+        TSSample sample;
+        State state;
+    };
+
+    double _bin_width = 0.0;
+    std::int64_t _first_bin = 0;
+
+    // The timestamp of the oldest sample when bins were last fetched
+    double _oldest = -std::numeric_limits<double>::infinity();
+    std::vector<Bin> _bins;
+    std::vector<Bin> _scratch;
+    std::vector<TSSample> _fetched;
+    std::size_t _hits = 0;
+    std::size_t _misses = 0;
+};
+} // namespace amber::database
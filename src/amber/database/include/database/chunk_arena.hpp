@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace amber::database
+{
+/**
+ * @brief Hands out the chunks used by ChunkedVector from a few large regions, rather than making a
+ * separate heap allocation for every chunk.
+ *
+ * Regions are REGION_SIZE bytes, aligned to REGION_SIZE, and are backed by transparent huge pages
+ * where the OS supports them. Chunks are carved out of the current region one after the other, so
+ * the chunks of a series being pushed to end up next to each other in memory. A chunk which is
+ * handed back goes on a free list for its size and is reused by the next chunk of that size.
+ * Regions are only given back to the OS when the arena itself goes away.
+ *
+ * Chunks too large to share a region get a region of their own, which goes straight back to the
+ * OS when they are freed.
+ *
+ * Any number of threads may allocate and free chunks at the same time.
+ */
+class ChunkArena
+{
+  public:
+    static constexpr std::size_t REGION_SIZE = 2 * 1024 * 1024;
+
+    ChunkArena() = default;
+    ~ChunkArena();
+    ChunkArena(const ChunkArena &) = delete;
+    ChunkArena &operator=(const ChunkArena &) = delete;
+
+    /**
+     * @brief The arena used by anything which isn't given one of its own.
+     */
+    static const std::shared_ptr<ChunkArena> &global();
+
+    /**
+     * @brief Get an uninitialized chunk of at least the given size, aligned to at least 64 bytes.
+     *
+     * @throws std::bad_alloc if the OS won't give us any more memory.
+     */
+    void *allocate(std::size_t bytes);
+
+    /**
+     * @brief Give back a chunk from allocate(), which must be passed the same size.
+     */
+    void deallocate(void *chunk, std::size_t bytes);
+
+    /**
+     * @brief The total size of the regions taken from the OS.
+     */
+    std::size_t reserved_bytes() const;
+
+    /**
+     * @brief The total size of the chunks currently handed out.
+     */
+    std::size_t allocated_bytes() const;
+
+  private:
+    static std::size_t round_up(std::size_t bytes);
+    static void *map_region(std::size_t bytes);
+    static void unmap_region(void *region, std::size_t bytes);
+
+    mutable std::mutex _mut;
+
+    // Every region which is shared between chunks, and how much of the newest one is used
+    std::vector<void *> _regions;
+    std::size_t _region_used = REGION_SIZE;
+
+    // Chunks which have been handed back, by size
+    std::map<std::size_t, std::vector<void *>> _free;
+
+    std::size_t _reserved_bytes = 0;
+    std::size_t _allocated_bytes = 0;
+};
+} // namespace amber::database
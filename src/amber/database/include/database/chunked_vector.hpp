@@ -1,24 +1,185 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstddef>
 #include <deque>
 #include <memory>
 #include <vector>
 #include <stdexcept>
+#include <type_traits>
+
+#include "chunk_arena.hpp"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace amber::database
 {
+/**
+ * @brief A contiguous run of elements, e.g. the part of a chunk which falls within a range.
+ */
+template <typename T> class Span
+{
+  public:
+    Span(T *data, std::size_t size) : _data(data), _size(size)
+    {
+    }
+
+    T *data() const
+    {
+        return _data;
+    }
+
+    std::size_t size() const
+    {
+        return _size;
+    }
+
+    T *begin() const
+    {
+        return _data;
+    }
+
+    T *end() const
+    {
+        return _data + _size;
+    }
+
+    T &operator[](std::size_t index) const
+    {
+        return _data[index];
+    }
+
+  private:
+    T *_data;
+    std::size_t _size;
+};
+
+/**
+ * @brief An append-only vector which stores its elements in fixed size chunks.
+ *
+ * Elements never move once they have been pushed, and neither does the directory of chunks, so a
+ * single writer may keep pushing while other threads read elements which have already been
+ * published to them. The vector publishes its own size once pushed elements have been written, so
+ * readers may use size() directly, or the owner can publish a size of its own when the elements
+ * only become meaningful along with something else.
+ *
+ * Elements which are next to each other in the same chunk are contiguous, and spans() walks a
+ * range of elements a chunk at a time, so loops can work on plain arrays rather than indexing
+ * every element through the directory.
+ *
+ * The chunk directory is split into pages which double in size, so page P holds 2^P chunks. This
+ * keeps the footprint of an empty vector small while never having to reallocate the directory.
+ *
+ * Chunks are normally allocated by the vector itself, but an existing std::vector can be adopted
+ * with adopt(), in which case its buffer is used for the chunks it covers instead of being copied.
+ *
+ * A full chunk which the vector allocated itself can be handed back with release(), e.g. once its
+ * contents have been stored some other way. Its slot in the directory is cleared, and the elements
+ * in it must not be accessed through the vector any more.
+ *
+ * Chunks come from a ChunkArena, so vectors sharing an arena share its regions and recycle each
+ * other's released chunks. T must be trivially destructible, as chunks aren't necessarily full.
+ *
+ * A vector which only ever needs its newest elements can be given a window with set_window(). The
+ * directory then becomes a ring just big enough for the window, and trim() drops the oldest chunks
+ * and keeps their storage for the next chunks to be added, so a vector which is trimmed as it
+ * grows neither allocates nor grows once the window is full. If it isn't trimmed in time, the ring
+ * is replaced by one twice the size rather than the writer having to wait.
+ */
 template <typename T, unsigned int ChunkSize> class ChunkedVector
 {
-    typedef std::array<T, ChunkSize> Chunk;
+    static_assert(std::is_trivially_destructible_v<T>, "Chunks are never destroyed element-wise");
+
+    struct ChunkDeleter
+    {
+        ChunkArena *arena = nullptr;
+
+        void operator()(T *chunk) const
+        {
+            arena->deallocate(chunk, sizeof(T) * ChunkSize);
+        }
+    };
 
   public:
-    ChunkedVector() : _size(0)
+    /**
+     * @brief A range of elements as a sequence of spans, one per chunk, for use in a range-based
+     * for loop.
+     */
+    template <typename Element> class SpanRange
+    {
+      public:
+        class iterator
+        {
+          public:
+            iterator(const ChunkedVector *vector, std::size_t index, std::size_t end)
+                : _vector(vector), _index(index), _end(end)
+            {
+            }
+
+            Span<Element> operator*() const
+            {
+                const auto offset = _index % ChunkSize;
+                const auto count = std::min<std::size_t>(ChunkSize - offset, _end - _index);
+                return Span<Element>(_vector->chunk_at(_index / ChunkSize) + offset, count);
+            }
+
+            iterator &operator++()
+            {
+                _index = std::min(_end, (_index / ChunkSize + 1) * ChunkSize);
+                return *this;
+            }
+
+            bool operator!=(const iterator &other) const
+            {
+                return _index != other._index;
+            }
+
+          private:
+            const ChunkedVector *_vector;
+            std::size_t _index;
+            std::size_t _end;
+        };
+
+        SpanRange(const ChunkedVector *vector, std::size_t begin, std::size_t end)
+            : _vector(vector), _begin(begin), _end(std::max(begin, end))
+        {
+        }
+
+        iterator begin() const
+        {
+            return iterator(_vector, _begin, _end);
+        }
+
+        iterator end() const
+        {
+            return iterator(_vector, _end, _end);
+        }
+
+      private:
+        const ChunkedVector *_vector;
+        std::size_t _begin;
+        std::size_t _end;
+    };
+
+    /**
+     * @brief Storage for a chunk which has been released from the vector, which goes back to the
+     * arena when it's dropped.
+     */
+    typedef std::unique_ptr<T[], ChunkDeleter> ChunkPtr;
+
+    explicit ChunkedVector(std::shared_ptr<ChunkArena> arena = ChunkArena::global())
+        : _arena(std::move(arena)), _size(0), _num_chunks(0)
     {
         //
     }
 
+    ChunkedVector(const ChunkedVector &) = delete;
+    ChunkedVector &operator=(const ChunkedVector &) = delete;
+
     void push_back(const T &value)
     {
         push(value);
@@ -26,25 +187,154 @@ template <typename T, unsigned int ChunkSize> class ChunkedVector
 
     void push(const T &value)
     {
-        ++_size;
-        if (_size > ChunkSize * _map.size())
+        const auto size = _size.load(std::memory_order_relaxed);
+        if (size == ChunkSize * _num_chunks)
         {
-            _map.push_back(std::make_unique<Chunk>());
+            add_chunk();
         }
 
-        const auto offset = (_size - 1) % ChunkSize;
-        auto &chunk = *(_map.back());
-        chunk[offset] = value;
+        chunk_at(_num_chunks - 1)[size % ChunkSize] = value;
+        _size.store(size + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Append a run of values, copying as much as possible into each chunk in one go.
+     *
+     * @param values Pointer to the first value, which must be convertible to T.
+     * @param count The number of values to append.
+     */
+    template <typename U> void push(const U *values, std::size_t count)
+    {
+        auto size = _size.load(std::memory_order_relaxed);
+        while (count)
+        {
+            if (size == ChunkSize * _num_chunks)
+            {
+                add_chunk();
+            }
+
+            const auto offset = size % ChunkSize;
+            const auto run = std::min<std::size_t>(count, ChunkSize - offset);
+            std::copy(values, values + run, chunk_at(_num_chunks - 1) + offset);
+
+            size += run;
+            values += run;
+            count -= run;
+        }
+        _size.store(size, std::memory_order_release);
     }
 
+    /**
+     * @brief Grow the vector to hold size elements, which are left uninitialized for the caller to
+     * fill in through operator[]. Elements in different chunks may be filled from different threads.
+     */
+    void resize(std::size_t size)
+    {
+        while (size > ChunkSize * _num_chunks)
+        {
+            add_chunk();
+        }
+        if (size > _size.load(std::memory_order_relaxed))
+        {
+            _size.store(size, std::memory_order_release);
+        }
+    }
+
+    /**
+     * @brief Take over the buffer of an empty vector's worth of values without copying them. Only
+     * a trailing partial chunk is copied, as the buffer can't grow in place.
+     */
+    void adopt(std::vector<T> &&values)
+    {
+        const auto owner = std::make_shared<const std::vector<T>>(std::move(values));
+        attach(owner->data(), owner->size(), owner);
+    }
+
+    /**
+     * @brief Fill an empty vector from external storage, which is used in place for every whole
+     * chunk it covers. Those chunks are never written to, and only a trailing partial chunk is
+     * copied.
+     *
+     * @param values Pointer to the first value.
+     * @param count The number of values.
+     * @param owner Keeps the storage alive for as long as the vector needs it.
+     */
+    void attach(const T *values, std::size_t count, std::shared_ptr<const void> owner)
+    {
+        if (size() != 0)
+        {
+            throw std::logic_error("Can only attach storage to an empty vector");
+        }
+
+        const auto whole_chunks = count / ChunkSize;
+        for (std::size_t chunk = 0; chunk < whole_chunks; ++chunk)
+        {
+            add_chunk(const_cast<T *>(values + chunk * ChunkSize));
+            _owned.emplace_back();
+        }
+        const auto attached = whole_chunks * ChunkSize;
+        _size.store(attached, std::memory_order_release);
+        _external = std::move(owner);
+        push(values + attached, count - attached);
+    }
+
+    /**
+     * @brief Only keep a window of the newest elements, see trim(). Must be called while the vector
+     * is empty, and rules out adopt() and attach().
+     *
+     * @param elements The most elements which will be kept at once, i.e. between the point the
+     * vector was last trimmed to and its size.
+     */
+    void set_window(std::size_t elements)
+    {
+        if (_num_chunks != 0)
+        {
+            throw std::logic_error("Can only set the window of an empty vector");
+        }
+
+        // Leave room for a chunk being filled as well as one only partly in the window
+        const auto chunks = (elements + ChunkSize - 1) / ChunkSize + 2;
+        std::size_t ring_size = 1;
+        while (ring_size < chunks)
+        {
+            ring_size <<= 1;
+        }
+        _rings.push_back(std::make_unique<Ring>(ring_size));
+        _ring.store(_rings.back().get(), std::memory_order_release);
+        _owned.resize(ring_size);
+    }
+
+    /**
+     * @brief Drop every chunk which lies entirely before the given element, keeping their storage
+     * for chunks added later. Only valid once a window has been set.
+     *
+     * Readers must have finished with the dropped chunks, and must not look at anything before the
+     * trimmed point from now on, as their storage may be reused straight away.
+     */
+    void trim(std::size_t first)
+    {
+        for (; _trimmed < _num_chunks && (_trimmed + 1) * ChunkSize <= first; ++_trimmed)
+        {
+            slot_at(_trimmed).store(nullptr, std::memory_order_relaxed);
+            if (auto &owned = owned_at(_trimmed))
+            {
+                _spare.push_back(std::move(owned));
+            }
+        }
+    }
+
+    /**
+     * @brief The number of elements which have been pushed and written, which any thread may read
+     * up to.
+     */
     std::size_t size() const
     {
-        return _size;
+        return _size.load(std::memory_order_acquire);
     }
 
     const T &at(std::size_t index) const
     {
-        if (index > size())
+        if (index >= size())
         {
             throw std::out_of_range("Out of range");
         }
@@ -54,15 +344,17 @@ template <typename T, unsigned int ChunkSize> class ChunkedVector
 
     const T &operator[](std::size_t index) const
     {
-        const auto chunk_index = index / ChunkSize;
-        const auto offset = index % ChunkSize;
-        const auto &chunk = *(_map[chunk_index]);
-        return chunk[offset];
+        return chunk_at(index / ChunkSize)[index % ChunkSize];
+    }
+
+    T &operator[](std::size_t index)
+    {
+        return chunk_at(index / ChunkSize)[index % ChunkSize];
     }
 
     const T &back() const
     {
-        return (*this)[_size - 1];
+        return (*this)[size() - 1];
     }
 
     const T &front() const
@@ -72,16 +364,217 @@ template <typename T, unsigned int ChunkSize> class ChunkedVector
 
     bool empty() const
     {
-        return _size == 0;
+        return size() == 0;
     }
 
+    /**
+     * @brief The number of elements the allocated chunks can hold. Only the writer should call this.
+     */
     std::size_t capacity() const
     {
-        return _map.size() * ChunkSize;
+        return _num_chunks * ChunkSize;
+    }
+
+    /**
+     * @brief The elements between begin and end, split into one span per chunk. The range must be
+     * within size(), and must not include released chunks.
+     */
+    SpanRange<const T> spans(std::size_t begin, std::size_t end) const
+    {
+        return SpanRange<const T>(this, begin, end);
+    }
+
+    /**
+     * @brief Like the const version above, but the elements may be written to, e.g. to fill in
+     * elements added by resize().
+     */
+    SpanRange<T> spans(std::size_t begin, std::size_t end)
+    {
+        return SpanRange<T>(this, begin, end);
+    }
+
+    /**
+     * @brief Get the elements of a chunk, or nullptr if the chunk has been released. Readers may
+     * call this while the writer releases chunks.
+     */
+    const T *chunk_data(std::size_t chunk_index) const
+    {
+        return chunk_at(chunk_index);
+    }
+
+    /**
+     * @brief Whether the vector allocated a chunk itself, and so could release it. Mustn't be asked
+     * about chunks which have been trimmed.
+     */
+    bool owns_chunk(std::size_t chunk_index) const
+    {
+        return owned_at(chunk_index) != nullptr;
+    }
+
+    /**
+     * @brief Clear a chunk's slot in the directory and hand its storage to the caller.
+     *
+     * @return The storage, or nullptr if the chunk wasn't allocated by the vector.
+     */
+    ChunkPtr release(std::size_t chunk_index)
+    {
+        auto &owned = owned_at(chunk_index);
+        if (!owned)
+        {
+            return nullptr;
+        }
+        slot_at(chunk_index).store(nullptr, std::memory_order_release);
+        return std::move(owned);
     }
 
   private:
-    std::vector<std::unique_ptr<Chunk>> _map;
-    std::size_t _size;
+    static constexpr std::size_t MAX_PAGES = 48;
+
+    // A ring of chunk slots, which replaces the directory once a window has been set
+    struct Ring
+    {
+        explicit Ring(std::size_t size)
+            : slots(std::make_unique<std::atomic<T *>[]>(size)), mask(size - 1)
+        {
+        }
+
+        std::unique_ptr<std::atomic<T *>[]> slots;
+        std::size_t mask;
+    };
+
+    static unsigned int page_of(std::size_t chunk_index)
+    {
+        const unsigned long long value = chunk_index + 1;
+#if defined(__GNUC__) || defined(__GNUG__)
+        return 63 ^ __builtin_clzll(value);
+#elif defined _MSC_VER
+        unsigned long leading;
+        _BitScanReverse64(&leading, value);
+        return leading;
+#endif
+    }
+
+    std::atomic<T *> &slot_at(std::size_t chunk_index) const
+    {
+        if (const auto *ring = _ring.load(std::memory_order_acquire))
+        {
+            return ring->slots[chunk_index & ring->mask];
+        }
+        const auto page = page_of(chunk_index);
+        const auto slot = chunk_index + 1 - (std::size_t(1) << page);
+        return _pages[page][slot];
+    }
+
+    T *chunk_at(std::size_t chunk_index) const
+    {
+        return slot_at(chunk_index).load(std::memory_order_acquire);
+    }
+
+    ChunkPtr &owned_at(std::size_t chunk_index)
+    {
+        const auto *ring = _ring.load(std::memory_order_relaxed);
+        return _owned[ring ? chunk_index & ring->mask : chunk_index];
+    }
+
+    const ChunkPtr &owned_at(std::size_t chunk_index) const
+    {
+        const auto *ring = _ring.load(std::memory_order_relaxed);
+        return _owned[ring ? chunk_index & ring->mask : chunk_index];
+    }
+
+    // Move the chunks which are still in the window over to a ring twice the size. Readers may
+    // still be looking at the old ring, so it's kept, and nothing in it changes from now on.
+    Ring *grow_ring()
+    {
+        const auto *old = _ring.load(std::memory_order_relaxed);
+        const auto ring_size = 2 * (old->mask + 1);
+        auto ring = std::make_unique<Ring>(ring_size);
+        std::vector<ChunkPtr> owned(ring_size);
+        for (auto chunk = _trimmed; chunk < _num_chunks; ++chunk)
+        {
+            ring->slots[chunk & ring->mask].store(
+                old->slots[chunk & old->mask].load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+            owned[chunk & ring->mask] = std::move(_owned[chunk & old->mask]);
+        }
+        _owned = std::move(owned);
+        _ring.store(ring.get(), std::memory_order_release);
+        _rings.push_back(std::move(ring));
+        return _rings.back().get();
+    }
+
+    void add_chunk(T *storage = nullptr)
+    {
+        if (auto *ring = _ring.load(std::memory_order_relaxed))
+        {
+            if (storage)
+            {
+                throw std::logic_error("Can't attach storage to a windowed vector");
+            }
+            if (_num_chunks - _trimmed > ring->mask)
+            {
+                ring = grow_ring();
+            }
+
+            // Reuse a trimmed chunk if there is one
+            auto &owned = owned_at(_num_chunks);
+            if (!_spare.empty())
+            {
+                owned = std::move(_spare.back());
+                _spare.pop_back();
+            }
+            else
+            {
+                owned.reset(static_cast<T *>(_arena->allocate(sizeof(T) * ChunkSize)));
+                owned.get_deleter().arena = _arena.get();
+            }
+            ring->slots[_num_chunks & ring->mask].store(owned.get(), std::memory_order_release);
+            ++_num_chunks;
+            return;
+        }
+
+        if (!storage)
+        {
+            // Elements are written before they are ever read, so don't bother initializing them
+            ChunkPtr chunk(static_cast<T *>(_arena->allocate(sizeof(T) * ChunkSize)),
+                           ChunkDeleter{_arena.get()});
+            _owned.push_back(std::move(chunk));
+            storage = _owned.back().get();
+        }
+
+        const auto page = page_of(_num_chunks);
+        if (!_pages[page])
+        {
+            _pages[page] = std::make_unique<std::atomic<T *>[]>(std::size_t(1) << page);
+        }
+        const auto slot = _num_chunks + 1 - (std::size_t(1) << page);
+        _pages[page][slot].store(storage, std::memory_order_release);
+        ++_num_chunks;
+    }
+
+    // Where chunks come from, which has to outlive them
+    std::shared_ptr<ChunkArena> _arena;
+
+    // Directory of chunks, which readers use to find elements
+    std::array<std::unique_ptr<std::atomic<T *>[]>, MAX_PAGES> _pages;
+
+    // Replaces the directory once a window has been set, with chunk C in slot C & mask. Every ring
+    // the vector has had is kept until it's destroyed, as readers may still be using an old one.
+    std::atomic<Ring *> _ring{nullptr};
+    std::vector<std::unique_ptr<Ring>> _rings;
+
+    // The storage behind each chunk (or each slot of the ring), or nullptr for chunks with external
+    // storage. Only the writer touches this.
+    std::vector<ChunkPtr> _owned;
+    std::shared_ptr<const void> _external;
+
+    // Chunks before this have been trimmed, and their storage is kept here until it's needed again
+    std::size_t _trimmed = 0;
+    std::vector<ChunkPtr> _spare;
+
+    // The number of elements which are safe for readers to access, whereas the number of chunks is
+    // only used by the writer
+    std::atomic<std::size_t> _size;
+    std::size_t _num_chunks;
 };
 } // namespace amber::database
@@ -1,36 +1,259 @@
 #pragma once
 
+#include "chunk_arena.hpp"
 #include "timeseries.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace amber::database
 {
+/**
+ * @brief Identifies a timeseries within a database. Handles are handed out in the order timeseries
+ * are registered starting from zero, and stay valid for as long as the database exists.
+ */
+typedef std::size_t SeriesHandle;
+
+/**
+ * @brief Every timeseries registered with a database at some point in time.
+ *
+ * A registry never changes once the database has published it. Registering a timeseries publishes
+ * a new registry instead, so anyone holding on to an old one can carry on using it.
+ */
+struct Registry
+{
+    struct Entry
+    {
+        std::string name;
+        std::shared_ptr<TimeSeries> ts;
+    };
+
+    // Every timeseries, indexed by handle
+    std::vector<Entry> series;
+
+    // Handles by name
+    std::map<std::string, SeriesHandle> handles;
+
+    // Counts the registries the database has published, starting from zero for the empty one
+    std::uint64_t generation = 0;
+};
+
+/**
+ * @brief Every timeseries in a registry pinned to the samples it had published when the view was
+ * taken (see TimeSeries::published()), so several timeseries can be read as of the same moment.
+ *
+ * Everything read through a view, e.g. while drawing a frame or exporting, stops at the same
+ * samples however long it takes, while the writers carry on pushing. Taking a view costs an atomic
+ * load per timeseries and reading through one never takes a lock. The counts are taken one after
+ * the other, so the newest samples of two timeseries with separate writers are only as close
+ * together as those writers keep them, but the channels of a TimeSeriesGroup always line up.
+ *
+ * A view doesn't hold on to samples which a timeseries drops (see TimeSeriesDense::set_retention).
+ */
+class ReadView
+{
+  public:
+    ReadView() = default;
+
+    explicit ReadView(std::shared_ptr<const Registry> registry);
+
+    /**
+     * @brief The registry the view was taken of, which won't change under the caller.
+     */
+    const Registry &registry() const;
+
+    /**
+     * @brief The published() count of a timeseries when the view was taken.
+     *
+     * @throws std::out_of_range if no timeseries had the handle when the view was taken.
+     */
+    std::size_t published(SeriesHandle handle) const;
+
+    /**
+     * @brief TimeSeries::get_samples() as of when the view was taken.
+     */
+    std::size_t get_samples(SeriesHandle handle,
+                            TSSample *samples,
+                            double timestamp_start,
+                            double bin_width,
+                            std::size_t num_samples) const;
+
+    /**
+     * @brief TimeSeries::get_span() as of when the view was taken.
+     */
+    std::pair<double, double> get_span(SeriesHandle handle) const;
+
+  private:
+    std::shared_ptr<const Registry> _registry = std::make_shared<const Registry>();
+    std::vector<std::size_t> _published;
+};
+
+/**
+ * @brief A collection of named timeseries.
+ *
+ * Timeseries may be registered from any thread at any time, e.g. by plugins as devices turn up.
+ * Readers never wait on them: the registry is copied, changed and published as a whole, and
+ * readers just pick up whichever registry was published last.
+ */
 class Database
 {
   public:
+    Database();
+    ~Database();
+    Database(const Database &) = delete;
+    Database &operator=(const Database &) = delete;
+
+    /**
+     * @brief The arena which timeseries belonging to this database should allocate their storage
+     * from, so their chunks are kept together and the database's memory can be accounted for on
+     * its own.
+     */
+    const std::shared_ptr<ChunkArena> &arena() const;
+
     /**
-     * @brief Add a new time series to the database.
+     * @brief Add a new time series to the database, and let the listeners know about it.
      *
-     * @param name The name of the timeseries.
+     * @param name The name of the timeseries. A timeseries which already has this name is
+     * replaced, and the new one takes over its handle.
      * @param timeseries The timeseries to add.
+     * @return The handle of the timeseries.
+     */
+    SeriesHandle register_timeseries(std::string name, std::shared_ptr<TimeSeries> timeseries);
+
+    /**
+     * @brief The registry as it stands, which won't change under the caller.
+     */
+    std::shared_ptr<const Registry> registry() const;
+
+    /**
+     * @brief Pin every timeseries to what it has published so far, for reading them consistently.
+     */
+    ReadView view() const;
+
+    /**
+     * @brief Look up a timeseries by its handle.
+     *
+     * @throws std::out_of_range if no timeseries has the handle.
      */
-    void register_timeseries(std::string name, std::shared_ptr<TimeSeries> timeseries);
+    std::shared_ptr<TimeSeries> get(SeriesHandle handle) const;
 
     /**
-     * @brief Get immutable access to all the entire list of time series in the
-     * database.
+     * @brief Find the handle of a timeseries by name.
+     */
+    std::optional<SeriesHandle> find(const std::string &name) const;
+
+    /**
+     * @brief Changes whenever a timeseries is registered, so a caller can cheaply poll for changes
+     * e.g. once a frame (see Registry::generation).
+     */
+    std::uint64_t generation() const;
+
+    /**
+     * @brief Get a call every time a timeseries is registered, with its handle.
      *
-     * @return const std::map<std::string, std::shared_ptr<TimeSeries>>&
+     * Listeners are called on the thread which registered the timeseries, once the new registry
+     * has been published, and without any lock held, so they may register timeseries or add and
+     * remove listeners themselves. Registrations on several threads call them at the same time,
+     * and a listener may still get a call which was under way when it was removed.
+     *
+     * @return An id which can be passed to remove_listener().
+     */
+    std::size_t add_listener(std::function<void(SeriesHandle)> listener);
+
+    void remove_listener(std::size_t id);
+
+    /**
+     * @brief Get a copy of every timeseries in the database by name.
      */
-    const std::map<std::string, std::shared_ptr<TimeSeries>> &data() const;
+    std::map<std::string, std::shared_ptr<TimeSeries>> data() const;
 
+    /**
+     * @brief The amount of memory actually used by every timeseries, with compressed samples
+     * counted at their compressed size.
+     */
     std::size_t memory_usage() const;
 
+    /**
+     * @brief The amount of memory every timeseries would use if none of it were compressed.
+     */
+    std::size_t logical_memory_usage() const;
+
     std::size_t num_samples() const;
 
+    /**
+     * @brief Keep the memory used by the database under a budget by moving the oldest raw samples
+     * out to a file, rather than running out of memory altogether.
+     *
+     * A background thread keeps an eye on memory_usage(), and once it goes over the budget spills
+     * the oldest samples across every timeseries which supports it until it's back under. Only raw
+     * samples are spilled, the mip-maps stay in memory so zoomed out views never touch the disk.
+     * Spilled samples are read back when they're looked at up close.
+     *
+     * @param bytes The budget in bytes.
+     * @param spill_directory Where to put the spill file, which is deleted when it's closed.
+     * @throws std::runtime_error if the spill file can't be created.
+     */
+    void set_memory_budget(std::size_t bytes, const std::string &spill_directory);
+
+    /**
+     * @brief Spill samples until the database is back within its memory budget, if it has one,
+     * rather than waiting for the background thread to get round to it.
+     */
+    void enforce_memory_budget();
+
+    /**
+     * @brief The number of bytes spilled to disk by every timeseries.
+     */
+    std::size_t spilled_bytes() const;
+
+    /**
+     * @brief Write every timeseries to a snapshot file, which can be opened again with load(). The
+     * timeseries are saved as of a view taken up front, so they all end at the same point.
+     *
+     * @throws std::runtime_error if the file can't be written.
+     */
+    void save(const std::string &path) const;
+
+    /**
+     * @brief Add every timeseries from a snapshot file written by save().
+     *
+     * The file is memory mapped and samples are read straight out of it, so this is quick no
+     * matter how large the file is, and only the parts of it which are looked at ever get read
+     * from disk. Loaded timeseries can still have samples pushed to them.
+     *
+     * @throws std::runtime_error if the file can't be opened or isn't a valid snapshot.
+     */
+    void load(const std::string &path);
+
   private:
-    std::map<std::string, std::shared_ptr<TimeSeries>> _data;
+    void _watch_budget();
+
+    std::shared_ptr<ChunkArena> _arena;
+
+    // The latest registry, which is only ever accessed atomically
+    std::shared_ptr<const Registry> _registry;
+
+    // Serializes registrations, readers never touch this
+    std::mutex _write_mut;
+
+    std::mutex _listener_mut;
+    std::vector<std::pair<std::size_t, std::function<void(SeriesHandle)>>> _listeners;
+    std::size_t _next_listener = 0;
+
+    // The memory budget, and the thread which enforces it
+    std::mutex _budget_mut;
+    std::condition_variable _budget_cond;
+    std::size_t _memory_budget = 0;
+    std::shared_ptr<SpillFile> _spill_file;
+    bool _stop = false;
+    std::thread _budget_thread;
 };
 } // namespace amber::database
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+
+#include "aggregate.hpp"
+
+namespace amber::database::kernels
+{
+/**
+ * @brief Instruction sets which the kernels can be built for.
+ */
+enum class Isa
+{
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+/**
+ * @brief Returns whether the kernels for an instruction set are built in and supported by this CPU.
+ */
+bool is_supported(Isa isa);
+
+/**
+ * @brief Returns the fastest instruction set supported by this CPU, which is what reduce() uses.
+ */
+Isa active_isa();
+
+/**
+ * @brief Find the sum, min and max of a contiguous run of samples.
+ *
+ * Every instruction set produces bit-for-bit identical results, as they all accumulate the run in
+ * the same number of lanes and combine those lanes in the same order.
+ *
+ * @param values Pointer to the first sample.
+ * @param count The number of samples, must be at least one.
+ */
+template <typename T> DataStore<T> reduce(const T *values, std::size_t count);
+
+/**
+ * @brief Like reduce(), but using the kernels for a specific instruction set, which must be
+ * supported.
+ */
+template <typename T> DataStore<T> reduce(const T *values, std::size_t count, Isa isa);
+
+/**
+ * @brief The ways fold() can combine a run of values.
+ */
+enum class Fold
+{
+    Min,
+    Max,
+    Sum
+};
+
+/**
+ * @brief Find the min, max or sum of a contiguous run of one column of aggregates, e.g. the mins
+ * of a run of mip-map blocks.
+ *
+ * Like reduce(), every instruction set gives bit-for-bit identical results. Sums are added up in
+ * lanes, so may differ in their last bits from adding the values up one after another.
+ *
+ * @param values Pointer to the first value.
+ * @param count The number of values, must be at least one.
+ */
+template <Fold F, typename T> T fold(const T *values, std::size_t count);
+
+/**
+ * @brief Like fold(), but using the kernels for a specific instruction set, which must be
+ * supported.
+ */
+template <Fold F, typename T> T fold(const T *values, std::size_t count, Isa isa);
+} // namespace amber::database::kernels
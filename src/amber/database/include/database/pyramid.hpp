@@ -0,0 +1,498 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "aggregate.hpp"
+#include "aggregate_level.hpp"
+#include "chunked_vector.hpp"
+#include "snapshot.hpp"
+
+namespace amber::database
+{
+class SpillFile;
+
+/**
+ * @brief The shape of a pyramid's mip-map levels (see Pyramid::set_geometry).
+ *
+ * Fewer, wider levels take less memory and keep reduces on fewer cache lines, at the cost of
+ * scanning more elements of the level below at the ragged ends of each range.
+ */
+struct PyramidGeometry
+{
+    // The first level summarizes blocks of 2^block_shift raw samples, between 1 and 8
+    unsigned int block_shift = 5;
+
+    // Each level above summarizes 2^fan_in_shift elements of the level below, between 1 and 4
+    unsigned int fan_in_shift = 1;
+};
+
+/**
+ * @brief Raw samples along with a mip-map pyramid of their sums, mins and maxes, indexed by sample
+ * number.
+ *
+ * Raw samples are stored on their own, and only the mip-map levels store the aggregates. By
+ * default the first mip-map level summarizes blocks of 32 raw samples, with each subsequent level
+ * summarizing pairs of elements from the level below. Reduces scan the raw samples directly for
+ * anything smaller than a block. With the default aggregates (sum, min & max) this comes to about
+ * 9.5 bytes per sample for double samples, and about 3 bytes per sample for 16-bit samples. Both
+ * the block size and the fan-in of the levels can be changed per pyramid (see PyramidGeometry).
+ *
+ * T is the type of the raw samples, which is instantiated for double, float, int16_t and int32_t.
+ * Set is the AggregateSet kept in the levels, which may be any of the sets in aggregate.hpp.
+ *
+ * The pyramid is append only and has a single writer. It does no synchronization of its own: the
+ * owner is expected to publish the number of samples which are safe to read once push() returns,
+ * and readers must only pass sizes and ranges below that published size.
+ *
+ * Pushing only appends the raw samples, and the mip-map levels are brought up to date off the
+ * writer's thread. Nothing is built for a pyramid until the first time it is read, which builds
+ * the levels for everything pushed so far. From then on the background worker builds them a chunk
+ * at a time as chunks are sealed, and reads cover the few samples newer than the levels from the
+ * raw samples, unless they're more than a chunk behind, in which case the reader catches them up
+ * itself. Pyramids with a retention are always kept up to date by the worker, as the levels must
+ * cover samples before they're dropped.
+ *
+ * Once a chunk of raw samples fills up it is sealed, and the background worker compresses it (see
+ * codec.hpp) and frees the original. Compressed chunks are split into frames of FRAME_SIZE samples
+ * which decode independently, and reads decode just the frame they need into a small per-thread
+ * cache of recently used frames. The mip-map levels are never compressed, so the cost of wide
+ * reduces hardly changes. Chunks which don't compress well, or which are backed by a snapshot file,
+ * are left as they are.
+ *
+ * When memory runs short the owner can spill() the oldest sealed chunks to disk, compressed or not,
+ * and they are read back a frame at a time when something needs them. The mip-map levels always
+ * stay in memory, and reduces over ranges of at least MIN_ROUNDED_RANGE samples never read spilled
+ * samples back: the ragged ends of the range are rounded to the nearest whole block and taken from
+ * the first level instead, once it has been built for them. A block which straddles the boundary
+ * between two such ranges goes to exactly one of them, so adjacent bins still add up to the same
+ * thing.
+ *
+ * Histograms of the sample values can be kept as well, once enable_histograms() is called. These
+ * live in levels of their own: the first counts blocks of HISTOGRAM_BLOCK_SIZE raw samples, and
+ * each level above merges HISTOGRAM_FAN_IN histograms from the level below, so the histogram of any
+ * range is found in the same way as its sum.
+ *
+ * A pyramid can be limited to its newest samples with set_retention(). Sample indices keep
+ * counting up from the first sample ever pushed, but once the oldest chunk of raw samples falls
+ * outside the retention window it is dropped, along with the parts of the levels which only cover
+ * it, and its storage is reused for a later chunk. Readers must only ask for samples from first()
+ * onwards, and must read first() while holding a ReadEpoch::Guard. The writer only moves first()
+ * on, and the background worker waits for readers who might have seen an older value before
+ * reusing anything, so readers never hold up the writer. If the worker falls several chunks
+ * behind, the pyramid uses more memory until it catches up.
+ *
+ * Without mipmaps: Complexity = O(N)
+ * With mipmaps: Worst case complexity = O(2*log2(N))
+ * Where N in the number of total samples required to be reduced.
+ */
+template <typename T, typename Set = DefaultAggregates> class Pyramid
+{
+  public:
+    static constexpr std::size_t CHUNK_SIZE = 16 * 1024;
+    static constexpr std::size_t FRAME_SIZE = 256;
+    static constexpr std::size_t MIN_ROUNDED_RANGE = 2048;
+    static constexpr std::size_t HISTOGRAM_BLOCK_SIZE = 1024;
+    static constexpr std::size_t HISTOGRAM_FAN_IN = 4;
+
+    /**
+     * @brief Create an empty pyramid.
+     *
+     * @param arena Where the chunks for the raw samples and levels come from.
+     */
+    explicit Pyramid(std::shared_ptr<ChunkArena> arena = ChunkArena::global());
+    ~Pyramid();
+    Pyramid(const Pyramid &) = delete;
+    Pyramid &operator=(const Pyramid &) = delete;
+
+    /**
+     * @brief Append samples. The mip-map levels are brought up to date later (see above).
+     *
+     * @param values Pointer to the first sample.
+     * @param count The number of samples to add.
+     */
+    template <typename U> void push(const U *values, std::size_t count)
+    {
+        while (count)
+        {
+            // With a retention, samples are aged out a chunk at a time, so nothing has to hold much
+            // more than the retention however big the batch is
+            const auto run =
+                _retention ? std::min(count, CHUNK_SIZE - _raw.size() % CHUNK_SIZE) : count;
+            {
+                // Adding chunks changes the bookkeeping the compressor uses to release them
+                std::unique_lock<std::mutex> lock(_seal_mut, std::defer_lock);
+                if (_raw.size() + run > _raw.capacity())
+                {
+                    lock.lock();
+                }
+                _raw.push(values, run);
+            }
+            if (_retention)
+            {
+                _age_out();
+            }
+            values += run;
+            count -= run;
+        }
+        _seal();
+    }
+
+    /**
+     * @brief Fill an empty pyramid with a copy of existing samples.
+     *
+     * The samples are split into power-of-two sized partitions, and the copy and the mip-map
+     * levels within each partition are built on their own thread. Only the few levels above the
+     * partitions are built serially.
+     *
+     * @param values Pointer to the first sample.
+     * @param count The number of samples.
+     * @param threads The number of threads to use, or 0 to use one per core.
+     * @throws std::logic_error if the pyramid isn't empty.
+     */
+    void bulk_load(const T *values, std::size_t count, unsigned int threads = 0);
+
+    /**
+     * @brief Like bulk_load() above, but takes over the buffer holding the samples rather than
+     * copying it.
+     */
+    void bulk_load(std::vector<T> &&values, unsigned int threads = 0);
+
+    /**
+     * @brief Find the aggregates of the raw samples between begin and end.
+     *
+     * @param begin Index of the first sample.
+     * @param end Index one past the last sample, must be greater than begin.
+     * @param size The number of published samples, only data below this is touched.
+     */
+    DataStore<T, Set> reduce(std::size_t begin, std::size_t end, std::size_t size) const;
+
+    /**
+     * @brief Find the aggregates of a batch of ranges in one go, e.g. the bins of a plot.
+     *
+     * The working level is picked once for the whole batch, as the coarsest level whose blocks are
+     * at most half as wide as the narrowest range. Every block of it within a range is read in one
+     * pass along the level, and only the ragged ends of each range are reduced from finer levels.
+     * The min and max come out the same as reduce() on each range, but sums are added up in a
+     * different order so may differ in their last bits.
+     *
+     * @param ranges The begin and end of each range, in order and not overlapping. An empty range
+     * gets the same result as a range whose samples are all rounded away.
+     * @param count The number of ranges.
+     * @param size The number of published samples, only data below this is touched.
+     * @param results Where to put the aggregates of each range.
+     * @param samples_only Only find the SampleAggregates of the set, which is all a plot needs, and
+     * skip the other columns of the blocks. The other aggregates of the results are unspecified.
+     */
+    void reduce(const std::pair<std::size_t, std::size_t> *ranges,
+                std::size_t count,
+                std::size_t size,
+                DataStore<T, Set> *results,
+                bool samples_only = false) const;
+
+    /**
+     * @brief Like the batched reduce() above, but trades accuracy for a fixed cost per range.
+     *
+     * The ends of each range are snapped to the nearest boundary between blocks of the coarsest
+     * level whose blocks are no wider than width, so each range is made of whole blocks and no raw
+     * samples are read. A range of width samples covers between one and 2^fan_in_shift blocks,
+     * e.g. one or two with the default fan-in of two, but up to 16 with a fan-in of 16. Blocks of
+     * the next level up would be wider than the ranges, so snapping to them would leave some
+     * ranges with no blocks at all. Ends which are the same before snapping are the same after it,
+     * so ranges which tile still do. Only the ragged edges before the first whole block and after
+     * the last are reduced exactly. Ranges narrower than a block of the first level aren't snapped
+     * at all.
+     *
+     * @param ranges The begin and end of each range, in order and not overlapping. Each is moved
+     * to the samples which were actually reduced.
+     * @param count The number of ranges.
+     * @param size The number of published samples, only data below this is touched.
+     * @param width The typical number of samples in a range, e.g. the width of a plot's bins.
+     * @param results Where to put the aggregates of each range.
+     * @param samples_only As for reduce().
+     * @return The furthest any end was moved, in samples, which is at most half of width.
+     */
+    std::size_t reduce_snapped(std::pair<std::size_t, std::size_t> *ranges,
+                               std::size_t count,
+                               std::size_t size,
+                               std::size_t width,
+                               DataStore<T, Set> *results,
+                               bool samples_only = false) const;
+
+    /**
+     * @brief Get a single raw sample.
+     */
+    T operator[](std::size_t index) const;
+
+    /**
+     * @brief Copy the raw samples between begin and end to values, decoding them if need be.
+     */
+    void read(std::size_t begin, std::size_t end, T *values) const;
+
+    /**
+     * @brief The number of samples pushed so far. Only the writer should call this, readers
+     * should use the published size instead.
+     */
+    std::size_t size() const
+    {
+        return _raw.size();
+    }
+
+    /**
+     * @brief Only keep the newest samples, dropping whole chunks of the oldest ones as new samples
+     * are pushed. Must be called before anything is pushed, and rules out loading from a snapshot.
+     *
+     * @param samples The number of samples which are always kept. Up to a chunk more are kept, as
+     * samples are dropped a chunk at a time.
+     * @throws std::invalid_argument if samples is 0.
+     * @throws std::logic_error if the pyramid isn't empty.
+     */
+    void set_retention(std::size_t samples);
+
+    /**
+     * @brief Change the shape of the mip-map levels. Must be called before anything is pushed.
+     *
+     * @throws std::invalid_argument if the geometry is out of range.
+     * @throws std::logic_error if the pyramid isn't empty.
+     */
+    void set_geometry(const PyramidGeometry &geometry);
+
+    /**
+     * @brief The shape of the mip-map levels.
+     */
+    PyramidGeometry geometry() const
+    {
+        return {static_cast<unsigned int>(_block_shift), static_cast<unsigned int>(_fan_in_shift)};
+    }
+
+    /**
+     * @brief The index of the oldest sample which is still kept, which is always 0 unless a
+     * retention has been set.
+     */
+    std::size_t first() const
+    {
+        return _first.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Gets the amount of memory used to store a given number of samples in bytes.
+     */
+    std::size_t memory_usage(std::size_t size) const;
+
+    /**
+     * @brief Gets the amount of memory a given number of samples would use if nothing had been
+     * compressed.
+     */
+    std::size_t logical_memory_usage(std::size_t size) const;
+
+    /**
+     * @brief Recycle the chunks which have aged out of the retention and compress every sealed
+     * chunk now on this thread, rather than waiting for the background worker to get round to it.
+     * Recycling waits for readers, so this mustn't be called while holding a read guard.
+     */
+    void compress();
+
+    /**
+     * @brief The oldest sealed chunk which is still held in memory, or nothing if every sealed
+     * chunk has been spilled or is backed by a snapshot file.
+     */
+    std::optional<std::size_t> spill_candidate() const;
+
+    /**
+     * @brief Write the oldest sealed chunk which is still held in memory out to a spill file, and
+     * free it. Chunks are compressed first if they haven't been already, and the levels are built
+     * over them, so the levels never have to be built from spilled samples.
+     *
+     * @return The amount of raw sample memory freed in bytes, or 0 if there was nothing to spill.
+     * Building the levels may have taken some of it up again.
+     * @throws std::runtime_error if the chunk can't be written, in which case it stays in memory.
+     */
+    std::size_t spill(const std::shared_ptr<SpillFile> &file);
+
+    /**
+     * @brief The number of bytes which have been written to spill files.
+     */
+    std::size_t spilled_bytes() const;
+
+    /**
+     * @brief Start keeping histograms of the sample values, including those already pushed. Only
+     * the writer may call this, and only once.
+     *
+     * @param low The bottom of the first bucket.
+     * @param high The top of the last bucket. Values outside the range go in the end buckets.
+     * @param buckets The number of equally sized buckets, a power of two between 2 and 256.
+     * @throws std::invalid_argument if the range or number of buckets is no good.
+     * @throws std::logic_error if histograms are already being kept.
+     */
+    void enable_histograms(double low, double high, unsigned int buckets);
+
+    /**
+     * @brief The number of buckets in each histogram, or 0 if histograms aren't being kept.
+     */
+    unsigned int histogram_buckets() const;
+
+    /**
+     * @brief Add the histogram of the raw samples between begin and end to counts, which holds
+     * histogram_buckets() counts. Must only be called once histograms are being kept.
+     */
+    void
+    histogram(std::size_t begin, std::size_t end, std::size_t size, std::uint64_t *counts) const;
+
+    /**
+     * @brief Write the samples from first up to size and the levels covering them to a snapshot,
+     * where they load back starting from 0.
+     *
+     * If first isn't 0, the levels don't line up with the saved samples, so the samples are copied
+     * into a pyramid of their own which is saved instead. With a retention, first must have been
+     * read from first() under a ReadEpoch::Guard which is held until this returns, so that nothing
+     * from first onwards is recycled while it's saved.
+     */
+    void save(SnapshotWriter &writer, std::size_t first, std::size_t size) const;
+
+    /**
+     * @brief Fill an empty pyramid from a snapshot. The raw samples and levels are used straight
+     * from the mapped file, so nothing is rebuilt.
+     */
+    void load(SnapshotReader &reader);
+
+  private:
+    static constexpr std::size_t MAX_LEVELS = 64;
+
+    // How many dropped chunks the windows leave room for on top of the retention, so they only grow
+    // if the worker falls this far behind with recycling them.
+    static constexpr std::size_t RECYCLE_LAG = 4;
+    typedef AggregateLevel<T, Set, CHUNK_SIZE> Level;
+    struct CompressedChunk;
+    typedef std::atomic<const CompressedChunk *> CompressedSlot;
+
+    static int count_trailing_zeros(unsigned long long value);
+    static int count_leading_zeros(unsigned long long value);
+    static DataStore<T, Set> summarize(const T *values, std::size_t count);
+    static DataStore<T, Set> combine(const DataStore<T, Set> &a, const DataStore<T, Set> &b);
+    static DataStore<T, Set> empty();
+    static DataStore<T, Set>
+    _combine_blocks(const Level &level, std::size_t begin, std::size_t end, bool samples_only);
+    void _build(std::size_t size) const;
+    void _catch_up(std::size_t size) const;
+    void _want(std::size_t size) const;
+    void _age_out();
+    void _build_parallel(const T *source, unsigned int threads);
+    void _seal();
+    void _post_maintenance();
+    void _recycle();
+    void _compress_sealed();
+    bool _dropped(std::size_t chunk) const;
+    bool _spilled(std::size_t index) const;
+    const T *_raw_values(std::size_t index) const;
+    static void _decode(const CompressedChunk &compressed, std::size_t frame, T *values);
+    Level &_level(std::size_t index) const;
+
+    // The log2 of the number of samples in each element of the given level
+    std::size_t _shift(std::size_t level) const
+    {
+        return _block_shift + level * _fan_in_shift;
+    }
+
+    // The coarsest level whose elements are no bigger than 2^row samples, which must be at least
+    // a block
+    std::size_t _level_at(int row) const
+    {
+        return (row - _block_shift) / _fan_in_shift;
+    }
+    struct Histograms;
+    void _build_histograms(Histograms &histograms, std::size_t size) const;
+    template <typename Visit>
+    void _visit_raw(std::size_t begin, std::size_t end, Visit &&visit) const;
+
+    // Combine the aggregates of the samples between begin and end onto result, greedily taking
+    // the coarsest blocks which fit. The caller holds a read guard.
+    void _reduce(std::size_t begin,
+                 std::size_t end,
+                 int row_max,
+                 bool wide,
+                 std::optional<DataStore<T, Set>> &result) const;
+
+    std::shared_ptr<ChunkArena> _arena;
+
+    // Raw samples
+    ChunkedVector<T, CHUNK_SIZE> _raw;
+
+    // Mip-map levels, where level L summarizes blocks of 2^_shift(L) raw samples. Levels are only
+    // ever created by the builder, and never move once created. Each keeps its aggregates in
+    // separate arrays, so scans only read the fields they need.
+    mutable std::array<std::unique_ptr<Level>, MAX_LEVELS> _data;
+    std::size_t _block_shift;
+    std::size_t _block_size;
+    std::size_t _fan_in_shift;
+
+    // Identifies this pyramid's frames in the per-thread caches of decoded frames
+    const std::uint64_t _id;
+
+    // Compressed versions of sealed raw chunks, which only the compressor writes to. A slot is
+    // filled before the raw chunk is released, so readers who find the raw chunk gone will always
+    // find it here.
+    ChunkedVector<CompressedSlot, 1024> _compressed;
+    std::size_t _next_to_compress;
+    std::atomic<std::size_t> _sealed;
+    std::atomic<std::size_t> _compressed_bytes;
+    std::atomic<std::size_t> _released_bytes;
+    bool _uses_worker;
+
+    // Chunks below this have been spilled, or skipped because a snapshot file holds them. The
+    // compressor also looks after spilling.
+    std::size_t _next_to_spill;
+    std::shared_ptr<SpillFile> _spill_file;
+    std::atomic<std::size_t> _spilled_bytes;
+
+    // Held by the writer while adding or dropping raw chunks, and by the compressor while releasing
+    // them
+    std::mutex _seal_mut;
+
+    // Only one compressor at a time
+    mutable std::mutex _compress_mut;
+
+    // Only one thread recycles dropped chunks at a time
+    std::mutex _recycle_mut;
+
+    // The number of samples to keep, or 0 to keep everything. Samples below _first have been
+    // dropped, and the raw chunks below _trimmed have been recycled, along with the compressed
+    // versions of them and the parts of the levels covering them. The writer moves _first on, and
+    // the worker follows with _trimmed. The compressor trims its own slots once _trimmed moves.
+    std::size_t _retention;
+    std::atomic<std::size_t> _first;
+    std::atomic<std::size_t> _trimmed;
+
+    // Histograms of the sample values, if they're being kept. They are built up before being
+    // published to readers, and from then on grow in step with the levels.
+    std::unique_ptr<Histograms> _histograms_storage;
+    std::atomic<Histograms *> _histograms;
+
+    // The levels and histograms cover every whole block of the samples below _built. Whichever
+    // thread brings them up to date holds _build_mut while it does, and never waits for readers
+    // while holding it, as readers may be waiting for it themselves.
+    mutable std::mutex _build_mut;
+    mutable std::atomic<std::size_t> _built;
+
+    // Set by the first read, from which point the worker keeps the levels up to date
+    mutable std::atomic<bool> _wanted;
+};
+
+#define AMBER_EXTERN_PYRAMID(T)                                                                    \
+    extern template class Pyramid<T, EnvelopeAggregates>;                                          \
+    extern template class Pyramid<T, DefaultAggregates>;                                           \
+    extern template class Pyramid<T, MomentAggregates>;                                            \
+    extern template class Pyramid<T, OhlcAggregates>;
+
+AMBER_EXTERN_PYRAMID(double)
+AMBER_EXTERN_PYRAMID(float)
+AMBER_EXTERN_PYRAMID(std::int16_t)
+AMBER_EXTERN_PYRAMID(std::int32_t)
+#undef AMBER_EXTERN_PYRAMID
+} // namespace amber::database
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "chunked_vector.hpp"
+
+namespace amber::database
+{
+/**
+ * @brief Identifies the kind of timeseries each entry in a snapshot holds.
+ */
+enum class SnapshotSeriesType : std::uint32_t
+{
+    Dense = 1,
+    Sparse = 2,
+};
+
+/**
+ * @brief Identifies the type of the raw samples of a dense timeseries in a snapshot.
+ */
+enum class SnapshotSampleType : std::uint32_t
+{
+    Double = 1,
+    Float = 2,
+    Int16 = 3,
+    Int32 = 4,
+};
+
+template <typename T> constexpr SnapshotSampleType snapshot_sample_type()
+{
+    if constexpr (std::is_same_v<T, double>)
+        return SnapshotSampleType::Double;
+    else if constexpr (std::is_same_v<T, float>)
+        return SnapshotSampleType::Float;
+    else if constexpr (std::is_same_v<T, std::int16_t>)
+        return SnapshotSampleType::Int16;
+    else
+    {
+        static_assert(std::is_same_v<T, std::int32_t>, "Unsupported sample type");
+        return SnapshotSampleType::Int32;
+    }
+}
+
+/**
+ * @brief Writes a snapshot file.
+ *
+ * A snapshot is a stream of plain values and arrays. Arrays are aligned to SNAPSHOT_ALIGNMENT
+ * within the file, so once the file is mapped into memory every chunk of an array lands on its own
+ * pages and can be used in place (see SnapshotReader).
+ *
+ * The snapshot is written next to the file as path + ".tmp" and only replaces it on close(), so a
+ * snapshot which is mapped by a reader can be saved over safely.
+ */
+class SnapshotWriter
+{
+  public:
+    static constexpr std::size_t SNAPSHOT_ALIGNMENT = 4096;
+
+    /**
+     * @brief Create the file and write the header.
+     *
+     * @throws std::runtime_error if the file can't be created.
+     */
+    explicit SnapshotWriter(const std::string &path);
+
+    SnapshotWriter(const SnapshotWriter &) = delete;
+    SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+
+    /**
+     * @brief Delete the partly written file if close() was never called.
+     */
+    ~SnapshotWriter();
+
+    template <typename V> void write(const V &value)
+    {
+        static_assert(std::is_trivially_copyable_v<V>, "Only plain values can be written");
+        write_bytes(&value, sizeof(V));
+    }
+
+    void write(const std::string &value);
+
+    /**
+     * @brief Write the first count elements of a chunked vector as an aligned array.
+     */
+    template <typename T, unsigned int ChunkSize>
+    void write(const ChunkedVector<T, ChunkSize> &vector, std::size_t count)
+    {
+        begin_array<T>(count);
+        for (const auto span : vector.spans(0, count))
+        {
+            write_elements(span.data(), span.size());
+        }
+    }
+
+    /**
+     * @brief Start an aligned array of count elements, which must be followed by exactly that many
+     * elements written with write_elements().
+     */
+    template <typename T> void begin_array(std::size_t count)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be written");
+        write<std::uint64_t>(count);
+        align();
+    }
+
+    template <typename T> void write_elements(const T *values, std::size_t count)
+    {
+        write_bytes(values, count * sizeof(T));
+    }
+
+    /**
+     * @brief Flush everything to disk and move the file into place.
+     *
+     * @throws std::runtime_error if anything failed to write, or the file couldn't be replaced.
+     */
+    void close();
+
+  private:
+    void write_bytes(const void *data, std::size_t size);
+    void align();
+
+    std::ofstream _file;
+    std::string _path;
+    std::size_t _offset = 0;
+    bool _closed = false;
+};
+
+/**
+ * @brief Reads a snapshot file by mapping it into memory.
+ *
+ * Arrays are never copied out of the file. Chunked vectors read from the snapshot point straight at
+ * the mapped pages, which keep the mapping alive, so the operating system only ever pages in the
+ * parts of the file which are actually looked at.
+ */
+class SnapshotReader
+{
+  public:
+    /**
+     * @brief Map the file and check its header.
+     *
+     * @throws std::runtime_error if the file can't be mapped or isn't a snapshot.
+     */
+    explicit SnapshotReader(const std::string &path);
+
+    template <typename V> V read()
+    {
+        static_assert(std::is_trivially_copyable_v<V>, "Only plain values can be read");
+        V value;
+        std::copy_n(bytes(sizeof(V)), sizeof(V), reinterpret_cast<char *>(&value));
+        return value;
+    }
+
+    std::string read_string();
+
+    /**
+     * @brief Read an array into an empty chunked vector, which uses the mapped file for storage.
+     */
+    template <typename T, unsigned int ChunkSize> void read(ChunkedVector<T, ChunkSize> &vector)
+    {
+        const auto count = read<std::uint64_t>();
+        align();
+        const auto *values = reinterpret_cast<const T *>(bytes(count * sizeof(T)));
+        vector.attach(values, count, _mapping);
+    }
+
+    bool at_end() const;
+
+  private:
+    const char *bytes(std::size_t size);
+    void align();
+
+    std::shared_ptr<const void> _mapping;
+    const char *_data = nullptr;
+    std::size_t _size = 0;
+    std::size_t _offset = 0;
+};
+} // namespace amber::database
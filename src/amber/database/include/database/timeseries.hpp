@@ -1,10 +1,17 @@
 #pragma once
 
+#include <cmath>
 #include <cstddef>
+#include <memory>
+#include <optional>
 #include <utility>
+#include <vector>
 
 namespace amber::database
 {
+class SnapshotWriter;
+class SpillFile;
+
 struct TSSample
 {
     float timestamp;
@@ -13,6 +20,25 @@ struct TSSample
     float max;
 };
 
+/**
+ * @brief Everything a timeseries knows about the samples in a bin, for analysis rather than
+ * drawing. Statistics which the timeseries doesn't keep (see AggregateSet) are NaN.
+ */
+struct TSStats
+{
+    double timestamp;
+
+    // The number of samples the statistics cover, or 0 if the timeseries can't tell
+    std::size_t count;
+    double average;
+    double min;
+    double max;
+    double rms;
+    double stddev;
+    double first;
+    double last;
+};
+
 /**
  * @brief The interface which all time series must implement.
  * A timeseries is a single numerical value which varies over time.
@@ -43,6 +69,27 @@ struct TimeSeries
      */
     virtual TSSample get_sample(double timestamp, double bin_width) const = 0;
 
+    /**
+     * @brief Like get_samples(), but with whatever statistics the timeseries keeps for each bin.
+     * The default only fills in what get_samples() provides.
+     */
+    virtual std::size_t get_stats(TSStats *stats,
+                                  double timestamp_start,
+                                  double bin_width,
+                                  std::size_t num_bins) const
+    {
+        std::vector<TSSample> samples(num_bins);
+        const auto count = get_samples(samples.data(), timestamp_start, bin_width, num_bins);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const auto nan = std::nan("");
+            const auto &sample = samples[i];
+            stats[i] = TSStats{
+                sample.timestamp, 0, sample.average, sample.min, sample.max, nan, nan, nan, nan};
+        }
+        return count;
+    }
+
     /**
      * @brief Get the timestamps of the oldest and newest samples.
      */
@@ -53,9 +100,104 @@ struct TimeSeries
      */
     virtual std::size_t memory_usage() const = 0;
 
+    /**
+     * @brief Gets the amount of memory the timeseries would use if none of it were compressed.
+     */
+    virtual std::size_t logical_memory_usage() const = 0;
+
     /**
      * @brief Get the total number of samples in this timeseries.
      */
     virtual std::size_t size() const = 0;
+
+    /**
+     * @brief Write the samples published so far to a snapshot (see Database::save).
+     */
+    virtual void save(SnapshotWriter &writer) const = 0;
+
+    /**
+     * @brief A count of the samples published so far, including any which have since been dropped,
+     * so it only ever goes up. Reads can be pinned to what had been published at this point by
+     * passing it to the *_at() methods, see ReadView.
+     */
+    virtual std::size_t published() const
+    {
+        return size();
+    }
+
+    /**
+     * @brief Like get_samples(), but ignoring any samples published after published() returned the
+     * given count. Timeseries which can't tell their samples apart this way read everything.
+     */
+    virtual std::size_t get_samples_at(std::size_t /* published */,
+                                       TSSample *samples,
+                                       double timestamp_start,
+                                       double bin_width,
+                                       std::size_t num_samples) const
+    {
+        return get_samples(samples, timestamp_start, bin_width, num_samples);
+    }
+
+    /**
+     * @brief Like get_samples_at(), but quicker and less exact, for drawing while the view is on
+     * the move. Bin edges may be moved to wherever is cheapest to read, by at most half a bin.
+     * Timeseries which can't do any better than get_samples_at() read exactly.
+     *
+     * @param error Set to the furthest any bin edge was moved, in seconds.
+     */
+    virtual std::size_t get_samples_approx(std::size_t published,
+                                           TSSample *samples,
+                                           double timestamp_start,
+                                           double bin_width,
+                                           std::size_t num_samples,
+                                           double &error) const
+    {
+        error = 0.0;
+        return get_samples_at(published, samples, timestamp_start, bin_width, num_samples);
+    }
+
+    /**
+     * @brief Like get_span(), as of the given published() count.
+     */
+    virtual std::pair<double, double> get_span_at(std::size_t /* published */) const
+    {
+        return get_span();
+    }
+
+    /**
+     * @brief Like save(), as of the given published() count.
+     */
+    virtual void save_at(SnapshotWriter &writer, std::size_t /* published */) const
+    {
+        save(writer);
+    }
+
+    /**
+     * @brief The timestamp of the oldest samples which spill() would move out of memory, or
+     * nothing if there's nothing left which can be spilled.
+     */
+    virtual std::optional<double> spill_candidate() const
+    {
+        return std::nullopt;
+    }
+
+    /**
+     * @brief Move the oldest samples which are still in memory out to a spill file, to be read
+     * back if they're needed (see Database::set_memory_budget).
+     *
+     * @return The amount of memory freed in bytes, or 0 if there was nothing to spill.
+     */
+    virtual std::size_t spill(const std::shared_ptr<SpillFile> &)
+    {
+        return 0;
+    }
+
+    /**
+     * @brief The number of bytes which have been moved out to spill files.
+     */
+    virtual std::size_t spilled_bytes() const
+    {
+        return 0;
+    }
 };
 } // namespace amber::database
@@ -1,23 +1,19 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <mutex>
-#include <tuple>
 #include <utility>
 #include <vector>
 
-#include "chunked_vector.hpp"
+#include "pyramid.hpp"
 #include "timeseries.hpp"
 
 namespace amber::database
 {
 
-struct DataStore
-{
-    double sum;
-    double min;
-    double max;
-};
-
 /**
  * @brief A timeseries implementaion for fixed-rate data sources.
  *
@@ -25,16 +21,44 @@ struct DataStore
  * interval. It writes samples in a densely packed array, which is preferrable to a sparse time
  * series as it uses less storage because samples don't require individual timestamping.
 
- * This implemenation creates mip-maps on the fly, which results in taking up three times a much
- * space as the raw samples, but makes reduce operations significantly cheaper.
+ * This implemenation keeps mip-maps of the samples (see Pyramid), which makes reduce operations
+ * significantly cheaper at the cost of about 20% more space than the raw samples.
  *
- * Actually, this implementation actually has a flaw which ends up taking up 6 time as much space as
- * raw samples, but this is an oversight and has lots of duplicate data!
+ * Samples may be pushed from one thread while any number of other threads read from the timeseries.
+ * The writer publishes the number of committed samples as soon as the raw samples have been
+ * written, and readers only ever look at data below that size. The mip-maps are built afterwards,
+ * off the writer's thread: nothing is built until the series is first read, and from then on the
+ * background worker catches them up a chunk at a time. Reads cover the published samples which the
+ * mip-maps don't yet reach straight from the raw samples, or bring the mip-maps up to date
+ * themselves if they have fallen more than a chunk behind, which is the only time a reader waits
+ * on a lock.
  *
  * Without mipmaps: Complexity = O(N)
  * With mipmaps: Worst case complexity = O(2*log2(N))
  * Where N in the number of total samples required to be reduced.
+ *
+ * T is the type the raw samples are stored as, and may be double, float, int16_t or int32_t. Storing
+ * samples from e.g. a 16-bit ADC as int16_t uses a quarter of the space of doubles. Aggregates are
+ * kept in a wider type (see SampleTraits), and results are always reported through the TimeSeries
+ * interface so users of the series don't care what the samples are stored as.
+ *
+ * Under memory pressure the oldest raw samples can be spilled to disk, while the mip-maps stay in
+ * memory so zoomed out views never wait on the disk.
+ *
+ * Set picks which aggregates the mip-maps keep (see AggregateSet). A channel which is only ever
+ * drawn as an envelope can drop the sum with EnvelopeAggregates, in which case the average is
+ * reported as the middle of the min and max. MomentAggregates and OhlcAggregates keep enough for
+ * get_stats() to report the RMS and standard deviation, or the first and last samples, of a bin
+ * of any size without touching the raw samples.
+ *
+ * Histograms of the sample values in each bin are available too, for series which opt in with
+ * enable_histograms(). With 64 buckets they cost about a third of a byte per sample.
+ *
+ * For unattended monitoring a series can keep just a sliding window of its newest samples with
+ * set_retention(), e.g. the last 24 hours, in which case its memory stops growing once the window
+ * is full. get_span() and size() only cover the samples which are still kept.
  */
+template <typename T = double, typename Set = DefaultAggregates>
 class TimeSeriesDense : public TimeSeries
 {
   public:
@@ -43,17 +67,34 @@ class TimeSeriesDense : public TimeSeries
      *
      * @param initial_timestamp Timestamp of the first sample.
      * @param interval Time interval between each sample.
+     * @param arena Where to allocate storage for samples from, e.g. Database::arena().
      */
-    TimeSeriesDense(double initial_timestamp, double interval);
+    TimeSeriesDense(double initial_timestamp,
+                    double interval,
+                    std::shared_ptr<ChunkArena> arena = ChunkArena::global());
 
     /**
      * @brief Create a timeseries initialized from an array of data.
      *
+     * The mip-maps for the initial data are built using every core (see Pyramid::bulk_load).
+     *
      * @param initial_timestamp Timestamp of the first sample.
      * @param interval Time interval between each sample.
      * @param init Initial data which which to fill the timeseries.
+     * @param arena Where to allocate storage for samples from.
      */
-    TimeSeriesDense(double initial_timestamp, double interval, const std::vector<double> init);
+    TimeSeriesDense(double initial_timestamp,
+                    double interval,
+                    const std::vector<T> &init,
+                    std::shared_ptr<ChunkArena> arena = ChunkArena::global());
+
+    /**
+     * @brief Create a timeseries which takes ownership of an array of data, rather than copying it.
+     */
+    TimeSeriesDense(double initial_timestamp,
+                    double interval,
+                    std::vector<T> &&init,
+                    std::shared_ptr<ChunkArena> arena = ChunkArena::global());
 
     virtual ~TimeSeriesDense() = default;
 
@@ -72,6 +113,61 @@ class TimeSeriesDense : public TimeSeries
                             double bin_width,
                             std::size_t num_bins) const override;
 
+    std::size_t get_stats(TSStats *stats,
+                          double timestamp_start,
+                          double bin_width,
+                          std::size_t num_bins) const override;
+
+    /**
+     * @brief Only keep the samples from the last so many seconds, dropping older samples a chunk
+     * at a time as new ones are pushed (see Pyramid::set_retention). Must be called before any
+     * samples are pushed.
+     *
+     * @param seconds The length of the window, which is rounded up to a whole number of samples.
+     * @throws std::logic_error if the timeseries isn't empty.
+     */
+    void set_retention(double seconds);
+
+    /**
+     * @brief Change the shape of the mip-maps, e.g. to trade query latency for memory on a busy
+     * channel (see PyramidGeometry). Must be called before any samples are pushed.
+     *
+     * @throws std::invalid_argument if the geometry is out of range.
+     * @throws std::logic_error if the timeseries isn't empty.
+     */
+    void set_geometry(const PyramidGeometry &geometry);
+
+    /**
+     * @brief Start keeping histograms of the sample values for get_histograms(), including the
+     * samples pushed so far (see Pyramid::enable_histograms).
+     *
+     * @param low The bottom of the first bucket.
+     * @param high The top of the last bucket. Samples outside the range go in the end buckets.
+     * @param buckets The number of buckets, a power of two between 2 and 256.
+     */
+    void enable_histograms(double low, double high, unsigned int buckets = 64);
+
+    /**
+     * @brief The number of buckets in each histogram, or 0 if histograms aren't being kept.
+     */
+    unsigned int histogram_buckets() const;
+
+    /**
+     * @brief Bins the samples like get_samples(), but finds the histogram of the samples in each
+     * bin rather than their average, min & max.
+     *
+     * @param counts Where to put num_bins histograms of histogram_buckets() counts each, one
+     * after the other. Unlike get_samples(), bins without any samples get a histogram of zeros.
+     * @param timestamp_start Where to start sampling from.
+     * @param bin_width Width (in time) of each bin.
+     * @param num_bins The number of bins.
+     * @throws std::logic_error if histograms aren't being kept.
+     */
+    void get_histograms(std::uint64_t *counts,
+                        double timestamp_start,
+                        double bin_width,
+                        std::size_t num_bins) const;
+
     /**
      * @brief Helper function to extract just a single sample.
      *
@@ -89,24 +185,132 @@ class TimeSeriesDense : public TimeSeries
 
     std::size_t memory_usage() const override;
 
+    std::size_t logical_memory_usage() const override;
+
     std::size_t size() const override;
 
+    void save(SnapshotWriter &writer) const override;
+
+    std::size_t published() const override;
+
+    std::size_t get_samples_at(std::size_t published,
+                               TSSample *samples,
+                               double timestamp_start,
+                               double bin_width,
+                               std::size_t num_samples) const override;
+
+    /**
+     * @brief Reads a bounded number of blocks of the mip-maps per bin, whatever its width, by
+     * snapping bin edges to the nearest block boundary (see Pyramid::reduce_snapped). That is one
+     * or two blocks with the default geometry, and at most the fan-in of the levels otherwise. Bins
+     * of less than a few dozen samples are read exactly.
+     */
+    std::size_t get_samples_approx(std::size_t published,
+                                   TSSample *samples,
+                                   double timestamp_start,
+                                   double bin_width,
+                                   std::size_t num_samples,
+                                   double &error) const override;
+
+    std::pair<double, double> get_span_at(std::size_t published) const override;
+
+    void save_at(SnapshotWriter &writer, std::size_t published) const override;
+
+    std::optional<double> spill_candidate() const override;
+
+    std::size_t spill(const std::shared_ptr<SpillFile> &file) override;
+
+    std::size_t spilled_bytes() const override;
+
+    /**
+     * @brief Open a timeseries saved by save(), once its type has been read from the snapshot.
+     * Samples pushed after loading are allocated from the given arena.
+     */
+    static std::shared_ptr<TimeSeriesDense>
+    load(SnapshotReader &reader, std::shared_ptr<ChunkArena> arena = ChunkArena::global());
+
     /**
      * @brief Adds a new sample to the end of the timeseries. The timestamp of this sample will be
      *
      * @param value
      */
-    void push_sample(double value);
+    void push_sample(T value)
+    {
+        push_samples(&value, 1);
+    }
+
+    /**
+     * @brief Adds a run of samples to the end of the timeseries in one go.
+     *
+     * This is much cheaper than pushing samples one at a time, as the lock is only taken once. The
+     * mip-maps are built off this thread (see Pyramid).
+     *
+     * @param values Pointer to the first sample, which is converted to T as it is stored.
+     * @param count The number of samples to add.
+     */
+    template <typename U> void push_samples(const U *values, std::size_t count)
+    {
+        std::lock_guard<std::mutex> _(_write_mut);
+        _pyramid.push(values, count);
+
+        // Only now that the samples are stored can readers be allowed to see them
+        _size.store(_pyramid.size(), std::memory_order_release);
+    }
 
   private:
-    static int count_trailing_zeros(unsigned long long value);
-    static int count_leading_zeros(unsigned long long value);
-    std::tuple<double, double, double> _reduce(std::size_t, std::size_t) const;
+    std::pair<double, double> _span(std::size_t first, std::size_t size) const;
+
+    // Work out the range of samples in each bin which has any, and hand it to visit along with the
+    // index of the bin. Only the samples published up to the given count are looked at.
+    template <typename Visit>
+    std::size_t _visit_bins(std::size_t published,
+                            double timestamp_start,
+                            double bin_width,
+                            std::size_t num_bins,
+                            Visit &&visit) const;
+
+    // Like _visit_bins(), but reduces every bin in one batch first, and hands the aggregates of
+    // each to emit along with its timestamp, range and the size they were reduced up to. If error
+    // isn't null, bin edges are snapped to save time and it is set to how far they moved, in
+    // samples. Bins which snapping leaves empty are dropped. If samples_only is set, only the
+    // SampleAggregates of each bin are filled in.
+    template <typename Emit>
+    std::size_t _reduce_bins(std::size_t published,
+                             double timestamp_start,
+                             double bin_width,
+                             std::size_t num_bins,
+                             std::size_t *error,
+                             bool samples_only,
+                             Emit &&emit) const;
+
+    // Fill in samples from the bins handed to emit by _reduce_bins()
+    std::size_t _get_samples(std::size_t published,
+                             TSSample *samples,
+                             double timestamp_start,
+                             double bin_width,
+                             std::size_t num_samples,
+                             std::size_t *error) const;
 
-    static constexpr std::size_t CHUNK_SIZE = 16 * 1024;
-    mutable std::recursive_mutex _mut;
-    std::vector<ChunkedVector<DataStore, CHUNK_SIZE>> _data;
+    Pyramid<T, Set> _pyramid;
     double _interval;
     double _start;
+
+    // The number of samples which are safe for readers to access
+    std::atomic<std::size_t> _size;
+
+    // Serializes writers, readers never touch this
+    std::mutex _write_mut;
 };
+
+#define AMBER_EXTERN_TIMESERIES_DENSE(T)                                                           \
+    extern template class TimeSeriesDense<T, EnvelopeAggregates>;                                  \
+    extern template class TimeSeriesDense<T, DefaultAggregates>;                                   \
+    extern template class TimeSeriesDense<T, MomentAggregates>;                                    \
+    extern template class TimeSeriesDense<T, OhlcAggregates>;
+
+AMBER_EXTERN_TIMESERIES_DENSE(double)
+AMBER_EXTERN_TIMESERIES_DENSE(float)
+AMBER_EXTERN_TIMESERIES_DENSE(std::int16_t)
+AMBER_EXTERN_TIMESERIES_DENSE(std::int32_t)
+#undef AMBER_EXTERN_TIMESERIES_DENSE
 } // namespace amber::database
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "timeseries.hpp"
+#include "timeseries_dense.hpp"
+
+namespace amber::database
+{
+/**
+ * @brief An arithmetic expression over the values of one or more timeseries, which a
+ * TimeSeriesDerived evaluates.
+ *
+ * Expressions are built up from timeseries and constants with the usual operators, e.g.
+ * `Expression(volts) * 1000.0` or `abs(Expression(left) - Expression(right))`. They're immutable
+ * and cheap to copy, as sub-expressions are shared.
+ */
+class Expression
+{
+  public:
+    /**
+     * @brief The expression which is just the values of a timeseries.
+     */
+    explicit Expression(std::shared_ptr<TimeSeries> series);
+
+    /**
+     * @brief The expression which is always the same value.
+     */
+    Expression(double constant);
+
+    // An expression of the form scale * series + offset, where series may be null if the
+    // expression doesn't depend on any timeseries at all
+    struct Affine
+    {
+        std::shared_ptr<TimeSeries> series;
+        double scale;
+        double offset;
+    };
+
+    /**
+     * @brief The expression as an affine map of a single timeseries, if it is one.
+     */
+    std::optional<Affine> affine() const;
+
+    friend Expression operator+(const Expression &lhs, const Expression &rhs);
+    friend Expression operator-(const Expression &lhs, const Expression &rhs);
+    friend Expression operator*(const Expression &lhs, const Expression &rhs);
+    friend Expression operator/(const Expression &lhs, const Expression &rhs);
+    friend Expression operator-(const Expression &operand);
+    friend Expression abs(const Expression &operand);
+
+  private:
+    friend class TimeSeriesDerived;
+
+    enum class Op
+    {
+        Series,
+        Constant,
+        Add,
+        Subtract,
+        Multiply,
+        Divide,
+        Negate,
+        Abs,
+    };
+
+    struct Node
+    {
+        Op op;
+        std::shared_ptr<TimeSeries> series;
+        double constant;
+        std::shared_ptr<const Node> lhs;
+        std::shared_ptr<const Node> rhs;
+    };
+
+    explicit Expression(std::shared_ptr<const Node> node) : _node(std::move(node))
+    {
+    }
+
+    static std::optional<Affine> _affine(const Node &node);
+
+    std::shared_ptr<const Node> _node;
+};
+
+Expression operator+(const Expression &lhs, const Expression &rhs);
+Expression operator-(const Expression &lhs, const Expression &rhs);
+Expression operator*(const Expression &lhs, const Expression &rhs);
+Expression operator/(const Expression &lhs, const Expression &rhs);
+Expression operator-(const Expression &operand);
+Expression abs(const Expression &operand);
+
+/**
+ * @brief A timeseries whose values are worked out from other timeseries when it's read, e.g. a
+ * channel converted to other units, or the difference between two channels.
+ *
+ * Nothing is done as samples are pushed to the inputs, so a derived series costs nothing to keep
+ * up to date. How it's read depends on the expression:
+ *
+ * - An affine map of one series (scale * series + offset) maps the min and max of each bin
+ *   straight through (swapping them if the scale is negative), so it reads from the input's
+ *   mip-maps at the same cost as the input itself and uses no memory of its own.
+ * - Anything else has to be evaluated sample by sample. The first read evaluates the expression
+ *   over every sample the inputs have in common and keeps the results in a TimeSeriesDense, and
+ *   later reads only evaluate samples which have been pushed to the inputs since. The results
+ *   can be spilled like any other dense series.
+ *
+ * Evaluated samples are on the timebase of the first input in the expression, which should be
+ * a dense series. The other inputs are sampled at the same rate: each value is the average of the
+ * input's samples over one interval starting half an interval after the sample, so an input with
+ * the same timebase contributes exactly its own sample. Gaps in an input hold its previous value.
+ *
+ * Any number of threads may read from the timeseries while the inputs are being pushed to.
+ */
+class TimeSeriesDerived : public TimeSeries
+{
+  public:
+    /**
+     * @brief Create a timeseries which evaluates the given expression.
+     *
+     * @throws std::invalid_argument if the expression doesn't depend on any timeseries.
+     */
+    explicit TimeSeriesDerived(Expression expression,
+                               std::shared_ptr<ChunkArena> arena = ChunkArena::global());
+
+    virtual ~TimeSeriesDerived() = default;
+
+    std::size_t get_samples(TSSample *samples,
+                            double timestamp_start,
+                            double bin_width,
+                            std::size_t num_samples) const override;
+
+    std::size_t get_stats(TSStats *stats,
+                          double timestamp_start,
+                          double bin_width,
+                          std::size_t num_bins) const override;
+
+    TSSample get_sample(double timestamp, double bin_width) const override;
+
+    std::pair<double, double> get_span() const override;
+
+    std::size_t memory_usage() const override;
+
+    std::size_t logical_memory_usage() const override;
+
+    std::size_t size() const override;
+
+    /**
+     * @brief Saves the evaluated samples as a dense series, which is what it loads back as.
+     */
+    void save(SnapshotWriter &writer) const override;
+
+    std::optional<double> spill_candidate() const override;
+
+    std::size_t spill(const std::shared_ptr<SpillFile> &file) override;
+
+    std::size_t spilled_bytes() const override;
+
+    /**
+     * @brief Whether reads map the input's aggregates directly, rather than evaluating samples.
+     */
+    bool is_affine() const
+    {
+        return _affine.has_value();
+    }
+
+  private:
+    typedef TimeSeriesDense<double> Cache;
+
+    // The expression flattened into postfix order, to be evaluated over a batch of samples at once
+    struct Instruction
+    {
+        Expression::Op op;
+        std::size_t input;
+        double constant;
+    };
+
+    static constexpr std::size_t EVALUATE_BATCH = 4096;
+
+    void _compile(const Expression::Node &node);
+
+    // The start and interval of the first input, or nothing if it doesn't have any samples yet
+    std::optional<std::pair<double, double>> _timebase() const;
+
+    // The number of samples which can be evaluated on the given timebase
+    std::size_t _available(const std::pair<double, double> &timebase) const;
+
+    // Evaluates samples from into.size() up to count, and pushes them to into
+    void _evaluate(Cache &into,
+                   const std::pair<double, double> &timebase,
+                   std::size_t count,
+                   std::vector<double> &held) const;
+
+    // Brings the cache up to date with the inputs, and returns it if there is one yet
+    const Cache *_catch_up() const;
+
+    std::optional<Expression::Affine> _affine;
+    std::vector<std::shared_ptr<TimeSeries>> _inputs;
+    std::vector<Instruction> _program;
+    std::shared_ptr<ChunkArena> _arena;
+
+    // Evaluated samples, created on the first read once the first input has some samples
+    mutable std::atomic<Cache *> _cache;
+    mutable std::unique_ptr<Cache> _cache_storage;
+    mutable double _start;
+    mutable double _interval;
+
+    // The last value of each input, for filling gaps, picked up where the cache left off
+    mutable std::vector<double> _held;
+
+    // Serializes readers which need to evaluate more samples
+    mutable std::mutex _evaluate_mut;
+};
+} // namespace amber::database
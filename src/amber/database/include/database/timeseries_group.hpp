@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "pyramid.hpp"
+#include "timeseries.hpp"
+
+namespace amber::database
+{
+/**
+ * @brief A set of fixed-rate channels which are sampled together, e.g. the channels of an audio
+ * file or a multi-channel DAQ.
+ *
+ * Every channel shares one start time and interval, so a whole frame of samples (one per channel)
+ * is pushed in one go, under one lock, with one published size. Reading several channels at once
+ * with get_samples() works out which samples fall in each bin once, and reduces every channel
+ * over the same range.
+ *
+ * Each channel still has a Pyramid of its own, and channel() presents it as a TimeSeries so it can
+ * be registered with a Database and plotted like any other. Saving a channel writes it as a dense
+ * timeseries, so it comes back from a snapshot as a TimeSeriesDense.
+ *
+ * Groups must be created with std::make_shared, as channels keep their group alive.
+ *
+ * Frames may be pushed from one thread while any number of other threads read from the group, in
+ * the same way as TimeSeriesDense.
+ */
+template <typename T = double>
+class TimeSeriesGroup : public std::enable_shared_from_this<TimeSeriesGroup<T>>
+{
+  public:
+    /**
+     * @brief Create an empty group.
+     *
+     * @param num_channels The number of samples in every frame.
+     * @param initial_timestamp Timestamp of the first frame.
+     * @param interval Time interval between each frame.
+     * @param arena Where to allocate storage for samples from, e.g. Database::arena().
+     */
+    TimeSeriesGroup(std::size_t num_channels,
+                    double initial_timestamp,
+                    double interval,
+                    std::shared_ptr<ChunkArena> arena = ChunkArena::global());
+
+    TimeSeriesGroup(const TimeSeriesGroup &) = delete;
+    TimeSeriesGroup &operator=(const TimeSeriesGroup &) = delete;
+
+    std::size_t num_channels() const
+    {
+        return _channels.size();
+    }
+
+    /**
+     * @brief Adds one sample to the end of every channel.
+     *
+     * @param channels Pointer to num_channels() samples, one per channel.
+     */
+    template <typename U> void push_frame(const U *channels)
+    {
+        push_frames(channels, 1);
+    }
+
+    /**
+     * @brief Adds a run of frames in one go.
+     *
+     * @param frames Pointer to count frames of num_channels() samples each, with the samples of a
+     * frame next to each other.
+     * @param count The number of frames.
+     */
+    template <typename U> void push_frames(const U *frames, std::size_t count)
+    {
+        std::lock_guard<std::mutex> _(_write_mut);
+        const auto num_channels = _channels.size();
+        while (count)
+        {
+            // Split the frames up into a run for each channel, a batch at a time
+            const auto batch = std::min(count, PUSH_BATCH);
+            _scratch.resize(batch);
+            for (std::size_t channel = 0; channel < num_channels; ++channel)
+            {
+                for (std::size_t i = 0; i < batch; ++i)
+                {
+                    _scratch[i] = static_cast<T>(frames[i * num_channels + channel]);
+                }
+                _channels[channel]->push(_scratch.data(), batch);
+            }
+            frames += batch * num_channels;
+            count -= batch;
+        }
+
+        // Every channel now has the new frames, so readers can see them all at once
+        _size.store(_channels.empty() ? 0 : _channels.front()->size(), std::memory_order_release);
+    }
+
+    /**
+     * @brief Bins every channel at once, like TimeSeries::get_samples().
+     *
+     * @param samples One array of num_bins samples for each channel.
+     * @param timestamp_start Where to start sampling from.
+     * @param bin_width Width (in time) of each bin.
+     * @param num_bins The number of bins.
+     * @return std::size_t The actual number of bins generated, which is the same for every channel.
+     */
+    std::size_t get_samples(TSSample *const *samples,
+                            double timestamp_start,
+                            double bin_width,
+                            std::size_t num_bins) const;
+
+    /**
+     * @brief Returns the timestamps of the oldest and newest frames.
+     */
+    std::pair<double, double> get_span() const;
+
+    /**
+     * @brief The number of frames in the group.
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief Gets the amount of memory used by every channel in bytes.
+     */
+    std::size_t memory_usage() const;
+
+    /**
+     * @brief A view of a single channel as a timeseries of its own.
+     *
+     * @throws std::out_of_range if there's no such channel.
+     */
+    std::shared_ptr<TimeSeries> channel(std::size_t index);
+
+  private:
+    class Channel;
+
+    static constexpr std::size_t PUSH_BATCH = 4096;
+
+    std::size_t _get_samples(TSSample *const *samples,
+                             std::size_t first_channel,
+                             std::size_t num_channels,
+                             std::size_t size,
+                             double timestamp_start,
+                             double bin_width,
+                             std::size_t num_bins) const;
+    std::pair<double, double> _span(std::size_t size) const;
+
+    std::vector<std::unique_ptr<Pyramid<T>>> _channels;
+    double _interval;
+    double _start;
+
+    // The number of frames which are safe for readers to access
+    std::atomic<std::size_t> _size;
+
+    // Serializes writers, readers never touch this
+    std::mutex _write_mut;
+
+    // Where a batch of frames is split up into channels, only the writer touches this
+    std::vector<T> _scratch;
+};
+extern template class TimeSeriesGroup<double>;
+extern template class TimeSeriesGroup<float>;
+extern template class TimeSeriesGroup<std::int16_t>;
+extern template class TimeSeriesGroup<std::int32_t>;
+} // namespace amber::database
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "chunked_vector.hpp"
+#include "pyramid.hpp"
+#include "timeseries.hpp"
+
+namespace amber::database
+{
+/**
+ * @brief A timeseries implementation for irregularly timestamped data sources.
+ *
+ * Use this timeseries implementation when your data source produces samples at irregular
+ * intervals, e.g. event driven sensors or bus traffic. Every sample carries its own timestamp, so
+ * this uses more storage per sample than TimeSeriesDense.
+ *
+ * Timestamps are quantized to a fixed resolution and stored chunk-wise: each chunk records the
+ * timestamp of its first sample and the index of that sample, and every sample stores a 32-bit
+ * offset from the start of its chunk. A new chunk is started when the current one is full or when
+ * the offset no longer fits. Finding the samples within a time range is a binary search of the
+ * chunk index followed by a binary search within a chunk, so O(log(N)).
+ *
+ * Values are stored in a mip-map pyramid indexed by sample number (see Pyramid), so once a time
+ * range has been turned into a range of samples it reduces just like the dense series does.
+ *
+ * Samples may be pushed from one thread while any number of other threads read from the timeseries,
+ * readers never take a lock.
+ */
+class TimeSeriesSparse : public TimeSeries
+{
+  public:
+    /**
+     * @brief Create an empty timeseries.
+     *
+     * @param resolution The resolution of timestamps in seconds, timestamps are rounded to the
+     * nearest multiple of this.
+     * @param arena Where to allocate storage for samples from, e.g. Database::arena().
+     */
+    explicit TimeSeriesSparse(double resolution = 1e-6,
+                              std::shared_ptr<ChunkArena> arena = ChunkArena::global());
+
+    virtual ~TimeSeriesSparse() = default;
+
+    std::size_t get_samples(TSSample *samples,
+                            double timestamp_start,
+                            double bin_width,
+                            std::size_t num_bins) const override;
+
+    TSSample get_sample(double timestamp, double bin_width) const override;
+
+    /**
+     * @brief Returns the timestamps of the oldest and newest samples.
+     */
+    std::pair<double, double> get_span() const override;
+
+    std::size_t memory_usage() const override;
+
+    std::size_t logical_memory_usage() const override;
+
+    std::size_t size() const override;
+
+    void save(SnapshotWriter &writer) const override;
+
+    std::size_t published() const override;
+
+    std::size_t get_samples_at(std::size_t published,
+                               TSSample *samples,
+                               double timestamp_start,
+                               double bin_width,
+                               std::size_t num_bins) const override;
+
+    std::pair<double, double> get_span_at(std::size_t published) const override;
+
+    void save_at(SnapshotWriter &writer, std::size_t published) const override;
+
+    /**
+     * @brief Open a timeseries saved by save(), once its type has been read from the snapshot.
+     * Samples pushed after loading are allocated from the given arena.
+     */
+    static std::shared_ptr<TimeSeriesSparse>
+    load(SnapshotReader &reader, std::shared_ptr<ChunkArena> arena = ChunkArena::global());
+
+    /**
+     * @brief Adds a new sample to the end of the timeseries.
+     *
+     * @param timestamp Timestamp of the sample, must not be older than the newest sample.
+     * @param value The value of the sample.
+     * @throws std::invalid_argument if the timestamp is older than the newest sample.
+     */
+    void push_sample(double timestamp, double value);
+
+    /**
+     * @brief Adds a run of samples to the end of the timeseries in one go.
+     *
+     * @param timestamps Pointer to the first timestamp, timestamps must be in order.
+     * @param values Pointer to the first value.
+     * @param count The number of samples to add.
+     * @throws std::invalid_argument if the timestamps are out of order, in which case nothing is
+     * added.
+     */
+    void push_samples(const double *timestamps, const double *values, std::size_t count);
+
+  private:
+    struct TimeChunk
+    {
+        std::int64_t first_tick;
+        std::size_t first_index;
+    };
+
+    static constexpr std::size_t CHUNK_SIZE = 16 * 1024;
+    static constexpr std::size_t INDEX_CHUNK_SIZE = 1024;
+    static constexpr std::size_t TIME_CHUNK_SIZE = 4096;
+
+    std::int64_t _to_tick(double timestamp) const;
+    std::int64_t _tick(std::size_t index, std::size_t chunk) const;
+    std::size_t _num_chunks(std::size_t size) const;
+    std::size_t _lower_bound(std::int64_t tick, std::size_t size, std::size_t num_chunks) const;
+    std::size_t _chunk_end(std::size_t chunk, std::size_t size, std::size_t num_chunks) const;
+    std::size_t _timestamp_memory_usage(std::size_t size) const;
+    void _append(std::int64_t tick);
+
+    double _resolution;
+    Pyramid<double> _values;
+    ChunkedVector<std::uint32_t, CHUNK_SIZE> _offsets;
+    ChunkedVector<TimeChunk, INDEX_CHUNK_SIZE> _chunks;
+
+    // The number of samples and chunks which are safe for readers to access. Chunks are published
+    // before samples so a reader never sees a sample without the chunk it belongs to.
+    std::atomic<std::size_t> _size;
+    std::atomic<std::size_t> _published_chunks;
+
+    // Serializes writers, readers never touch this
+    std::mutex _write_mut;
+};
+} // namespace amber::database
@@ -0,0 +1,74 @@
+#include "background_worker.hpp"
+
+#include <algorithm>
+
+using namespace amber::database;
+
+BackgroundWorker &BackgroundWorker::instance()
+{
+    static BackgroundWorker worker;
+    return worker;
+}
+
+BackgroundWorker::BackgroundWorker() : _thread(&BackgroundWorker::_run, this)
+{
+}
+
+BackgroundWorker::~BackgroundWorker()
+{
+    {
+        std::lock_guard<std::mutex> _(_mut);
+        _stop = true;
+    }
+    _cond.notify_all();
+    _thread.join();
+}
+
+void BackgroundWorker::post(const void *owner, std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> _(_mut);
+        const auto queued = std::any_of(
+            _jobs.begin(), _jobs.end(), [owner](const Job &job) { return job.owner == owner; });
+        if (queued)
+        {
+            return;
+        }
+        _jobs.push_back(Job{owner, std::move(job)});
+    }
+    _cond.notify_all();
+}
+
+void BackgroundWorker::cancel(const void *owner)
+{
+    std::unique_lock<std::mutex> lock(_mut);
+    _jobs.erase(std::remove_if(_jobs.begin(),
+                               _jobs.end(),
+                               [owner](const Job &job) { return job.owner == owner; }),
+                _jobs.end());
+    _cond.wait(lock, [this, owner]() { return _running != owner; });
+}
+
+void BackgroundWorker::_run()
+{
+    std::unique_lock<std::mutex> lock(_mut);
+    for (;;)
+    {
+        _cond.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+        if (_stop)
+        {
+            return;
+        }
+
+        auto job = std::move(_jobs.front());
+        _jobs.pop_front();
+        _running = job.owner;
+
+        lock.unlock();
+        job.run();
+        lock.lock();
+
+        _running = nullptr;
+        _cond.notify_all();
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace amber::database
+{
+/**
+ * @brief A single low priority thread which runs housekeeping jobs for the database, e.g.
+ * compressing chunks which have been sealed.
+ *
+ * Jobs belong to an owner, and an owner which is going away must call cancel() first, so none of
+ * its jobs are left waiting to run or running after it has gone.
+ */
+class BackgroundWorker
+{
+  public:
+    static BackgroundWorker &instance();
+
+    ~BackgroundWorker();
+
+    /**
+     * @brief Queue a job to run on the worker thread, unless the owner already has one waiting.
+     */
+    void post(const void *owner, std::function<void()> job);
+
+    /**
+     * @brief Drop any jobs belonging to the owner which haven't started yet, and wait for one which
+     * has to finish.
+     */
+    void cancel(const void *owner);
+
+  private:
+    struct Job
+    {
+        const void *owner;
+        std::function<void()> run;
+    };
+
+    BackgroundWorker();
+    void _run();
+
+    std::mutex _mut;
+    std::condition_variable _cond;
+    std::deque<Job> _jobs;
+    const void *_running = nullptr;
+    bool _stop = false;
+    std::thread _thread;
+};
+} // namespace amber::database
@@ -0,0 +1,132 @@
+#include "bin_cache.hpp"
+
+#include <cmath>
+
+using namespace amber::database;
+
+std::size_t BinCache::get_samples(const TimeSeries &ts,
+                                  TSSample *samples,
+                                  double timestamp_start,
+                                  double bin_width,
+                                  std::size_t num_bins)
+{
+    return get_samples(ts, ts.published(), samples, timestamp_start, bin_width, num_bins);
+}
+
+std::size_t BinCache::get_samples(const TimeSeries &ts,
+                                  std::size_t published,
+                                  TSSample *samples,
+                                  double timestamp_start,
+                                  double bin_width,
+                                  std::size_t num_bins)
+{
+    if (std::abs(bin_width - _bin_width) > _bin_width * WIDTH_TOLERANCE)
+    {
+        clear();
+        _bin_width = bin_width;
+    }
+
+    // Anything ending before the newest sample is complete, and can't change unless the oldest
+    // samples are dropped. Bins are fetched as of the same count, so samples arriving in the
+    // meantime can't land in bins which are kept.
+    const bool has_samples = published > 0;
+    const auto [oldest, newest] = ts.get_span_at(published);
+
+    // If samples have been dropped since last time, any bin starting before the oldest sample
+    // left may have lost some of them
+    const bool oldest_moved = has_samples && oldest > _oldest;
+    _oldest = has_samples ? oldest : _oldest;
+
+    // Carry over any bins which overlap the new window
+    const auto first_bin = static_cast<std::int64_t>(std::floor(timestamp_start / _bin_width));
+    _scratch.assign(num_bins, Bin{TSSample{}, State::Missing});
+    for (std::size_t i = 0; i < num_bins; ++i)
+    {
+        const auto index = first_bin + static_cast<std::int64_t>(i);
+        const auto old = index - _first_bin;
+        if (oldest_moved && index * _bin_width < oldest)
+        {
+            continue;
+        }
+        if (old >= 0 && old < static_cast<std::int64_t>(_bins.size()))
+        {
+            _scratch[i] = _bins[old];
+        }
+    }
+    _bins.swap(_scratch);
+    _first_bin = first_bin;
+    const auto misses = _misses;
+
+    // Fetch each run of missing bins in one go, so the timeseries can reduce them all in a single
+    // pass. Runs start on the grid, so bin edges are the same no matter where the window starts.
+    for (std::size_t i = 0; i < num_bins;)
+    {
+        if (_bins[i].state != State::Missing)
+        {
+            ++i;
+            continue;
+        }
+        auto end = i;
+        while (end < num_bins && _bins[end].state == State::Missing)
+        {
+            ++end;
+        }
+        _misses += end - i;
+
+        const auto run_start = (first_bin + static_cast<std::int64_t>(i)) * _bin_width;
+        _fetched.resize(end - i);
+        const auto found =
+            ts.get_samples_at(published, _fetched.data(), run_start, _bin_width, end - i);
+
+        // Only the bins which had samples come back, so put each one back where it belongs
+        for (std::size_t j = i; j < end; ++j)
+        {
+            _bins[j].state = State::Empty;
+        }
+        for (std::size_t j = 0; j < found; ++j)
+        {
+            const auto offset = std::llround((_fetched[j].timestamp - run_start) / _bin_width);
+            auto &bin = _bins[i + static_cast<std::size_t>(offset)];
+            bin.sample = _fetched[j];
+            bin.state = State::Full;
+        }
+
+        i = end;
+    }
+    _hits += num_bins - (_misses - misses);
+
+    auto *current_sample = samples;
+    for (std::size_t i = 0; i < num_bins; ++i)
+    {
+        auto &bin = _bins[i];
+        if (bin.state == State::Full)
+        {
+            *current_sample++ = bin.sample;
+        }
+
+        // Bins which may still receive samples are fetched again next time
+        const auto bin_end = (first_bin + static_cast<std::int64_t>(i) + 1) * _bin_width;
+        if (!has_samples || bin_end >= newest)
+        {
+            bin.state = State::Missing;
+        }
+    }
+
+    return current_sample - samples;
+}
+
+void BinCache::clear()
+{
+    _bins.clear();
+    _first_bin = 0;
+}
+
+std::size_t BinCache::hits() const
+{
+    return _hits;
+}
+
+std::size_t BinCache::misses() const
+{
+    return _misses;
+}
@@ -0,0 +1,159 @@
+#include "chunk_arena.hpp"
+
+#include <cstdint>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+using namespace amber::database;
+
+namespace
+{
+constexpr std::size_t CHUNK_ALIGNMENT = 64;
+constexpr std::size_t PAGE_SIZE = 4096;
+
+// Anything bigger than this would waste too much of a shared region, so gets one of its own
+constexpr std::size_t MAX_SHARED_CHUNK = ChunkArena::REGION_SIZE / 4;
+} // namespace
+
+ChunkArena::~ChunkArena()
+{
+    // Chunks hold on to the arena which they came from, so there can't be any left by now
+    for (auto region : _regions)
+    {
+        unmap_region(region, REGION_SIZE);
+    }
+}
+
+const std::shared_ptr<ChunkArena> &ChunkArena::global()
+{
+    static const auto arena = std::make_shared<ChunkArena>();
+    return arena;
+}
+
+void *ChunkArena::allocate(std::size_t bytes)
+{
+    bytes = round_up(bytes);
+    if (bytes > MAX_SHARED_CHUNK)
+    {
+        auto chunk = map_region(bytes);
+        std::lock_guard<std::mutex> _(_mut);
+        _reserved_bytes += bytes;
+        _allocated_bytes += bytes;
+        return chunk;
+    }
+
+    std::lock_guard<std::mutex> _(_mut);
+    auto &free = _free[bytes];
+    if (!free.empty())
+    {
+        auto chunk = free.back();
+        free.pop_back();
+        _allocated_bytes += bytes;
+        return chunk;
+    }
+
+    // Whatever is left at the end of the current region is wasted, which is at most a quarter of it
+    if (_region_used + bytes > REGION_SIZE)
+    {
+        // Make room first, so the new region can't leak if this throws
+        _regions.reserve(_regions.size() + 1);
+        _regions.push_back(map_region(REGION_SIZE));
+        _region_used = 0;
+        _reserved_bytes += REGION_SIZE;
+    }
+    auto chunk = static_cast<char *>(_regions.back()) + _region_used;
+    _region_used += bytes;
+    _allocated_bytes += bytes;
+    return chunk;
+}
+
+void ChunkArena::deallocate(void *chunk, std::size_t bytes)
+{
+    bytes = round_up(bytes);
+    if (bytes > MAX_SHARED_CHUNK)
+    {
+        unmap_region(chunk, bytes);
+        std::lock_guard<std::mutex> _(_mut);
+        _reserved_bytes -= bytes;
+        _allocated_bytes -= bytes;
+        return;
+    }
+
+    std::lock_guard<std::mutex> _(_mut);
+    _allocated_bytes -= bytes;
+    _free[bytes].push_back(chunk);
+}
+
+std::size_t ChunkArena::reserved_bytes() const
+{
+    std::lock_guard<std::mutex> _(_mut);
+    return _reserved_bytes;
+}
+
+std::size_t ChunkArena::allocated_bytes() const
+{
+    std::lock_guard<std::mutex> _(_mut);
+    return _allocated_bytes;
+}
+
+std::size_t ChunkArena::round_up(std::size_t bytes)
+{
+    const auto alignment = bytes > MAX_SHARED_CHUNK ? PAGE_SIZE : CHUNK_ALIGNMENT;
+    return (bytes + alignment - 1) / alignment * alignment;
+}
+
+void *ChunkArena::map_region(std::size_t bytes)
+{
+#ifdef _WIN32
+    // Large pages need special privileges on Windows, so settle for the alignment
+    auto region = _aligned_malloc(bytes, REGION_SIZE);
+    if (!region)
+    {
+        throw std::bad_alloc();
+    }
+    return region;
+#else
+    // Map enough to be sure of finding an aligned region inside, then trim off the ends
+    const auto mapped_bytes = bytes + REGION_SIZE;
+    auto mapped = mmap(
+        nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+
+    const auto address = reinterpret_cast<std::uintptr_t>(mapped);
+    const auto aligned = (address + REGION_SIZE - 1) / REGION_SIZE * REGION_SIZE;
+    const auto head = aligned - address;
+    if (head)
+    {
+        munmap(mapped, head);
+    }
+    if (mapped_bytes - head > bytes)
+    {
+        munmap(reinterpret_cast<void *>(aligned + bytes), mapped_bytes - head - bytes);
+    }
+
+    auto region = reinterpret_cast<void *>(aligned);
+#ifdef MADV_HUGEPAGE
+    // Only a hint, the kernel is free to ignore it
+    madvise(region, bytes, MADV_HUGEPAGE);
+#endif
+    return region;
+#endif
+}
+
+void ChunkArena::unmap_region(void *region, std::size_t bytes)
+{
+#ifdef _WIN32
+    (void)bytes;
+    _aligned_free(region);
+#else
+    munmap(region, bytes);
+#endif
+}
@@ -0,0 +1,307 @@
+#include "codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+using namespace amber::database;
+
+namespace
+{
+class BitWriter
+{
+  public:
+    explicit BitWriter(std::vector<std::uint8_t> &out) : _out(out)
+    {
+    }
+
+    ~BitWriter()
+    {
+        if (_used)
+        {
+            _out.push_back(static_cast<std::uint8_t>(_bits << (8 - _used)));
+        }
+    }
+
+    // Write the bottom count bits of value, most significant first
+    void write(std::uint64_t value, unsigned int count)
+    {
+        while (count)
+        {
+            const auto take = std::min(count, 8 - _used);
+            count -= take;
+            const auto bits = (value >> count) & ((1u << take) - 1);
+            _bits = (_bits << take) | static_cast<unsigned int>(bits);
+            _used += take;
+            if (_used == 8)
+            {
+                _out.push_back(static_cast<std::uint8_t>(_bits));
+                _bits = 0;
+                _used = 0;
+            }
+        }
+    }
+
+  private:
+    std::vector<std::uint8_t> &_out;
+    unsigned int _bits = 0;
+    unsigned int _used = 0;
+};
+
+class BitReader
+{
+  public:
+    explicit BitReader(const std::uint8_t *data) : _data(data)
+    {
+    }
+
+    std::uint64_t read(unsigned int count)
+    {
+        std::uint64_t value = 0;
+        while (count)
+        {
+            const auto available = 8 - _used;
+            const auto take = std::min(count, available);
+            const auto bits = (*_data >> (available - take)) & ((1u << take) - 1);
+            value = (value << take) | bits;
+            count -= take;
+            _used += take;
+            if (_used == 8)
+            {
+                ++_data;
+                _used = 0;
+            }
+        }
+        return value;
+    }
+
+    bool read_bit()
+    {
+        return read(1);
+    }
+
+  private:
+    const std::uint8_t *_data;
+    unsigned int _used = 0;
+};
+
+int leading_zeros(std::uint64_t value)
+{
+#if defined(__GNUC__) || defined(__GNUG__)
+    return value ? __builtin_clzll(value) : 64;
+#else
+    int count = 0;
+    for (auto bit = std::uint64_t(1) << 63; bit && !(value & bit); bit >>= 1)
+        ++count;
+    return count;
+#endif
+}
+
+int trailing_zeros(std::uint64_t value)
+{
+#if defined(__GNUC__) || defined(__GNUG__)
+    return value ? __builtin_ctzll(value) : 64;
+#else
+    int count = 0;
+    for (std::uint64_t bit = 1; bit && !(value & bit); bit <<= 1)
+        ++count;
+    return count;
+#endif
+}
+
+template <typename T> using Bits = std::conditional_t<sizeof(T) == 8, std::uint64_t, std::uint32_t>;
+
+template <typename T> Bits<T> to_bits(T value)
+{
+    Bits<T> bits;
+    std::memcpy(&bits, &value, sizeof(T));
+    return bits;
+}
+
+template <typename T> T from_bits(Bits<T> bits)
+{
+    T value;
+    std::memcpy(&value, &bits, sizeof(T));
+    return value;
+}
+
+// Leading zero counts and window lengths both fit in 6 bits, with a length of 64 stored as 0
+constexpr unsigned int COUNT_BITS = 6;
+
+template <typename T> void encode_floats(const T *values, std::size_t count, BitWriter &writer)
+{
+    constexpr int WIDTH = sizeof(T) * 8;
+    auto previous = to_bits(values[0]);
+    writer.write(previous, WIDTH);
+
+    int window_leading = -1;
+    int window_trailing = 0;
+    for (std::size_t i = 1; i < count; ++i)
+    {
+        const auto bits = to_bits(values[i]);
+        const std::uint64_t diff = bits ^ previous;
+        previous = bits;
+
+        if (diff == 0)
+        {
+            writer.write(0, 1);
+            continue;
+        }
+
+        const int leading = leading_zeros(diff) - (64 - WIDTH);
+        const int trailing = trailing_zeros(diff);
+        if (window_leading >= 0 && leading >= window_leading && trailing >= window_trailing)
+        {
+            // Fits in the previous window
+            writer.write(0b10, 2);
+            writer.write(diff >> window_trailing, WIDTH - window_leading - window_trailing);
+        }
+        else
+        {
+            const int length = WIDTH - leading - trailing;
+            writer.write(0b11, 2);
+            writer.write(leading, COUNT_BITS);
+            writer.write(length & 63, COUNT_BITS);
+            writer.write(diff >> trailing, length);
+            window_leading = leading;
+            window_trailing = trailing;
+        }
+    }
+}
+
+template <typename T> void decode_floats(BitReader &reader, std::size_t count, T *values)
+{
+    constexpr int WIDTH = sizeof(T) * 8;
+    auto previous = static_cast<Bits<T>>(reader.read(WIDTH));
+    values[0] = from_bits<T>(previous);
+
+    int window_leading = 0;
+    int window_trailing = 0;
+    for (std::size_t i = 1; i < count; ++i)
+    {
+        if (reader.read_bit())
+        {
+            if (reader.read_bit())
+            {
+                window_leading = static_cast<int>(reader.read(COUNT_BITS));
+                int length = static_cast<int>(reader.read(COUNT_BITS));
+                length = length ? length : 64;
+                window_trailing = WIDTH - window_leading - length;
+            }
+            const auto length = WIDTH - window_leading - window_trailing;
+            previous ^= static_cast<Bits<T>>(reader.read(length) << window_trailing);
+        }
+        values[i] = from_bits<T>(previous);
+    }
+}
+
+// Prefix codes and payload sizes for the integer difference buckets, the last bucket takes
+// anything at all
+constexpr struct
+{
+    unsigned int prefix;
+    unsigned int prefix_bits;
+    unsigned int payload_bits;
+} BUCKETS[] = {{0b10, 2, 3}, {0b110, 3, 8}, {0b1110, 4, 16}, {0b1111, 4, 64}};
+
+template <typename T> void encode_integers(const T *values, std::size_t count, BitWriter &writer)
+{
+    std::int64_t previous = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto diff = static_cast<std::int64_t>(values[i]) - previous;
+        previous = values[i];
+
+        const auto zigzag = (static_cast<std::uint64_t>(diff) << 1) ^
+                            static_cast<std::uint64_t>(diff >> 63);
+        if (zigzag == 0)
+        {
+            writer.write(0, 1);
+            continue;
+        }
+
+        for (const auto &bucket : BUCKETS)
+        {
+            if (bucket.payload_bits == 64 || zigzag < (std::uint64_t(1) << bucket.payload_bits))
+            {
+                writer.write(bucket.prefix, bucket.prefix_bits);
+                writer.write(zigzag, bucket.payload_bits);
+                break;
+            }
+        }
+    }
+}
+
+template <typename T> void decode_integers(BitReader &reader, std::size_t count, T *values)
+{
+    std::int64_t previous = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (reader.read_bit())
+        {
+            // Count the ones in the prefix to find the bucket
+            std::size_t bucket = 0;
+            while (bucket < 2 && reader.read_bit())
+            {
+                ++bucket;
+            }
+            if (bucket == 2 && reader.read_bit())
+            {
+                ++bucket;
+            }
+
+            const auto zigzag = reader.read(BUCKETS[bucket].payload_bits);
+            const auto diff =
+                static_cast<std::int64_t>(zigzag >> 1) ^ -static_cast<std::int64_t>(zigzag & 1);
+            previous += diff;
+        }
+        values[i] = static_cast<T>(previous);
+    }
+}
+} // namespace
+
+template <typename T>
+void codec::encode(const T *values, std::size_t count, std::vector<std::uint8_t> &out)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    BitWriter writer(out);
+    if constexpr (std::is_floating_point_v<T>)
+    {
+        encode_floats(values, count, writer);
+    }
+    else
+    {
+        encode_integers(values, count, writer);
+    }
+}
+
+template <typename T> void codec::decode(const std::uint8_t *data, std::size_t count, T *values)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    BitReader reader(data);
+    if constexpr (std::is_floating_point_v<T>)
+    {
+        decode_floats(reader, count, values);
+    }
+    else
+    {
+        decode_integers(reader, count, values);
+    }
+}
+
+#define INSTANTIATE_CODEC(T)                                                                       \
+    template void codec::encode<T>(const T *, std::size_t, std::vector<std::uint8_t> &);           \
+    template void codec::decode<T>(const std::uint8_t *, std::size_t, T *);
+
+INSTANTIATE_CODEC(double)
+INSTANTIATE_CODEC(float)
+INSTANTIATE_CODEC(std::int16_t)
+INSTANTIATE_CODEC(std::int32_t)
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace amber::database::codec
+{
+/**
+ * @brief Lossless compression for runs of samples which tend to vary slowly.
+ *
+ * Floating point samples use the XOR scheme from Facebook's Gorilla: each value is XORed with the
+ * one before it and only the meaningful bits in the middle of the result are kept, reusing the
+ * previous window of meaningful bits when the new one fits inside it. Integer samples store the
+ * zig-zag encoded difference from the previous sample in one of a few bucket sizes.
+ *
+ * Either way an unchanged sample costs a single bit, and decoding recreates the input exactly,
+ * including NaNs and negative zeros.
+ */
+template <typename T> void encode(const T *values, std::size_t count, std::vector<std::uint8_t> &out);
+
+/**
+ * @brief Decode count samples written by encode().
+ */
+template <typename T> void decode(const std::uint8_t *data, std::size_t count, T *values);
+} // namespace amber::database::codec
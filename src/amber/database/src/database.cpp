@@ -1,35 +1,366 @@
+#include "spill_file.hpp"
+
+#include <algorithm>
+#include <chrono>
 #include <numeric>
+#include <stdexcept>
 #include <database/database.hpp>
+#include <database/snapshot.hpp>
+#include <database/timeseries_dense.hpp>
+#include <database/timeseries_sparse.hpp>
 
 using namespace amber::database;
 
-void Database::register_timeseries(std::string name, std::shared_ptr<TimeSeries> timeseries)
+namespace
+{
+// How often the budget thread checks the memory usage
+constexpr auto BUDGET_CHECK_INTERVAL = std::chrono::milliseconds(100);
+} // namespace
+
+ReadView::ReadView(std::shared_ptr<const Registry> registry) : _registry(std::move(registry))
+{
+    _published.reserve(_registry->series.size());
+    for (const auto &entry : _registry->series)
+    {
+        _published.push_back(entry.ts->published());
+    }
+}
+
+const Registry &ReadView::registry() const
+{
+    return *_registry;
+}
+
+std::size_t ReadView::published(SeriesHandle handle) const
+{
+    return _published.at(handle);
+}
+
+std::size_t ReadView::get_samples(SeriesHandle handle,
+                                  TSSample *samples,
+                                  double timestamp_start,
+                                  double bin_width,
+                                  std::size_t num_samples) const
+{
+    const auto &ts = *_registry->series.at(handle).ts;
+    return ts.get_samples_at(_published[handle], samples, timestamp_start, bin_width, num_samples);
+}
+
+std::pair<double, double> ReadView::get_span(SeriesHandle handle) const
+{
+    return _registry->series.at(handle).ts->get_span_at(_published[handle]);
+}
+
+Database::Database()
+    : _arena(std::make_shared<ChunkArena>()), _registry(std::make_shared<const Registry>())
+{
+}
+
+Database::~Database()
+{
+    {
+        std::lock_guard<std::mutex> _(_budget_mut);
+        _stop = true;
+    }
+    _budget_cond.notify_all();
+    if (_budget_thread.joinable())
+    {
+        _budget_thread.join();
+    }
+}
+
+const std::shared_ptr<ChunkArena> &Database::arena() const
+{
+    return _arena;
+}
+
+SeriesHandle Database::register_timeseries(std::string name,
+                                           std::shared_ptr<TimeSeries> timeseries)
+{
+    SeriesHandle handle;
+    {
+        std::lock_guard<std::mutex> _(_write_mut);
+        auto registry = std::make_shared<Registry>(*std::atomic_load(&_registry));
+        const auto existing = registry->handles.find(name);
+        if (existing != registry->handles.end())
+        {
+            handle = existing->second;
+            registry->series[handle].ts = std::move(timeseries);
+        }
+        else
+        {
+            handle = registry->series.size();
+            registry->handles.emplace(name, handle);
+            registry->series.push_back(Registry::Entry{std::move(name), std::move(timeseries)});
+        }
+        ++registry->generation;
+        std::atomic_store(&_registry, std::shared_ptr<const Registry>(std::move(registry)));
+    }
+
+    // Call a copy of the listeners, so they can add, remove or register from inside the call
+    decltype(_listeners) listeners;
+    {
+        std::lock_guard<std::mutex> _(_listener_mut);
+        listeners = _listeners;
+    }
+    for (const auto &[id, listener] : listeners)
+    {
+        listener(handle);
+    }
+    return handle;
+}
+
+std::shared_ptr<const Registry> Database::registry() const
+{
+    return std::atomic_load(&_registry);
+}
+
+ReadView Database::view() const
+{
+    return ReadView(registry());
+}
+
+std::shared_ptr<TimeSeries> Database::get(SeriesHandle handle) const
+{
+    return registry()->series.at(handle).ts;
+}
+
+std::optional<SeriesHandle> Database::find(const std::string &name) const
 {
-    _data[name] = timeseries;
+    const auto registry = this->registry();
+    const auto handle = registry->handles.find(name);
+    if (handle == registry->handles.end())
+    {
+        return std::nullopt;
+    }
+    return handle->second;
 }
 
-const std::map<std::string, std::shared_ptr<TimeSeries>> &Database::data() const
+std::uint64_t Database::generation() const
 {
-    return _data;
+    return registry()->generation;
+}
+
+std::size_t Database::add_listener(std::function<void(SeriesHandle)> listener)
+{
+    std::lock_guard<std::mutex> _(_listener_mut);
+    _listeners.emplace_back(_next_listener, std::move(listener));
+    return _next_listener++;
+}
+
+void Database::remove_listener(std::size_t id)
+{
+    std::lock_guard<std::mutex> _(_listener_mut);
+    _listeners.erase(std::remove_if(_listeners.begin(),
+                                    _listeners.end(),
+                                    [id](const auto &listener) { return listener.first == id; }),
+                     _listeners.end());
+}
+
+std::map<std::string, std::shared_ptr<TimeSeries>> Database::data() const
+{
+    std::map<std::string, std::shared_ptr<TimeSeries>> data;
+    for (const auto &entry : registry()->series)
+    {
+        data.emplace(entry.name, entry.ts);
+    }
+    return data;
 }
 
 std::size_t Database::memory_usage() const
 {
-    std::size_t total_bytes = std::accumulate(_data.begin(),
-                                              _data.end(),
-                                              static_cast<std::size_t>(0),
-                                              [](std::size_t sum, const auto &ts) {
-                                                  std::size_t bytes_used =
-                                                      ts.second->memory_usage();
-                                                  std::size_t total = sum + bytes_used;
-                                                  return total;
-                                              });
-    return total_bytes;
+    const auto registry = this->registry();
+    return std::accumulate(registry->series.begin(),
+                           registry->series.end(),
+                           std::size_t(0),
+                           [](std::size_t sum, const auto &entry) {
+                               return sum + entry.ts->memory_usage();
+                           });
+}
+
+std::size_t Database::logical_memory_usage() const
+{
+    const auto registry = this->registry();
+    return std::accumulate(registry->series.begin(),
+                           registry->series.end(),
+                           std::size_t(0),
+                           [](std::size_t sum, const auto &entry) {
+                               return sum + entry.ts->logical_memory_usage();
+                           });
 }
 
 std::size_t Database::num_samples() const
 {
-    return std::accumulate(_data.begin(), _data.end(), 0, [](std::size_t sum, const auto &ts) {
-        return sum + ts.second->size();
-    });
+    const auto registry = this->registry();
+    return std::accumulate(registry->series.begin(),
+                           registry->series.end(),
+                           std::size_t(0),
+                           [](std::size_t sum, const auto &entry) {
+                               return sum + entry.ts->size();
+                           });
+}
+
+void Database::set_memory_budget(std::size_t bytes, const std::string &spill_directory)
+{
+    auto file = std::make_shared<SpillFile>(spill_directory);
+    {
+        std::lock_guard<std::mutex> _(_budget_mut);
+        _memory_budget = bytes;
+        _spill_file = std::move(file);
+        if (!_budget_thread.joinable())
+        {
+            _budget_thread = std::thread(&Database::_watch_budget, this);
+        }
+    }
+    _budget_cond.notify_all();
+}
+
+void Database::enforce_memory_budget()
+{
+    std::shared_ptr<SpillFile> file;
+    std::size_t budget;
+    {
+        std::lock_guard<std::mutex> _(_budget_mut);
+        file = _spill_file;
+        budget = _memory_budget;
+    }
+    if (!file)
+    {
+        return;
+    }
+
+    const auto registry = this->registry();
+    auto usage = memory_usage();
+    while (usage > budget)
+    {
+        // Always spill the oldest samples in the whole database next
+        TimeSeries *oldest = nullptr;
+        double oldest_timestamp = 0;
+        for (const auto &entry : registry->series)
+        {
+            const auto timestamp = entry.ts->spill_candidate();
+            if (timestamp && (!oldest || *timestamp < oldest_timestamp))
+            {
+                oldest = entry.ts.get();
+                oldest_timestamp = *timestamp;
+            }
+        }
+        if (!oldest)
+        {
+            break;
+        }
+        // Spilling may build levels which the series hadn't got round to yet, so measure again
+        oldest->spill(file);
+        usage = memory_usage();
+    }
+}
+
+std::size_t Database::spilled_bytes() const
+{
+    const auto registry = this->registry();
+    return std::accumulate(registry->series.begin(),
+                           registry->series.end(),
+                           std::size_t(0),
+                           [](std::size_t sum, const auto &entry) {
+                               return sum + entry.ts->spilled_bytes();
+                           });
+}
+
+void Database::_watch_budget()
+{
+    std::unique_lock<std::mutex> lock(_budget_mut);
+    while (!_stop)
+    {
+        lock.unlock();
+        try
+        {
+            enforce_memory_budget();
+        }
+        catch (const std::runtime_error &)
+        {
+            // Most likely the disk is full, leave everything in memory and try again later
+        }
+        lock.lock();
+        _budget_cond.wait_for(lock, BUDGET_CHECK_INTERVAL, [this]() { return _stop; });
+    }
+}
+
+void Database::save(const std::string &path) const
+{
+    // In order of handle, so they're registered in the same order when loaded
+    const auto view = this->view();
+    const auto &series = view.registry().series;
+    SnapshotWriter writer(path);
+    for (SeriesHandle handle = 0; handle < series.size(); ++handle)
+    {
+        writer.write(series[handle].name);
+        series[handle].ts->save_at(writer, view.published(handle));
+    }
+    writer.close();
+}
+
+namespace
+{
+template <typename T>
+std::shared_ptr<TimeSeries> load_dense(SnapshotReader &reader,
+                                       const std::shared_ptr<ChunkArena> &arena)
+{
+    const auto set = reader.read<std::uint32_t>();
+    switch (set)
+    {
+    case EnvelopeAggregates::id:
+        return TimeSeriesDense<T, EnvelopeAggregates>::load(reader, arena);
+    case DefaultAggregates::id:
+        return TimeSeriesDense<T, DefaultAggregates>::load(reader, arena);
+    case MomentAggregates::id:
+        return TimeSeriesDense<T, MomentAggregates>::load(reader, arena);
+    case OhlcAggregates::id:
+        return TimeSeriesDense<T, OhlcAggregates>::load(reader, arena);
+    }
+    throw std::runtime_error("Snapshot has an unknown set of aggregates");
+}
+
+std::shared_ptr<TimeSeries> load_dense(SnapshotReader &reader,
+                                       const std::shared_ptr<ChunkArena> &arena)
+{
+    switch (reader.read<SnapshotSampleType>())
+    {
+    case SnapshotSampleType::Double:
+        return load_dense<double>(reader, arena);
+    case SnapshotSampleType::Float:
+        return load_dense<float>(reader, arena);
+    case SnapshotSampleType::Int16:
+        return load_dense<std::int16_t>(reader, arena);
+    case SnapshotSampleType::Int32:
+        return load_dense<std::int32_t>(reader, arena);
+    }
+    throw std::runtime_error("Snapshot has an unknown sample type");
+}
+} // namespace
+
+void Database::load(const std::string &path)
+{
+    // Load everything before registering any of it, so a bad file doesn't leave us half loaded
+    SnapshotReader reader(path);
+    std::vector<std::pair<std::string, std::shared_ptr<TimeSeries>>> loaded;
+    while (!reader.at_end())
+    {
+        auto name = reader.read_string();
+        switch (reader.read<SnapshotSeriesType>())
+        {
+        case SnapshotSeriesType::Dense:
+            loaded.emplace_back(std::move(name), load_dense(reader, _arena));
+            break;
+        case SnapshotSeriesType::Sparse:
+            loaded.emplace_back(std::move(name), TimeSeriesSparse::load(reader, _arena));
+            break;
+        default:
+            throw std::runtime_error("Snapshot has an unknown timeseries type");
+        }
+    }
+
+    for (auto &[name, ts] : loaded)
+    {
+        register_timeseries(name, ts);
+    }
 }
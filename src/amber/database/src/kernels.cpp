@@ -0,0 +1,174 @@
+#include "kernels.hpp"
+#include "kernels_impl.hpp"
+
+#include <initializer_list>
+
+#if defined(AMBER_DATABASE_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace amber::database::kernels
+{
+template <typename T> DataStore<T> reduce_scalar(const T *values, std::size_t count)
+{
+    return reduce_lanes(values, count);
+}
+
+template <Fold F, typename T> T fold_scalar(const T *values, std::size_t count)
+{
+    return fold_lanes<F>(values, count);
+}
+
+namespace
+{
+template <typename T> using Kernel = DataStore<T> (*)(const T *, std::size_t);
+template <typename T> using FoldKernel = T (*)(const T *, std::size_t);
+
+bool cpu_supports(Isa isa)
+{
+#if !defined(AMBER_DATABASE_X86)
+    return isa == Isa::Scalar;
+#elif defined(_MSC_VER)
+    // Check the CPU has the instructions, and that the OS saves the registers they need
+    int info[4];
+    __cpuid(info, 0);
+    const int max_leaf = info[0];
+    __cpuid(info, 1);
+    const bool osxsave = info[2] & (1 << 27);
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    int leaf7[4] = {0, 0, 0, 0};
+    if (max_leaf >= 7)
+    {
+        __cpuidex(leaf7, 7, 0);
+    }
+
+    switch (isa)
+    {
+    case Isa::Scalar:
+    case Isa::SSE2:
+        return true;
+    case Isa::AVX2:
+        return (leaf7[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6;
+    case Isa::AVX512:
+        return (leaf7[1] & (1 << 16)) && (xcr0 & 0xE6) == 0xE6;
+    }
+    return false;
+#else
+    __builtin_cpu_init();
+    switch (isa)
+    {
+    case Isa::Scalar:
+        return true;
+    case Isa::SSE2:
+        return __builtin_cpu_supports("sse2");
+    case Isa::AVX2:
+        return __builtin_cpu_supports("avx2");
+    case Isa::AVX512:
+        return __builtin_cpu_supports("avx512f");
+    }
+    return false;
+#endif
+}
+
+template <typename T> Kernel<T> select(Isa isa)
+{
+    switch (isa)
+    {
+#if defined(AMBER_DATABASE_X86)
+    case Isa::SSE2:
+        return &reduce_sse2<T>;
+    case Isa::AVX2:
+        return &reduce_avx2<T>;
+    case Isa::AVX512:
+        return &reduce_avx512<T>;
+#endif
+    default:
+        return &reduce_scalar<T>;
+    }
+}
+
+template <Fold F, typename T> FoldKernel<T> select_fold(Isa isa)
+{
+    switch (isa)
+    {
+#if defined(AMBER_DATABASE_X86)
+    case Isa::SSE2:
+        return &fold_sse2<F, T>;
+    case Isa::AVX2:
+        return &fold_avx2<F, T>;
+    case Isa::AVX512:
+        return &fold_avx512<F, T>;
+#endif
+    default:
+        return &fold_scalar<F, T>;
+    }
+}
+} // namespace
+
+bool is_supported(Isa isa)
+{
+    return cpu_supports(isa);
+}
+
+Isa active_isa()
+{
+    static const Isa isa = []() {
+        for (auto isa : {Isa::AVX512, Isa::AVX2, Isa::SSE2})
+        {
+            if (cpu_supports(isa))
+            {
+                return isa;
+            }
+        }
+        return Isa::Scalar;
+    }();
+    return isa;
+}
+
+template <typename T> DataStore<T> reduce(const T *values, std::size_t count)
+{
+    // Pick the kernel once, the first time it's needed
+    static const Kernel<T> kernel = select<T>(active_isa());
+    return kernel(values, count);
+}
+
+template <typename T> DataStore<T> reduce(const T *values, std::size_t count, Isa isa)
+{
+    return select<T>(isa)(values, count);
+}
+
+template <Fold F, typename T> T fold(const T *values, std::size_t count)
+{
+    static const FoldKernel<T> kernel = select_fold<F, T>(active_isa());
+    return kernel(values, count);
+}
+
+template <Fold F, typename T> T fold(const T *values, std::size_t count, Isa isa)
+{
+    return select_fold<F, T>(isa)(values, count);
+}
+
+INSTANTIATE_FOLDS(fold_scalar)
+INSTANTIATE_FOLDS(fold)
+
+#define INSTANTIATE_FOLD_DISPATCH(T)                                                               \
+    template T fold<Fold::Min, T>(const T *, std::size_t, Isa);                                    \
+    template T fold<Fold::Max, T>(const T *, std::size_t, Isa);                                    \
+    template T fold<Fold::Sum, T>(const T *, std::size_t, Isa);
+
+INSTANTIATE_FOLD_DISPATCH(double)
+INSTANTIATE_FOLD_DISPATCH(float)
+INSTANTIATE_FOLD_DISPATCH(std::int16_t)
+INSTANTIATE_FOLD_DISPATCH(std::int32_t)
+INSTANTIATE_FOLD_DISPATCH(std::int64_t)
+
+#define INSTANTIATE_KERNELS(T)                                                                     \
+    template DataStore<T> reduce_scalar<T>(const T *, std::size_t);                                \
+    template DataStore<T> reduce<T>(const T *, std::size_t);                                       \
+    template DataStore<T> reduce<T>(const T *, std::size_t, Isa);
+
+INSTANTIATE_KERNELS(double)
+INSTANTIATE_KERNELS(float)
+INSTANTIATE_KERNELS(std::int16_t)
+INSTANTIATE_KERNELS(std::int32_t)
+} // namespace amber::database::kernels
@@ -0,0 +1,165 @@
+#include "kernels_impl.hpp"
+
+#include <immintrin.h>
+#include <type_traits>
+
+namespace amber::database::kernels
+{
+template <typename T> DataStore<T> reduce_avx2(const T *values, std::size_t count)
+{
+    return reduce_lanes(values, count);
+}
+
+template <> DataStore<double> reduce_avx2<double>(const double *values, std::size_t count)
+{
+    Lanes<double> lanes;
+    init_lanes(lanes, values[0]);
+
+    // Two registers of four doubles make up the eight lanes
+    const auto body = count - count % LANES;
+    if (body)
+    {
+        __m256d sum[2];
+        __m256d min[2];
+        __m256d max[2];
+        for (int k = 0; k < 2; ++k)
+        {
+            sum[k] = _mm256_setzero_pd();
+            min[k] = max[k] = _mm256_set1_pd(values[0]);
+        }
+
+        for (std::size_t i = 0; i < body; i += LANES)
+        {
+            for (int k = 0; k < 2; ++k)
+            {
+                const auto x = _mm256_loadu_pd(values + i + 4 * k);
+                sum[k] = _mm256_add_pd(sum[k], x);
+                min[k] = _mm256_min_pd(x, min[k]);
+                max[k] = _mm256_max_pd(x, max[k]);
+            }
+        }
+
+        for (int k = 0; k < 2; ++k)
+        {
+            _mm256_storeu_pd(lanes.sum + 4 * k, sum[k]);
+            _mm256_storeu_pd(lanes.min + 4 * k, min[k]);
+            _mm256_storeu_pd(lanes.max + 4 * k, max[k]);
+        }
+    }
+
+    return finish(lanes, values, body, count);
+}
+
+template <> DataStore<float> reduce_avx2<float>(const float *values, std::size_t count)
+{
+    Lanes<float> lanes;
+    init_lanes(lanes, values[0]);
+
+    // One register of eight floats for the mins and maxes, and two registers of four doubles for
+    // the sums
+    const auto body = count - count % LANES;
+    if (body)
+    {
+        __m256d sum[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+        __m256 min = _mm256_set1_ps(values[0]);
+        __m256 max = min;
+
+        for (std::size_t i = 0; i < body; i += LANES)
+        {
+            const auto x = _mm256_loadu_ps(values + i);
+            min = _mm256_min_ps(x, min);
+            max = _mm256_max_ps(x, max);
+            sum[0] = _mm256_add_pd(sum[0], _mm256_cvtps_pd(_mm256_castps256_ps128(x)));
+            sum[1] = _mm256_add_pd(sum[1], _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)));
+        }
+
+        _mm256_storeu_pd(lanes.sum, sum[0]);
+        _mm256_storeu_pd(lanes.sum + 4, sum[1]);
+        _mm256_storeu_ps(lanes.min, min);
+        _mm256_storeu_ps(lanes.max, max);
+    }
+
+    return finish(lanes, values, body, count);
+}
+
+template DataStore<std::int16_t> reduce_avx2<std::int16_t>(const std::int16_t *, std::size_t);
+template DataStore<std::int32_t> reduce_avx2<std::int32_t>(const std::int32_t *, std::size_t);
+
+namespace
+{
+template <Fold F> __m256d fold_pd(__m256d lanes, __m256d x)
+{
+    if constexpr (F == Fold::Min)
+    {
+        return _mm256_min_pd(x, lanes);
+    }
+    else if constexpr (F == Fold::Max)
+    {
+        return _mm256_max_pd(x, lanes);
+    }
+    else
+    {
+        return _mm256_add_pd(lanes, x);
+    }
+}
+
+template <Fold F> __m256 fold_ps(__m256 lanes, __m256 x)
+{
+    if constexpr (F == Fold::Min)
+    {
+        return _mm256_min_ps(x, lanes);
+    }
+    else if constexpr (F == Fold::Max)
+    {
+        return _mm256_max_ps(x, lanes);
+    }
+    else
+    {
+        return _mm256_add_ps(lanes, x);
+    }
+}
+} // namespace
+
+template <Fold F, typename T> T fold_avx2(const T *values, std::size_t count)
+{
+    if constexpr (!std::is_floating_point_v<T>)
+    {
+        return fold_lanes<F>(values, count);
+    }
+    else
+    {
+        T lanes[LANES];
+        init_fold_lanes<F>(lanes, values);
+
+        // Two registers of four doubles or one register of eight floats make up the eight lanes
+        const auto body = count - count % LANES;
+        if (body)
+        {
+            if constexpr (std::is_same_v<T, double>)
+            {
+                __m256d acc[2] = {_mm256_set1_pd(lanes[0]), _mm256_set1_pd(lanes[0])};
+                for (std::size_t i = 0; i < body; i += LANES)
+                {
+                    acc[0] = fold_pd<F>(acc[0], _mm256_loadu_pd(values + i));
+                    acc[1] = fold_pd<F>(acc[1], _mm256_loadu_pd(values + i + 4));
+                }
+                _mm256_storeu_pd(lanes, acc[0]);
+                _mm256_storeu_pd(lanes + 4, acc[1]);
+            }
+            else
+            {
+                __m256 acc = _mm256_set1_ps(lanes[0]);
+                for (std::size_t i = 0; i < body; i += LANES)
+                {
+                    acc = fold_ps<F>(acc, _mm256_loadu_ps(values + i));
+                }
+                _mm256_storeu_ps(lanes, acc);
+            }
+        }
+
+        return finish_fold<F>(lanes, values, body, count);
+    }
+}
+
+INSTANTIATE_FOLDS(fold_avx2)
+} // namespace amber::database::kernels
@@ -0,0 +1,156 @@
+#include "kernels_impl.hpp"
+
+#include <immintrin.h>
+#include <type_traits>
+
+// Some versions of GCC warn about the deliberately undefined pass-through operand inside the
+// AVX-512 intrinsics
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+namespace amber::database::kernels
+{
+template <typename T> DataStore<T> reduce_avx512(const T *values, std::size_t count)
+{
+    return reduce_lanes(values, count);
+}
+
+template <> DataStore<double> reduce_avx512<double>(const double *values, std::size_t count)
+{
+    Lanes<double> lanes;
+    init_lanes(lanes, values[0]);
+
+    // A single register holds all eight lanes
+    const auto body = count - count % LANES;
+    if (body)
+    {
+        __m512d sum = _mm512_setzero_pd();
+        __m512d min = _mm512_set1_pd(values[0]);
+        __m512d max = min;
+
+        for (std::size_t i = 0; i < body; i += LANES)
+        {
+            const auto x = _mm512_loadu_pd(values + i);
+            sum = _mm512_add_pd(sum, x);
+            min = _mm512_min_pd(x, min);
+            max = _mm512_max_pd(x, max);
+        }
+
+        _mm512_storeu_pd(lanes.sum, sum);
+        _mm512_storeu_pd(lanes.min, min);
+        _mm512_storeu_pd(lanes.max, max);
+    }
+
+    return finish(lanes, values, body, count);
+}
+
+template <> DataStore<float> reduce_avx512<float>(const float *values, std::size_t count)
+{
+    Lanes<float> lanes;
+    init_lanes(lanes, values[0]);
+
+    // One register of eight floats for the mins and maxes, and one register of eight doubles for
+    // the sums
+    const auto body = count - count % LANES;
+    if (body)
+    {
+        __m512d sum = _mm512_setzero_pd();
+        __m256 min = _mm256_set1_ps(values[0]);
+        __m256 max = min;
+
+        for (std::size_t i = 0; i < body; i += LANES)
+        {
+            const auto x = _mm256_loadu_ps(values + i);
+            min = _mm256_min_ps(x, min);
+            max = _mm256_max_ps(x, max);
+            sum = _mm512_add_pd(sum, _mm512_cvtps_pd(x));
+        }
+
+        _mm512_storeu_pd(lanes.sum, sum);
+        _mm256_storeu_ps(lanes.min, min);
+        _mm256_storeu_ps(lanes.max, max);
+    }
+
+    return finish(lanes, values, body, count);
+}
+
+template DataStore<std::int16_t> reduce_avx512<std::int16_t>(const std::int16_t *, std::size_t);
+template DataStore<std::int32_t> reduce_avx512<std::int32_t>(const std::int32_t *, std::size_t);
+
+namespace
+{
+template <Fold F> __m512d fold_pd(__m512d lanes, __m512d x)
+{
+    if constexpr (F == Fold::Min)
+    {
+        return _mm512_min_pd(x, lanes);
+    }
+    else if constexpr (F == Fold::Max)
+    {
+        return _mm512_max_pd(x, lanes);
+    }
+    else
+    {
+        return _mm512_add_pd(lanes, x);
+    }
+}
+
+template <Fold F> __m256 fold_ps(__m256 lanes, __m256 x)
+{
+    if constexpr (F == Fold::Min)
+    {
+        return _mm256_min_ps(x, lanes);
+    }
+    else if constexpr (F == Fold::Max)
+    {
+        return _mm256_max_ps(x, lanes);
+    }
+    else
+    {
+        return _mm256_add_ps(lanes, x);
+    }
+}
+} // namespace
+
+template <Fold F, typename T> T fold_avx512(const T *values, std::size_t count)
+{
+    if constexpr (!std::is_floating_point_v<T>)
+    {
+        return fold_lanes<F>(values, count);
+    }
+    else
+    {
+        T lanes[LANES];
+        init_fold_lanes<F>(lanes, values);
+
+        // A single register holds all eight lanes, eight doubles or eight floats
+        const auto body = count - count % LANES;
+        if (body)
+        {
+            if constexpr (std::is_same_v<T, double>)
+            {
+                __m512d acc = _mm512_set1_pd(lanes[0]);
+                for (std::size_t i = 0; i < body; i += LANES)
+                {
+                    acc = fold_pd<F>(acc, _mm512_loadu_pd(values + i));
+                }
+                _mm512_storeu_pd(lanes, acc);
+            }
+            else
+            {
+                __m256 acc = _mm256_set1_ps(lanes[0]);
+                for (std::size_t i = 0; i < body; i += LANES)
+                {
+                    acc = fold_ps<F>(acc, _mm256_loadu_ps(values + i));
+                }
+                _mm256_storeu_ps(lanes, acc);
+            }
+        }
+
+        return finish_fold<F>(lanes, values, body, count);
+    }
+}
+
+INSTANTIATE_FOLDS(fold_avx512)
+} // namespace amber::database::kernels
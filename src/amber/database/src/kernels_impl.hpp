@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "aggregate.hpp"
+#include "kernels.hpp"
+
+namespace amber::database::kernels
+{
+// Each instruction set gets its own translation unit, compiled with the flags which enable it
+template <typename T> DataStore<T> reduce_scalar(const T *values, std::size_t count);
+template <typename T> DataStore<T> reduce_sse2(const T *values, std::size_t count);
+template <typename T> DataStore<T> reduce_avx2(const T *values, std::size_t count);
+template <typename T> DataStore<T> reduce_avx512(const T *values, std::size_t count);
+template <Fold F, typename T> T fold_scalar(const T *values, std::size_t count);
+template <Fold F, typename T> T fold_sse2(const T *values, std::size_t count);
+template <Fold F, typename T> T fold_avx2(const T *values, std::size_t count);
+template <Fold F, typename T> T fold_avx512(const T *values, std::size_t count);
+
+// Everything below has internal linkage, so each translation unit gets its own copy built for its
+// own instruction set rather than the linker picking one of them for everyone.
+namespace
+{
+// The number of independent accumulators used by every kernel. The vector kernels map these onto
+// however many registers they need, which is what keeps their results identical.
+constexpr std::size_t LANES = 8;
+
+template <typename T> struct Lanes
+{
+    typename SampleTraits<T>::Sum sum[LANES];
+    T min[LANES];
+    T max[LANES];
+};
+
+template <typename T> void init_lanes(Lanes<T> &lanes, T first)
+{
+    for (std::size_t j = 0; j < LANES; ++j)
+    {
+        lanes.sum[j] = 0;
+        lanes.min[j] = first;
+        lanes.max[j] = first;
+    }
+}
+
+/**
+ * @brief Fold the lanes together in a fixed order, then mop up the samples which didn't fill a
+ * whole set of lanes.
+ */
+template <typename T>
+DataStore<T> finish(Lanes<T> &lanes, const T *values, std::size_t begin, std::size_t end)
+{
+    for (std::size_t width = LANES / 2; width; width /= 2)
+    {
+        for (std::size_t j = 0; j < width; ++j)
+        {
+            lanes.sum[j] = lanes.sum[j] + lanes.sum[j + width];
+            lanes.min[j] = lanes.min[j + width] < lanes.min[j] ? lanes.min[j + width] : lanes.min[j];
+            lanes.max[j] = lanes.max[j + width] > lanes.max[j] ? lanes.max[j + width] : lanes.max[j];
+        }
+    }
+
+    DataStore<T> result{lanes.sum[0], lanes.min[0], lanes.max[0]};
+    for (auto i = begin; i < end; ++i)
+    {
+        const T x = values[i];
+        result.sum += x;
+        result.min = x < result.min ? x : result.min;
+        result.max = x > result.max ? x : result.max;
+    }
+    return result;
+}
+
+/**
+ * @brief The portable kernel, which is the reference the vector kernels have to match. Lane J
+ * accumulates every sample whose index is J modulo LANES.
+ */
+template <typename T> DataStore<T> reduce_lanes(const T *values, std::size_t count)
+{
+    Lanes<T> lanes;
+    init_lanes(lanes, values[0]);
+
+    const auto body = count - count % LANES;
+    for (std::size_t i = 0; i < body; i += LANES)
+    {
+        for (std::size_t j = 0; j < LANES; ++j)
+        {
+            const T x = values[i + j];
+            lanes.sum[j] += x;
+            lanes.min[j] = x < lanes.min[j] ? x : lanes.min[j];
+            lanes.max[j] = x > lanes.max[j] ? x : lanes.max[j];
+        }
+    }
+
+    return finish(lanes, values, body, count);
+}
+
+// Combine two values the way a fold does
+template <Fold F, typename T> T fold_pair(T a, T b)
+{
+    if constexpr (F == Fold::Min)
+    {
+        return b < a ? b : a;
+    }
+    else if constexpr (F == Fold::Max)
+    {
+        return b > a ? b : a;
+    }
+    else
+    {
+        return a + b;
+    }
+}
+
+// Sums start from nothing, while mins and maxes start from the first value
+template <Fold F, typename T> void init_fold_lanes(T *lanes, const T *values)
+{
+    for (std::size_t j = 0; j < LANES; ++j)
+    {
+        lanes[j] = F == Fold::Sum ? T(0) : values[0];
+    }
+}
+
+/**
+ * @brief Like finish(), but for the lanes of a single fold.
+ */
+template <Fold F, typename T>
+T finish_fold(T *lanes, const T *values, std::size_t begin, std::size_t end)
+{
+    for (std::size_t width = LANES / 2; width; width /= 2)
+    {
+        for (std::size_t j = 0; j < width; ++j)
+        {
+            lanes[j] = fold_pair<F>(lanes[j], lanes[j + width]);
+        }
+    }
+
+    auto result = lanes[0];
+    for (auto i = begin; i < end; ++i)
+    {
+        result = fold_pair<F>(result, values[i]);
+    }
+    return result;
+}
+
+/**
+ * @brief The portable fold, laid out in lanes in the same way as reduce_lanes().
+ */
+template <Fold F, typename T> T fold_lanes(const T *values, std::size_t count)
+{
+    T lanes[LANES];
+    init_fold_lanes<F>(lanes, values);
+
+    const auto body = count - count % LANES;
+    for (std::size_t i = 0; i < body; i += LANES)
+    {
+        for (std::size_t j = 0; j < LANES; ++j)
+        {
+            lanes[j] = fold_pair<F>(lanes[j], values[i + j]);
+        }
+    }
+
+    return finish_fold<F>(lanes, values, body, count);
+}
+} // namespace
+
+// Every fold is built for every sample type and both types of sum
+#define INSTANTIATE_FOLDS(NAME)                                                                    \
+    INSTANTIATE_FOLDS_OF(NAME, double)                                                             \
+    INSTANTIATE_FOLDS_OF(NAME, float)                                                              \
+    INSTANTIATE_FOLDS_OF(NAME, std::int16_t)                                                       \
+    INSTANTIATE_FOLDS_OF(NAME, std::int32_t)                                                       \
+    INSTANTIATE_FOLDS_OF(NAME, std::int64_t)
+
+#define INSTANTIATE_FOLDS_OF(NAME, T)                                                              \
+    template T NAME<Fold::Min, T>(const T *, std::size_t);                                         \
+    template T NAME<Fold::Max, T>(const T *, std::size_t);                                         \
+    template T NAME<Fold::Sum, T>(const T *, std::size_t);
+} // namespace amber::database::kernels
@@ -0,0 +1,201 @@
+#include "kernels_impl.hpp"
+
+#include <emmintrin.h>
+#include <type_traits>
+
+namespace amber::database::kernels
+{
+template <typename T> DataStore<T> reduce_sse2(const T *values, std::size_t count)
+{
+    return reduce_lanes(values, count);
+}
+
+template <> DataStore<double> reduce_sse2<double>(const double *values, std::size_t count)
+{
+    Lanes<double> lanes;
+    init_lanes(lanes, values[0]);
+
+    // Four registers of two doubles make up the eight lanes
+    const auto body = count - count % LANES;
+    if (body)
+    {
+        __m128d sum[4];
+        __m128d min[4];
+        __m128d max[4];
+        for (int k = 0; k < 4; ++k)
+        {
+            sum[k] = _mm_setzero_pd();
+            min[k] = max[k] = _mm_set1_pd(values[0]);
+        }
+
+        for (std::size_t i = 0; i < body; i += LANES)
+        {
+            for (int k = 0; k < 4; ++k)
+            {
+                const auto x = _mm_loadu_pd(values + i + 2 * k);
+                sum[k] = _mm_add_pd(sum[k], x);
+                min[k] = _mm_min_pd(x, min[k]);
+                max[k] = _mm_max_pd(x, max[k]);
+            }
+        }
+
+        for (int k = 0; k < 4; ++k)
+        {
+            _mm_storeu_pd(lanes.sum + 2 * k, sum[k]);
+            _mm_storeu_pd(lanes.min + 2 * k, min[k]);
+            _mm_storeu_pd(lanes.max + 2 * k, max[k]);
+        }
+    }
+
+    return finish(lanes, values, body, count);
+}
+
+template <> DataStore<float> reduce_sse2<float>(const float *values, std::size_t count)
+{
+    Lanes<float> lanes;
+    init_lanes(lanes, values[0]);
+
+    // Two registers of four floats for the mins and maxes, and four registers of two doubles for
+    // the sums
+    const auto body = count - count % LANES;
+    if (body)
+    {
+        __m128d sum[4];
+        __m128 min[2];
+        __m128 max[2];
+        for (int k = 0; k < 4; ++k)
+        {
+            sum[k] = _mm_setzero_pd();
+        }
+        for (int k = 0; k < 2; ++k)
+        {
+            min[k] = max[k] = _mm_set1_ps(values[0]);
+        }
+
+        for (std::size_t i = 0; i < body; i += LANES)
+        {
+            for (int k = 0; k < 2; ++k)
+            {
+                const auto x = _mm_loadu_ps(values + i + 4 * k);
+                min[k] = _mm_min_ps(x, min[k]);
+                max[k] = _mm_max_ps(x, max[k]);
+                sum[2 * k] = _mm_add_pd(sum[2 * k], _mm_cvtps_pd(x));
+                sum[2 * k + 1] = _mm_add_pd(sum[2 * k + 1], _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+            }
+        }
+
+        for (int k = 0; k < 4; ++k)
+        {
+            _mm_storeu_pd(lanes.sum + 2 * k, sum[k]);
+        }
+        for (int k = 0; k < 2; ++k)
+        {
+            _mm_storeu_ps(lanes.min + 4 * k, min[k]);
+            _mm_storeu_ps(lanes.max + 4 * k, max[k]);
+        }
+    }
+
+    return finish(lanes, values, body, count);
+}
+
+template DataStore<std::int16_t> reduce_sse2<std::int16_t>(const std::int16_t *, std::size_t);
+template DataStore<std::int32_t> reduce_sse2<std::int32_t>(const std::int32_t *, std::size_t);
+
+namespace
+{
+template <Fold F> __m128d fold_pd(__m128d lanes, __m128d x)
+{
+    if constexpr (F == Fold::Min)
+    {
+        return _mm_min_pd(x, lanes);
+    }
+    else if constexpr (F == Fold::Max)
+    {
+        return _mm_max_pd(x, lanes);
+    }
+    else
+    {
+        return _mm_add_pd(lanes, x);
+    }
+}
+
+template <Fold F> __m128 fold_ps(__m128 lanes, __m128 x)
+{
+    if constexpr (F == Fold::Min)
+    {
+        return _mm_min_ps(x, lanes);
+    }
+    else if constexpr (F == Fold::Max)
+    {
+        return _mm_max_ps(x, lanes);
+    }
+    else
+    {
+        return _mm_add_ps(lanes, x);
+    }
+}
+} // namespace
+
+template <Fold F, typename T> T fold_sse2(const T *values, std::size_t count)
+{
+    if constexpr (!std::is_floating_point_v<T>)
+    {
+        return fold_lanes<F>(values, count);
+    }
+    else
+    {
+        T lanes[LANES];
+        init_fold_lanes<F>(lanes, values);
+
+        // Four registers of two doubles or two registers of four floats make up the eight lanes
+        constexpr int width = 16 / sizeof(T);
+        constexpr int registers = LANES / width;
+        const auto body = count - count % LANES;
+        if (body)
+        {
+            if constexpr (std::is_same_v<T, double>)
+            {
+                __m128d acc[registers];
+                for (int k = 0; k < registers; ++k)
+                {
+                    acc[k] = _mm_set1_pd(lanes[0]);
+                }
+                for (std::size_t i = 0; i < body; i += LANES)
+                {
+                    for (int k = 0; k < registers; ++k)
+                    {
+                        acc[k] = fold_pd<F>(acc[k], _mm_loadu_pd(values + i + width * k));
+                    }
+                }
+                for (int k = 0; k < registers; ++k)
+                {
+                    _mm_storeu_pd(lanes + width * k, acc[k]);
+                }
+            }
+            else
+            {
+                __m128 acc[registers];
+                for (int k = 0; k < registers; ++k)
+                {
+                    acc[k] = _mm_set1_ps(lanes[0]);
+                }
+                for (std::size_t i = 0; i < body; i += LANES)
+                {
+                    for (int k = 0; k < registers; ++k)
+                    {
+                        acc[k] = fold_ps<F>(acc[k], _mm_loadu_ps(values + i + width * k));
+                    }
+                }
+                for (int k = 0; k < registers; ++k)
+                {
+                    _mm_storeu_ps(lanes + width * k, acc[k]);
+                }
+            }
+        }
+
+        return finish_fold<F>(lanes, values, body, count);
+    }
+}
+
+INSTANTIATE_FOLDS(fold_sse2)
+} // namespace amber::database::kernels
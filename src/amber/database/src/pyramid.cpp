@@ -0,0 +1,1426 @@
+#include "pyramid.hpp"
+#include "background_worker.hpp"
+#include "codec.hpp"
+#include "kernels.hpp"
+#include "read_epoch.hpp"
+#include "spill_file.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace amber::database;
+
+template <typename T, typename Set> struct Pyramid<T, Set>::CompressedChunk
+{
+    // Where each frame starts in bytes, plus where the last one ends
+    std::array<std::uint32_t, CHUNK_SIZE / FRAME_SIZE + 1> frame_offsets;
+    std::vector<std::uint8_t> bytes;
+
+    // Frames of chunks which didn't compress well are stored as plain samples once spilled
+    bool encoded = true;
+
+    // Once spilled the bytes are kept in a file rather than in memory
+    const SpillFile *file = nullptr;
+    std::uint64_t file_offset = 0;
+};
+
+template <typename T, typename Set> struct Pyramid<T, Set>::Histograms
+{
+    // Counts are 32 bits, so a histogram can cover at most 2^30 samples, which is ten levels up
+    static constexpr std::size_t MAX_LEVELS = 11;
+    typedef ChunkedVector<std::uint32_t, CHUNK_SIZE> Level;
+
+    Histograms(double low, double high, unsigned int buckets)
+        : low(low), scale(buckets / (high - low)), buckets(buckets)
+    {
+    }
+
+    unsigned int bucket(T value) const
+    {
+        // NaNs end up in the bottom bucket
+        const auto position = (static_cast<double>(value) - low) * scale;
+        if (!(position >= 0))
+        {
+            return 0;
+        }
+        return position < buckets ? static_cast<unsigned int>(position) : buckets - 1;
+    }
+
+    const double low;
+    const double scale;
+    const unsigned int buckets;
+
+    // Level L holds the histograms of blocks of HISTOGRAM_BLOCK_SIZE * HISTOGRAM_FAN_IN^L samples,
+    // one after the other. Buckets divide CHUNK_SIZE, so a histogram never straddles chunks.
+    std::array<std::unique_ptr<Level>, MAX_LEVELS> levels;
+};
+
+namespace
+{
+std::atomic<std::uint64_t> next_pyramid_id{1};
+
+// Histogram blocks in terms of shifts
+constexpr std::size_t HISTOGRAM_SHIFT = 10;
+constexpr std::size_t HISTOGRAM_FAN_IN_SHIFT = 2;
+
+// Like MIN_ROUNDED_RANGE, but histogram blocks are bigger so the range has to be too
+constexpr std::size_t MIN_ROUNDED_HISTOGRAM_RANGE = 64 * 1024;
+
+/**
+ * @brief The most recently decoded frames of compressed chunks, which belong to a single thread.
+ */
+template <typename T, std::size_t FrameSize> class FrameCache
+{
+  public:
+    static FrameCache &instance()
+    {
+        thread_local FrameCache cache;
+        return cache;
+    }
+
+    const T *find(std::uint64_t owner, std::size_t frame)
+    {
+        for (auto &entry : _entries)
+        {
+            if (entry.owner == owner && entry.frame == frame)
+            {
+                entry.last_used = ++_clock;
+                return entry.values.data();
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Evict the least recently used frame, and return its buffer for the new one.
+     */
+    T *insert(std::uint64_t owner, std::size_t frame)
+    {
+        auto &entry = *std::min_element(
+            _entries.begin(), _entries.end(), [](const Entry &a, const Entry &b) {
+                return a.last_used < b.last_used;
+            });
+        entry.owner = owner;
+        entry.frame = frame;
+        entry.last_used = ++_clock;
+        return entry.values.data();
+    }
+
+  private:
+    static constexpr std::size_t ENTRIES = 32;
+
+    struct Entry
+    {
+        std::uint64_t owner = 0;
+        std::size_t frame = 0;
+        std::uint64_t last_used = 0;
+        std::array<T, FrameSize> values;
+    };
+
+    FrameCache() : _entries(ENTRIES)
+    {
+    }
+
+    std::vector<Entry> _entries;
+    std::uint64_t _clock = 0;
+};
+} // namespace
+
+template <typename T, typename Set>
+Pyramid<T, Set>::Pyramid(std::shared_ptr<ChunkArena> arena)
+    : _arena(std::move(arena)), _raw(_arena), _block_shift(PyramidGeometry{}.block_shift),
+      _block_size(std::size_t(1) << _block_shift), _fan_in_shift(PyramidGeometry{}.fan_in_shift),
+      _id(next_pyramid_id++), _compressed(_arena), _next_to_compress(0), _sealed(0),
+      _compressed_bytes(0), _released_bytes(0), _uses_worker(false), _next_to_spill(0),
+      _spilled_bytes(0), _retention(0), _first(0), _trimmed(0), _histograms(nullptr),
+      _built(0), _wanted(false)
+{
+    static_assert(HISTOGRAM_BLOCK_SIZE == std::size_t(1) << HISTOGRAM_SHIFT);
+    static_assert(HISTOGRAM_FAN_IN == std::size_t(1) << HISTOGRAM_FAN_IN_SHIFT);
+}
+
+template <typename T, typename Set> Pyramid<T, Set>::~Pyramid()
+{
+    if (_uses_worker)
+    {
+        BackgroundWorker::instance().cancel(this);
+    }
+
+    // Anything older has been deleted already, and its slot may have been reused
+    for (auto chunk = _trimmed.load(); chunk < _compressed.size(); ++chunk)
+    {
+        delete _compressed[chunk].load(std::memory_order_relaxed);
+    }
+}
+
+template <typename T, typename Set> T Pyramid<T, Set>::operator[](std::size_t index) const
+{
+    ReadEpoch::Guard guard;
+    return *_raw_values(index);
+}
+
+template <typename T, typename Set>
+void Pyramid<T, Set>::read(std::size_t begin, std::size_t end, T *values) const
+{
+    _visit_raw(begin, end, [&values](const T *run, std::size_t count) {
+        values = std::copy(run, run + count, values);
+    });
+}
+
+template <typename T, typename Set> void Pyramid<T, Set>::set_retention(std::size_t samples)
+{
+    if (samples == 0)
+    {
+        throw std::invalid_argument("Retention must keep at least one sample");
+    }
+    if (_raw.size() != 0 || _histograms_storage)
+    {
+        throw std::logic_error("Can only set the retention of an empty pyramid");
+    }
+
+    // Enough slots for the chunks in the window, plus one being filled and those waiting to be
+    // recycled
+    _retention = samples;
+    _raw.set_window(samples + (1 + RECYCLE_LAG) * CHUNK_SIZE);
+    _compressed.set_window(samples / CHUNK_SIZE + 2 + RECYCLE_LAG);
+}
+
+template <typename T, typename Set>
+void Pyramid<T, Set>::set_geometry(const PyramidGeometry &geometry)
+{
+    // Blocks mustn't straddle frames, so the raw samples in a block are always contiguous
+    if (geometry.block_shift < 1 || (std::size_t(1) << geometry.block_shift) > FRAME_SIZE)
+    {
+        throw std::invalid_argument("Blocks must be between 2 and 256 samples");
+    }
+    if (geometry.fan_in_shift < 1 || geometry.fan_in_shift > 4)
+    {
+        throw std::invalid_argument("Fan-in must be 2, 4, 8 or 16");
+    }
+    if (_raw.size() != 0 || _histograms_storage)
+    {
+        throw std::logic_error("Can only set the geometry of an empty pyramid");
+    }
+
+    _block_shift = geometry.block_shift;
+    _block_size = std::size_t(1) << _block_shift;
+    _fan_in_shift = geometry.fan_in_shift;
+}
+
+template <typename T, typename Set>
+std::size_t Pyramid<T, Set>::memory_usage(std::size_t size) const
+{
+    return logical_memory_usage(size) + _compressed_bytes.load(std::memory_order_relaxed) -
+           _released_bytes.load(std::memory_order_relaxed);
+}
+
+template <typename T, typename Set>
+std::size_t Pyramid<T, Set>::logical_memory_usage(std::size_t size) const
+{
+    // Work out the capacity from the size rather than asking the levels, as the writer may be
+    // adding chunks to them as we speak. Chunks wholly before the first sample have been dropped.
+    const auto chunk_bytes = [](std::size_t first, std::size_t size, std::size_t element_size) {
+        const auto num_chunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE - first / CHUNK_SIZE;
+        return num_chunks * CHUNK_SIZE * element_size;
+    };
+    const auto first = std::min(_first.load(std::memory_order_acquire), size);
+
+    std::size_t total_bytes = sizeof(_raw) + chunk_bytes(first, size, sizeof(T));
+
+    // The levels and histograms may not have caught up with the samples yet
+    const auto built = std::max(first, std::min(_built.load(std::memory_order_acquire), size));
+    for (auto shift = _block_shift; built >> shift; shift += _fan_in_shift)
+    {
+        const auto bytes = chunk_bytes(first >> shift, built >> shift, Level::ELEMENT_SIZE);
+        total_bytes += sizeof(Level) + bytes;
+    }
+
+    if (const auto *histograms = _histograms.load(std::memory_order_acquire))
+    {
+        const auto buckets = histograms->buckets;
+        auto shift = HISTOGRAM_SHIFT;
+        for (std::size_t level = 0; built >> shift && level < Histograms::MAX_LEVELS; ++level)
+        {
+            const auto bytes = chunk_bytes(
+                (first >> shift) * buckets, (built >> shift) * buckets, sizeof(std::uint32_t));
+            total_bytes += sizeof(typename Histograms::Level) + bytes;
+            shift += HISTOGRAM_FAN_IN_SHIFT;
+        }
+    }
+    return total_bytes;
+}
+
+template <typename T, typename Set>
+void Pyramid<T, Set>::save(SnapshotWriter &writer, std::size_t first, std::size_t size) const
+{
+    // The levels line up with the first sample ever pushed, so once the window has moved on the
+    // samples which are left are saved as a pyramid of their own
+    if (first != 0)
+    {
+        std::vector<T> values(size - first);
+        read(first, size, values.data());
+        Pyramid<T, Set> copy(_arena);
+        copy.set_geometry(geometry());
+        copy.bulk_load(std::move(values));
+        copy.save(writer, 0, copy.size());
+        return;
+    }
+    _catch_up(size);
+
+    writer.write(static_cast<std::uint32_t>(_block_shift));
+    writer.write(static_cast<std::uint32_t>(_fan_in_shift));
+
+    // Raw chunks may have been compressed, so decode those as we go
+    writer.begin_array<T>(size);
+    std::vector<T> decoded(CHUNK_SIZE);
+    for (std::size_t begin = 0; begin < size; begin += CHUNK_SIZE)
+    {
+        ReadEpoch::Guard guard;
+        const auto chunk = begin / CHUNK_SIZE;
+        const T *values = _raw.chunk_data(chunk);
+        if (!values)
+        {
+            const auto &compressed = *_compressed[chunk].load(std::memory_order_acquire);
+            for (std::size_t frame = 0; frame < CHUNK_SIZE / FRAME_SIZE; ++frame)
+            {
+                _decode(compressed, frame, decoded.data() + frame * FRAME_SIZE);
+            }
+            values = decoded.data();
+        }
+        writer.write_elements(values, std::min(CHUNK_SIZE, size - begin));
+    }
+
+    std::uint32_t num_levels = 0;
+    while (size >> _shift(num_levels))
+    {
+        ++num_levels;
+    }
+    writer.write(num_levels);
+    for (std::uint32_t level = 0; level < num_levels; ++level)
+    {
+        _data[level]->save(writer, size >> _shift(level));
+    }
+}
+
+template <typename T, typename Set> void Pyramid<T, Set>::load(SnapshotReader &reader)
+{
+    PyramidGeometry geometry;
+    geometry.block_shift = reader.read<std::uint32_t>();
+    geometry.fan_in_shift = reader.read<std::uint32_t>();
+    try
+    {
+        set_geometry(geometry);
+    }
+    catch (const std::invalid_argument &)
+    {
+        throw std::runtime_error("Snapshot has an unsupported pyramid geometry");
+    }
+
+    reader.read(_raw);
+
+    const auto num_levels = reader.read<std::uint32_t>();
+    if (num_levels > MAX_LEVELS)
+    {
+        throw std::runtime_error("Snapshot has too many levels");
+    }
+    for (std::uint32_t level = 0; level < num_levels; ++level)
+    {
+        _level(level).load(reader);
+        if (_data[level]->size() != (_raw.size() >> _shift(level)))
+        {
+            throw std::runtime_error("Snapshot levels don't match its samples");
+        }
+    }
+    if (_raw.size() >> _shift(num_levels))
+    {
+        throw std::runtime_error("Snapshot is missing levels");
+    }
+    _built.store(_raw.size(), std::memory_order_release);
+}
+
+template <typename T, typename Set> void Pyramid<T, Set>::_build(std::size_t size) const
+{
+    // Everything here works on the range of elements which have been completed since the last
+    // build, so a single chunk and a backlog of many chunks take the same path.
+
+    // Results are appended to each level in small batches
+    std::array<DataStore<T, Set>, 256> results;
+    std::size_t count = 0;
+
+    // Summarize any newly completed blocks of raw samples into the first level. The chunks may
+    // have been compressed or spilled by now, but blocks never straddle frames, so each frame's
+    // worth can be read as a contiguous array.
+    auto &first = _level(0);
+    const auto blocks_end = (size >> _block_shift) << _block_shift;
+    _visit_raw(first.size() << _block_shift, blocks_end, [&](const T *values, std::size_t n) {
+        for (std::size_t i = 0; i < n; i += _block_size)
+        {
+            results[count++] = summarize(values + i, _block_size);
+            if (count == results.size())
+            {
+                first.push(results.data(), count);
+                count = 0;
+            }
+        }
+    });
+    first.push(results.data(), count);
+
+    // Then combine runs of elements from each level into the level above, a field at a time
+    for (std::size_t index = 1; (_data[index - 1]->size() >> _fan_in_shift) > 0; ++index)
+    {
+        _level(index).push_combined(*_data[index - 1], _fan_in_shift);
+    }
+
+    if (_histograms_storage)
+    {
+        _build_histograms(*_histograms_storage, size);
+    }
+    _built.store(size, std::memory_order_release);
+}
+
+template <typename T, typename Set> void Pyramid<T, Set>::_age_out()
+{
+    const auto size = _raw.size();
+    if (size <= _retention)
+    {
+        return;
+    }
+    const auto first = (size - _retention) / CHUNK_SIZE * CHUNK_SIZE;
+    if (first <= _first.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    // Move readers on, and leave recycling the dropped chunks to the worker, as that means waiting
+    // for readers who might have missed the move, and the writer may be one of them. If the worker
+    // falls behind, the windows grow until it catches up.
+    {
+        std::lock_guard<std::mutex> lock(_seal_mut);
+        _first.store(first, std::memory_order_release);
+    }
+    _post_maintenance();
+}
+
+template <typename T, typename Set> void Pyramid<T, Set>::_recycle()
+{
+    std::lock_guard<std::mutex> _(_recycle_mut);
+    const auto first = _first.load(std::memory_order_acquire);
+    if (first / CHUNK_SIZE <= _trimmed.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    // The levels can only be built from samples which are still there. The worker has normally
+    // built these long ago, as they're a whole retention old.
+    _catch_up(first);
+
+    // Wait for any readers who might have missed the move before reusing anything
+    ReadEpoch::instance().synchronize();
+
+    // Dropping raw chunks changes the bookkeeping the writer uses to add them
+    std::lock_guard<std::mutex> lock(_seal_mut);
+    const auto num_slots = _compressed.size();
+    for (auto chunk = _trimmed.load(std::memory_order_relaxed); chunk < first / CHUNK_SIZE; ++chunk)
+    {
+        // The compressor only adds slots, so a chunk without one was never compressed
+        if (chunk >= num_slots)
+        {
+            continue;
+        }
+        if (const auto *compressed = _compressed[chunk].exchange(nullptr))
+        {
+            const auto bytes = sizeof(CompressedChunk) + compressed->bytes.capacity();
+            _compressed_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+            _released_bytes.fetch_sub(CHUNK_SIZE * sizeof(T), std::memory_order_relaxed);
+            delete compressed;
+        }
+    }
+
+    _raw.trim(first);
+    std::lock_guard<std::mutex> build_lock(_build_mut);
+    for (std::size_t level = 0; level < MAX_LEVELS && _data[level]; ++level)
+    {
+        _data[level]->trim(first >> _shift(level));
+    }
+    if (_histograms_storage)
+    {
+        const auto &levels = _histograms_storage->levels;
+        const auto buckets = _histograms_storage->buckets;
+        for (std::size_t level = 0; level < Histograms::MAX_LEVELS && levels[level]; ++level)
+        {
+            const auto shift = HISTOGRAM_SHIFT + level * HISTOGRAM_FAN_IN_SHIFT;
+            levels[level]->trim((first >> shift) * buckets);
+        }
+    }
+    _trimmed.store(first / CHUNK_SIZE, std::memory_order_release);
+}
+
+template <typename T, typename Set>
+void Pyramid<T, Set>::enable_histograms(double low, double high, unsigned int buckets)
+{
+    if (!(low < high))
+    {
+        throw std::invalid_argument("Histogram range is empty");
+    }
+    if (buckets < 2 || buckets > 256 || (buckets & (buckets - 1)))
+    {
+        throw std::invalid_argument("Histograms need a power of two buckets between 2 and 256");
+    }
+    if (_histograms_storage)
+    {
+        throw std::logic_error("Histograms are already being kept");
+    }
+    if (_first.load(std::memory_order_relaxed) != 0)
+    {
+        throw std::logic_error("Histograms must be enabled before samples are dropped");
+    }
+
+    // Catch up with the levels before readers get to see anything
+    std::lock_guard<std::mutex> lock(_build_mut);
+    auto histograms = std::make_unique<Histograms>(low, high, buckets);
+    _build_histograms(*histograms, _built.load(std::memory_order_relaxed));
+    _histograms_storage = std::move(histograms);
+    _histograms.store(_histograms_storage.get(), std::memory_order_release);
+}
+
+template <typename T, typename Set> unsigned int Pyramid<T, Set>::histogram_buckets() const
+{
+    const auto *histograms = _histograms.load(std::memory_order_acquire);
+    return histograms ? histograms->buckets : 0;
+}
+
+template <typename T, typename Set>
+void Pyramid<T, Set>::_build_histograms(Histograms &histograms, std::size_t size) const
+{
+    const auto level = [this, &histograms](std::size_t index) -> typename Histograms::Level & {
+        if (!histograms.levels[index])
+        {
+            histograms.levels[index] = std::make_unique<typename Histograms::Level>(_arena);
+            if (_retention)
+            {
+                const auto shift = HISTOGRAM_SHIFT + index * HISTOGRAM_FAN_IN_SHIFT;
+                const auto window =
+                    ((_retention + (2 + RECYCLE_LAG) * CHUNK_SIZE) >> shift) + 2;
+                histograms.levels[index]->set_window(window * histograms.buckets);
+            }
+        }
+        return *histograms.levels[index];
+    };
+    std::vector<std::uint32_t> counts(histograms.buckets);
+
+    // Count the samples in any newly completed blocks, which may have been compressed or spilled
+    // already if histograms have only just been enabled
+    auto &first = level(0);
+    const auto num_blocks = size >> HISTOGRAM_SHIFT;
+    for (auto block = first.size() / counts.size(); block < num_blocks; ++block)
+    {
+        std::fill(counts.begin(), counts.end(), 0);
+        const auto begin = block << HISTOGRAM_SHIFT;
+        _visit_raw(begin, begin + HISTOGRAM_BLOCK_SIZE, [&](const T *values, std::size_t count) {
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                ++counts[histograms.bucket(values[i])];
+            }
+        });
+        first.push(counts.data(), counts.size());
+    }
+
+    // Then merge them into the levels above
+    for (std::size_t index = 1; index < Histograms::MAX_LEVELS; ++index)
+    {
+        const auto &prev = *histograms.levels[index - 1];
+        const auto available = (prev.size() / counts.size()) >> HISTOGRAM_FAN_IN_SHIFT;
+        if (!available)
+        {
+            break;
+        }
+
+        auto &buf = level(index);
+        for (auto histogram = buf.size() / counts.size(); histogram < available; ++histogram)
+        {
+            std::fill(counts.begin(), counts.end(), 0);
+            for (std::size_t child = 0; child < HISTOGRAM_FAN_IN; ++child)
+            {
+                const auto *child_counts =
+                    &prev[(histogram * HISTOGRAM_FAN_IN + child) * counts.size()];
+                for (std::size_t bucket = 0; bucket < counts.size(); ++bucket)
+                {
+                    counts[bucket] += child_counts[bucket];
+                }
+            }
+            buf.push(counts.data(), counts.size());
+        }
+    }
+}
+
+template <typename T, typename Set>
+void Pyramid<T, Set>::histogram(std::size_t begin,
+                                std::size_t end,
+                                std::size_t size,
+                                std::uint64_t *counts) const
+{
+    _want(size);
+
+    // Spilled chunks can't be swapped out while we might be looking at them
+    ReadEpoch::Guard guard;
+    const auto built = _built.load(std::memory_order_acquire);
+
+    const auto &histograms = *_histograms.load(std::memory_order_acquire);
+    const auto add_histogram = [&histograms, counts](std::size_t level, std::size_t index) {
+        const auto *level_counts = &(*histograms.levels[level])[index * histograms.buckets];
+        for (std::size_t bucket = 0; bucket < histograms.buckets; ++bucket)
+        {
+            counts[bucket] += level_counts[bucket];
+        }
+    };
+    const auto add_samples = [&histograms, counts](const T *values, std::size_t count) {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            ++counts[histograms.bucket(values[i])];
+        }
+    };
+
+    // Greedily take the biggest histogram which starts here and fits in what's left, exactly like
+    // reduce() does with the levels
+    const bool wide = end - begin >= MIN_ROUNDED_HISTOGRAM_RANGE;
+    const auto row_max = 63 - count_leading_zeros(size);
+    for (auto iter = begin; iter < end;)
+    {
+        const auto row = std::min({count_trailing_zeros(iter),
+                                   row_max,
+                                   63 - count_leading_zeros(end - iter),
+                                   iter < built ? 63 - count_leading_zeros(built - iter) : 0});
+        if (row < static_cast<int>(HISTOGRAM_SHIFT))
+        {
+            const auto run_end = std::min(end, (iter | (HISTOGRAM_BLOCK_SIZE - 1)) + 1);
+            if (wide && (iter | (HISTOGRAM_BLOCK_SIZE - 1)) < built && _spilled(iter))
+            {
+                // Rather than going to disk, take the whole block if the run covers its middle
+                const auto middle = (iter & ~(HISTOGRAM_BLOCK_SIZE - 1)) + HISTOGRAM_BLOCK_SIZE / 2;
+                if (iter <= middle && middle < run_end)
+                {
+                    add_histogram(0, iter >> HISTOGRAM_SHIFT);
+                }
+            }
+            else
+            {
+                _visit_raw(iter, run_end, add_samples);
+            }
+            iter = run_end;
+        }
+        else
+        {
+            const auto level = std::min((row - HISTOGRAM_SHIFT) / HISTOGRAM_FAN_IN_SHIFT,
+                                        Histograms::MAX_LEVELS - 1);
+            const auto shift = HISTOGRAM_SHIFT + level * HISTOGRAM_FAN_IN_SHIFT;
+            add_histogram(level, iter >> shift);
+            iter += std::size_t(1) << shift;
+        }
+    }
+}
+
+template <typename T, typename Set>
+template <typename Visit>
+void Pyramid<T, Set>::_visit_raw(std::size_t begin, std::size_t end, Visit &&visit) const
+{
+    // Frames never straddle chunks, so each run up to the end of a frame is contiguous whether or
+    // not its chunk has been compressed
+    ReadEpoch::Guard guard;
+    while (begin < end)
+    {
+        const auto run_end = std::min(end, (begin | (FRAME_SIZE - 1)) + 1);
+        visit(_raw_values(begin), run_end - begin);
+        begin = run_end;
+    }
+}
+
+template <typename T, typename Set>
+void Pyramid<T, Set>::bulk_load(const T *values, std::size_t count, unsigned int threads)
+{
+    if (_raw.size() != 0)
+    {
+        throw std::logic_error("Can only bulk load an empty pyramid");
+    }
+    if (_retention)
+    {
+        // Most of the samples would be dropped straight away, so don't bother building them in
+        // parallel
+        push(values, count);
+        return;
+    }
+
+    _raw.resize(count);
+    _build_parallel(values, threads);
+}
+
+template <typename T, typename Set>
+void Pyramid<T, Set>::bulk_load(std::vector<T> &&values, unsigned int threads)
+{
+    if (_retention)
+    {
+        bulk_load(values.data(), values.size(), threads);
+        return;
+    }
+    _raw.adopt(std::move(values));
+    _build_parallel(nullptr, threads);
+}
+
+template <typename T, typename Set>
+void Pyramid<T, Set>::_build_parallel(const T *source, unsigned int threads)
+{
+    const auto size = _raw.size();
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Partitions are a power of two samples, and at least a chunk, so every level below the
+    // partition size splits cleanly between them and the raw samples can be copied a chunk at a
+    // time
+    const auto per_thread = (size + threads - 1) / threads;
+    std::size_t partition_shift = 0;
+    while ((std::size_t(1) << partition_shift) < std::max(CHUNK_SIZE, per_thread))
+    {
+        ++partition_shift;
+    }
+    const auto partition_size = std::size_t(1) << partition_shift;
+    const auto num_partitions = (size + partition_size - 1) / partition_size;
+
+    // Size every level which lives entirely within the partitions up front, so the threads only
+    // ever fill in elements
+    const auto partition_levels = _level_at(static_cast<int>(partition_shift)) + 1;
+    for (std::size_t level = 0; level < partition_levels; ++level)
+    {
+        _level(level).resize(size >> _shift(level));
+    }
+
+    const auto build_partition = [this, source, size, partition_size, partition_levels](
+                                     std::size_t partition) {
+        const auto begin = partition * partition_size;
+        const auto end = std::min(size, begin + partition_size);
+
+        if (source)
+        {
+            auto from = source + begin;
+            for (const auto span : _raw.spans(begin, end))
+            {
+                std::copy(from, from + span.size(), span.data());
+                from += span.size();
+            }
+        }
+
+        auto &first = *_data[0];
+        auto block = begin >> _block_shift;
+        for (const auto span : _raw.spans(begin, (end >> _block_shift) << _block_shift))
+        {
+            for (std::size_t i = 0; i < span.size(); i += _block_size)
+            {
+                first.set(block++, summarize(span.data() + i, _block_size));
+            }
+        }
+
+        for (std::size_t level = 1; level < partition_levels; ++level)
+        {
+            const auto shift = _shift(level);
+            _data[level]->combine_from(
+                *_data[level - 1], _fan_in_shift, begin >> shift, end >> shift);
+        }
+    };
+
+    // This thread takes the last partition, which may be the only one
+    std::vector<std::thread> workers;
+    for (std::size_t partition = 0; partition + 1 < num_partitions; ++partition)
+    {
+        workers.emplace_back(build_partition, partition);
+    }
+    if (num_partitions)
+    {
+        build_partition(num_partitions - 1);
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    // Then stitch the partitions together with the levels above them
+    _catch_up(size);
+    _seal();
+}
+
+template <typename T, typename Set> void Pyramid<T, Set>::_seal()
+{
+    const auto sealed = _raw.size() / CHUNK_SIZE;
+    if (sealed == _sealed.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    _sealed.store(sealed, std::memory_order_release);
+    _post_maintenance();
+}
+
+template <typename T, typename Set> void Pyramid<T, Set>::_post_maintenance()
+{
+    // The worker's jobs use the read epoch, so make sure it's created first and destroyed last
+    ReadEpoch::instance();
+    _uses_worker = true;
+    BackgroundWorker::instance().post(this, [this]() {
+        // Build the levels before the chunks are compressed, while they're cheap to read
+        if (_wanted.load(std::memory_order_relaxed) || _retention)
+        {
+            _catch_up(_raw.size());
+        }
+        compress();
+    });
+}
+
+template <typename T, typename Set> void Pyramid<T, Set>::_catch_up(std::size_t size) const
+{
+    std::lock_guard<std::mutex> _(_build_mut);
+    if (size > _built.load(std::memory_order_relaxed))
+    {
+        _build(size);
+    }
+}
+
+template <typename T, typename Set> void Pyramid<T, Set>::_want(std::size_t size) const
+{
+    // A short way behind is quicker to cover from the raw samples than to wait for the worker
+    _wanted.store(true, std::memory_order_relaxed);
+    if (size > _built.load(std::memory_order_acquire) + CHUNK_SIZE)
+    {
+        _catch_up(size);
+    }
+}
+
+template <typename T, typename Set> void Pyramid<T, Set>::compress()
+{
+    if (_retention)
+    {
+        _recycle();
+    }
+    std::lock_guard<std::mutex> _(_compress_mut);
+    _compress_sealed();
+}
+
+template <typename T, typename Set> void Pyramid<T, Set>::_compress_sealed()
+{
+    const auto sealed = _sealed.load(std::memory_order_acquire);
+    const auto trimmed = _trimmed.load(std::memory_order_acquire);
+    if (_retention)
+    {
+        // Recycling has emptied the slots of dropped chunks, so they can be reused
+        _compressed.trim(trimmed);
+        _next_to_compress = std::max(_next_to_compress, trimmed);
+    }
+    const auto num_slots = _compressed.size();
+    if (sealed > num_slots)
+    {
+        _compressed.resize(sealed);
+        for (auto chunk = num_slots; chunk < sealed; ++chunk)
+        {
+            _compressed[chunk].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<typename ChunkedVector<T, CHUNK_SIZE>::ChunkPtr> retired;
+    for (; _next_to_compress < sealed; ++_next_to_compress)
+    {
+        const auto chunk = _next_to_compress;
+
+        // The writer reuses chunks which are dropped, but not while we might be reading them
+        ReadEpoch::Guard guard;
+        {
+            std::lock_guard<std::mutex> lock(_seal_mut);
+            if (_dropped(chunk) || !_raw.owns_chunk(chunk))
+            {
+                continue;
+            }
+        }
+
+        // Nobody writes to a sealed chunk, so it can be read without holding anything
+        const T *values = _raw.chunk_data(chunk);
+        auto compressed = std::make_unique<CompressedChunk>();
+        for (std::size_t frame = 0; frame < CHUNK_SIZE / FRAME_SIZE; ++frame)
+        {
+            compressed->frame_offsets[frame] = static_cast<std::uint32_t>(compressed->bytes.size());
+            codec::encode(values + frame * FRAME_SIZE, FRAME_SIZE, compressed->bytes);
+        }
+        compressed->frame_offsets.back() = static_cast<std::uint32_t>(compressed->bytes.size());
+        compressed->bytes.shrink_to_fit();
+
+        // Keep the original if compression doesn't buy us much, it's quicker to read
+        const auto compressed_bytes = sizeof(CompressedChunk) + compressed->bytes.capacity();
+        const auto raw_bytes = CHUNK_SIZE * sizeof(T);
+        if (compressed_bytes > raw_bytes * 3 / 4)
+        {
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_seal_mut);
+            if (_dropped(chunk))
+            {
+                continue;
+            }
+            _compressed[chunk].store(compressed.release(), std::memory_order_release);
+            retired.push_back(_raw.release(chunk));
+        }
+        _compressed_bytes.fetch_add(compressed_bytes, std::memory_order_relaxed);
+        _released_bytes.fetch_add(raw_bytes, std::memory_order_relaxed);
+    }
+
+    // Readers might still be looking at the originals
+    if (!retired.empty())
+    {
+        ReadEpoch::instance().synchronize();
+    }
+}
+
+template <typename T, typename Set>
+std::optional<std::size_t> Pyramid<T, Set>::spill_candidate() const
+{
+    std::lock_guard<std::mutex> _(_compress_mut);
+    const auto chunk = std::max(_next_to_spill, _trimmed.load(std::memory_order_acquire));
+    if (chunk < _sealed.load(std::memory_order_acquire))
+    {
+        return chunk;
+    }
+    return std::nullopt;
+}
+
+template <typename T, typename Set>
+std::size_t Pyramid<T, Set>::spill(const std::shared_ptr<SpillFile> &file)
+{
+    std::lock_guard<std::mutex> _(_compress_mut);
+    _compress_sealed();
+
+    const auto sealed = _sealed.load(std::memory_order_acquire);
+    _next_to_spill = std::max(_next_to_spill, _trimmed.load(std::memory_order_acquire));
+    for (; _next_to_spill < sealed; ++_next_to_spill)
+    {
+        const auto chunk = _next_to_spill;
+
+        // The levels must cover the chunk before it goes, or the first wide read of a series
+        // nobody has looked at yet would build them from the disk
+        _catch_up((chunk + 1) * CHUNK_SIZE);
+
+        const CompressedChunk *compressed;
+        typename ChunkedVector<T, CHUNK_SIZE>::ChunkPtr raw;
+        std::size_t freed;
+        {
+            // Dropped chunks are reused, but not while we might be reading them
+            ReadEpoch::Guard guard;
+            {
+                // Chunks from a snapshot are on disk already
+                std::lock_guard<std::mutex> lock(_seal_mut);
+                compressed = _dropped(chunk) ? nullptr : _compressed[chunk].load();
+                if (_dropped(chunk) || (!compressed && !_raw.owns_chunk(chunk)))
+                {
+                    continue;
+                }
+            }
+
+            auto spilled = std::make_unique<CompressedChunk>();
+            spilled->file = file.get();
+            if (compressed)
+            {
+                spilled->frame_offsets = compressed->frame_offsets;
+                spilled->file_offset =
+                    file->append(compressed->bytes.data(), compressed->bytes.size());
+            }
+            else
+            {
+                for (std::size_t frame = 0; frame <= CHUNK_SIZE / FRAME_SIZE; ++frame)
+                {
+                    spilled->frame_offsets[frame] =
+                        static_cast<std::uint32_t>(frame * FRAME_SIZE * sizeof(T));
+                }
+                spilled->encoded = false;
+                spilled->file_offset =
+                    file->append(_raw.chunk_data(chunk), CHUNK_SIZE * sizeof(T));
+            }
+
+            // Swap the spilled chunk in, unless it was dropped while we were writing it out
+            std::lock_guard<std::mutex> lock(_seal_mut);
+            if (_dropped(chunk))
+            {
+                continue;
+            }
+            _spilled_bytes.fetch_add(spilled->frame_offsets.back(), std::memory_order_relaxed);
+            _spill_file = file;
+            _compressed[chunk].store(spilled.release(), std::memory_order_release);
+            if (compressed)
+            {
+                freed = compressed->bytes.capacity();
+                _compressed_bytes.fetch_sub(freed, std::memory_order_relaxed);
+            }
+            else
+            {
+                raw = _raw.release(chunk);
+                freed = CHUNK_SIZE * sizeof(T) - sizeof(CompressedChunk);
+                _compressed_bytes.fetch_add(sizeof(CompressedChunk), std::memory_order_relaxed);
+                _released_bytes.fetch_add(CHUNK_SIZE * sizeof(T), std::memory_order_relaxed);
+            }
+        }
+
+        // Then wait for readers to finish with whatever it replaced
+        ReadEpoch::instance().synchronize();
+        delete compressed;
+
+        ++_next_to_spill;
+        return freed;
+    }
+    return 0;
+}
+
+template <typename T, typename Set> std::size_t Pyramid<T, Set>::spilled_bytes() const
+{
+    return _spilled_bytes.load(std::memory_order_relaxed);
+}
+
+template <typename T, typename Set> bool Pyramid<T, Set>::_dropped(std::size_t chunk) const
+{
+    return chunk < _first.load(std::memory_order_acquire) / CHUNK_SIZE;
+}
+
+template <typename T, typename Set> bool Pyramid<T, Set>::_spilled(std::size_t index) const
+{
+    const auto chunk = index / CHUNK_SIZE;
+    if (_raw.chunk_data(chunk))
+    {
+        return false;
+    }
+    return _compressed[chunk].load(std::memory_order_acquire)->file != nullptr;
+}
+
+template <typename T, typename Set>
+const T *Pyramid<T, Set>::_raw_values(std::size_t index) const
+{
+    const auto chunk = index / CHUNK_SIZE;
+    if (const T *values = _raw.chunk_data(chunk))
+    {
+        return values + index % CHUNK_SIZE;
+    }
+
+    // The chunk has been compressed, so go via the decoded frames
+    auto &cache = FrameCache<T, FRAME_SIZE>::instance();
+    const auto frame = index / FRAME_SIZE;
+    const T *values = cache.find(_id, frame);
+    if (!values)
+    {
+        T *buffer = cache.insert(_id, frame);
+        const auto &compressed = *_compressed[chunk].load(std::memory_order_acquire);
+        _decode(compressed, frame % (CHUNK_SIZE / FRAME_SIZE), buffer);
+        values = buffer;
+    }
+    return values + index % FRAME_SIZE;
+}
+
+template <typename T, typename Set>
+void Pyramid<T, Set>::_decode(const CompressedChunk &compressed, std::size_t frame, T *values)
+{
+    const auto offset = compressed.frame_offsets[frame];
+    const std::uint8_t *bytes = compressed.bytes.data() + offset;
+    if (compressed.file)
+    {
+        thread_local std::vector<std::uint8_t> buffer;
+        buffer.resize(compressed.frame_offsets[frame + 1] - offset);
+        compressed.file->read(compressed.file_offset + offset, buffer.data(), buffer.size());
+        bytes = buffer.data();
+    }
+
+    if (compressed.encoded)
+    {
+        codec::decode(bytes, FRAME_SIZE, values);
+    }
+    else
+    {
+        std::memcpy(values, bytes, FRAME_SIZE * sizeof(T));
+    }
+}
+
+template <typename T, typename Set>
+DataStore<T, Set> Pyramid<T, Set>::summarize(const T *values, std::size_t count)
+{
+    // The vectorized kernels take care of the sum, min & max, anything else is cheap enough to
+    // work out as we go
+    const auto s = kernels::reduce(values, count);
+    DataStore<T, Set> result;
+    result.min = s.min;
+    result.max = s.max;
+    if constexpr (Set::sum)
+    {
+        result.sum = s.sum;
+    }
+    if constexpr (Set::sum_squares)
+    {
+        result.sum_squares = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            result.sum_squares += static_cast<double>(values[i]) * values[i];
+        }
+    }
+    if constexpr (Set::first_last)
+    {
+        result.first = values[0];
+        result.last = values[count - 1];
+    }
+    return result;
+}
+
+template <typename T, typename Set>
+DataStore<T, Set> Pyramid<T, Set>::combine(const DataStore<T, Set> &a, const DataStore<T, Set> &b)
+{
+    DataStore<T, Set> result;
+    result.min = std::min(a.min, b.min);
+    result.max = std::max(a.max, b.max);
+    if constexpr (Set::sum)
+    {
+        result.sum = a.sum + b.sum;
+    }
+    if constexpr (Set::sum_squares)
+    {
+        result.sum_squares = a.sum_squares + b.sum_squares;
+    }
+    if constexpr (Set::first_last)
+    {
+        result.first = a.first;
+        result.last = b.last;
+    }
+    return result;
+}
+
+template <typename T, typename Set>
+typename Pyramid<T, Set>::Level &Pyramid<T, Set>::_level(std::size_t index) const
+{
+    if (!_data[index])
+    {
+        _data[index] = std::make_unique<Level>(_arena);
+        if (_retention)
+        {
+            const auto window = _retention + (2 + RECYCLE_LAG) * CHUNK_SIZE;
+            _data[index]->set_window((window >> _shift(index)) + 2);
+        }
+    }
+    return *_data[index];
+}
+
+#if defined(__GNUC__) || defined(__GNUG__)
+template <typename T, typename Set>
+int Pyramid<T, Set>::count_trailing_zeros(unsigned long long value)
+{
+    return __builtin_ctzll(value | (1ULL << 63));
+};
+
+template <typename T, typename Set>
+int Pyramid<T, Set>::count_leading_zeros(unsigned long long value)
+{
+    return __builtin_clzll(value | 1ULL);
+};
+
+#elif defined _MSC_VER
+template <typename T, typename Set>
+int Pyramid<T, Set>::count_trailing_zeros(unsigned long long value)
+{
+    unsigned long leading;
+    _BitScanForward64(&leading, value | (1ULL << 63));
+    return leading;
+};
+
+template <typename T, typename Set>
+int Pyramid<T, Set>::count_leading_zeros(unsigned long long value)
+{
+    unsigned long leading;
+    _BitScanReverse64(&leading, value | 1ULL);
+    return 63 ^ leading;
+};
+
+#endif
+
+/**
+ * @brief Find the aggregates of the samples between begin and end.
+ */
+template <typename T, typename Set>
+DataStore<T, Set>
+Pyramid<T, Set>::reduce(std::size_t begin, std::size_t end, std::size_t size) const
+{
+    // Data is stored in an array of arrays like so:
+    // [1 2 3 4 5 6 7 8]
+    // [3 7 11 15]
+    // [10 26]
+    // [36]
+    //
+    // The first row contains the raw samples.
+    // Each subsequent row contains the sum of two elements in the row above.
+    //   I.e. e[N][M] = e[N-1][2M] + e[N-1][2M+1]
+    // Where:
+    //  - N is the row number
+    //  - M is the element in the array
+    // Note: the data structure also contains the min and max, but they are left out here for
+    // brevity.
+    //
+    // Each element contains the sum of 2^R raw samples, where R is the index of the row in
+    // which it lives. The job of this algorithm is to return the sum, min & max for each element in
+    // this list, by visiting the smallest numver of elements possible.
+    //
+    // Not every row is actually stored (see PyramidGeometry). Rows below the first level's blocks
+    // aren't, so any stretch of samples which isn't aligned to a whole block is summed straight
+    // from the raw samples instead. With a fan-in of more than two, the rows between levels aren't
+    // either, so an element of one of those is made up from a short run of the level below.
+
+    _want(size);
+
+    // Raw chunks can't be freed by the compressor while we might be looking at them
+    ReadEpoch::Guard guard;
+
+    // Find the aggregates for samples between begin and end
+    std::optional<DataStore<T, Set>> result;
+    _reduce(begin, end, 63 - count_leading_zeros(size), end - begin >= MIN_ROUNDED_RANGE, result);
+
+    // Unless every sample in the range was rounded away
+    return result ? *result : empty();
+}
+
+template <typename T, typename Set>
+void Pyramid<T, Set>::reduce(const std::pair<std::size_t, std::size_t> *ranges,
+                             std::size_t count,
+                             std::size_t size,
+                             DataStore<T, Set> *results,
+                             bool samples_only) const
+{
+    _want(size);
+    ReadEpoch::Guard guard;
+    const auto row_max = 63 - count_leading_zeros(size);
+    const auto built = std::min(size, _built.load(std::memory_order_acquire));
+
+    // Work along the coarsest level whose blocks are at most half as wide as the narrowest range,
+    // so every range covers at least one of them. Ranges too narrow to cover a whole block of the
+    // first level are reduced on their own like any other.
+    auto narrowest = size;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (ranges[i].second > ranges[i].first)
+        {
+            narrowest = std::min(narrowest, ranges[i].second - ranges[i].first);
+        }
+    }
+    const auto row = 62 - count_leading_zeros(narrowest);
+    const Level *level = nullptr;
+    std::size_t shift = 0;
+    if (row >= static_cast<int>(_block_shift) && (built >> _shift(_level_at(row))))
+    {
+        level = _data[_level_at(row)].get();
+        shift = _shift(_level_at(row));
+    }
+    const auto mask = level ? (std::size_t(1) << shift) - 1 : 0;
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto [begin, end] = ranges[i];
+        const bool wide = end - begin >= MIN_ROUNDED_RANGE;
+        std::optional<DataStore<T, Set>> result;
+
+        // The whole blocks in the middle of the range follow on from the last range's, so are
+        // read straight out of the level's chunks, leaving the ends either side of them
+        const auto middle_begin = (begin + mask) & ~mask;
+        const auto middle_end = std::min(end, built) & ~mask;
+        if (level && middle_begin < middle_end)
+        {
+            _reduce(begin, middle_begin, row_max, wide, result);
+            const auto blocks = _combine_blocks(
+                *level, middle_begin >> shift, middle_end >> shift, samples_only);
+            result = result ? combine(*result, blocks) : blocks;
+            _reduce(middle_end, end, row_max, wide, result);
+        }
+        else if (begin < end)
+        {
+            _reduce(begin, end, row_max, wide, result);
+        }
+        results[i] = result ? *result : empty();
+    }
+}
+
+template <typename T, typename Set>
+std::size_t Pyramid<T, Set>::reduce_snapped(std::pair<std::size_t, std::size_t> *ranges,
+                                            std::size_t count,
+                                            std::size_t size,
+                                            std::size_t width,
+                                            DataStore<T, Set> *results,
+                                            bool samples_only) const
+{
+    if (!count)
+    {
+        return 0;
+    }
+    _want(size);
+
+    // Blocks of the working level are no wider than the width, and no narrower than the width over
+    // the fan-in, so every range which isn't cut short ends up with between one and fan-in of them
+    const auto row = std::min(63 - count_leading_zeros(width), 63 - count_leading_zeros(size));
+    if (row < static_cast<int>(_block_shift))
+    {
+        reduce(ranges, count, size, results, samples_only);
+        return 0;
+    }
+    const auto shift = _shift(_level_at(row));
+    const auto mask = (std::size_t(1) << shift) - 1;
+    const auto lo = (ranges[0].first + mask) & ~mask;
+    const auto hi = std::min(size, _built.load(std::memory_order_acquire)) & ~mask;
+    if (lo >= hi)
+    {
+        reduce(ranges, count, size, results, samples_only);
+        return 0;
+    }
+
+    ReadEpoch::Guard guard;
+    const auto row_max = 63 - count_leading_zeros(size);
+    const auto &level = *_data[_level_at(row)];
+    const auto snap = [&](std::size_t index) {
+        return std::clamp((index + (mask + 1) / 2) & ~mask, lo, hi);
+    };
+
+    std::size_t error = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto &[begin, end] = ranges[i];
+        std::optional<DataStore<T, Set>> result;
+        const auto block_begin = snap(begin);
+        const auto block_end = snap(end);
+
+        // Samples before the first whole block or after the last can't be snapped to anything
+        // without leaving them out, so are reduced exactly
+        const bool head = begin < lo;
+        const bool tail = end > hi;
+        if (head)
+        {
+            _reduce(begin, std::min(lo, end), row_max, false, result);
+        }
+        if (block_begin < block_end)
+        {
+            const auto blocks =
+                _combine_blocks(level, block_begin >> shift, block_end >> shift, samples_only);
+            result = result ? combine(*result, blocks) : blocks;
+        }
+        if (tail)
+        {
+            _reduce(std::max(hi, begin), end, row_max, false, result);
+        }
+
+        // Ends which were snapped move with the blocks, others stay where they were
+        if (lo <= begin && begin <= hi)
+        {
+            error =
+                std::max(error, begin > block_begin ? begin - block_begin : block_begin - begin);
+            begin = block_begin;
+        }
+        if (lo <= end && end <= hi)
+        {
+            error = std::max(error, end > block_end ? end - block_end : block_end - end);
+            end = block_end;
+        }
+        results[i] = result ? *result : empty();
+    }
+    return error;
+}
+
+template <typename T, typename Set>
+void Pyramid<T, Set>::_reduce(std::size_t begin,
+                              std::size_t end,
+                              int row_max,
+                              bool wide,
+                              std::optional<DataStore<T, Set>> &result) const
+{
+    // Pieces are visited in order, so combining them one after another keeps the first and last
+    // samples straight
+    const auto add = [&result](const DataStore<T, Set> &s) {
+        result = result ? combine(*result, s) : s;
+    };
+
+    // Run from start to fininsh greedily consuming the highest rows possible
+    const auto built = _built.load(std::memory_order_acquire);
+    for (auto iter = begin; iter < end;)
+    {
+        // Count the number of least significant zeros, which gives us an idea of the largest chunk
+        // we are aligned to
+        auto row = count_trailing_zeros(iter);
+        row = std::min(row, row_max);
+
+        // If the remaining number of samples is smaller than one chunk on this row then we would
+        // have consumed too much Work out the largest chunk that that will fit in this chunk (by
+        // getting log2 of it)
+        const auto distance_remaining = end - iter;
+        const auto log2_dist = 63 - count_leading_zeros(distance_remaining);
+        row = std::min(log2_dist, row);
+
+        // Nor can it go past the samples the levels have been built for so far
+        row = std::min(row, iter < built ? 63 - count_leading_zeros(built - iter) : 0);
+
+        if (row < static_cast<int>(_block_shift))
+        {
+            // Consume raw samples up to the next block boundary (or the end). Blocks never straddle
+            // chunks or frames, so the run is contiguous.
+            const auto run_end = std::min(end, (iter | (_block_size - 1)) + 1);
+            if (wide && (iter | (_block_size - 1)) < built && _spilled(iter))
+            {
+                // Rather than going to disk, take the whole block if the run covers its middle
+                const auto middle = (iter & ~(_block_size - 1)) + _block_size / 2;
+                if (iter <= middle && middle < run_end)
+                {
+                    add((*_data[0])[iter >> _block_shift]);
+                }
+            }
+            else
+            {
+                add(summarize(_raw_values(iter), run_end - iter));
+            }
+            iter = run_end;
+        }
+        else
+        {
+            // The row's element is a run of fewer than fan-in elements of the level below it
+            const auto level = _level_at(row);
+            const auto shift = _shift(level);
+            const auto index = iter >> shift;
+            add(_data[level]->combine(index, index + (std::size_t(1) << (row - shift))));
+
+            iter += (1ULL << row);
+        }
+    }
+}
+
+template <typename T, typename Set> DataStore<T, Set> Pyramid<T, Set>::empty()
+{
+    DataStore<T, Set> empty{};
+    empty.min = std::numeric_limits<T>::max();
+    empty.max = std::numeric_limits<T>::lowest();
+    return empty;
+}
+
+template <typename T, typename Set>
+DataStore<T, Set> Pyramid<T, Set>::_combine_blocks(const Level &level,
+                                                   std::size_t begin,
+                                                   std::size_t end,
+                                                   bool samples_only)
+{
+    // Leaving out the columns nobody asked for saves a pass over each of them
+    return samples_only ? level.template combine<SampleAggregates<Set>>(begin, end)
+                        : level.combine(begin, end);
+}
+
+#define INSTANTIATE_PYRAMID(T)                                                                     \
+    template class amber::database::Pyramid<T, EnvelopeAggregates>;                                \
+    template class amber::database::Pyramid<T, DefaultAggregates>;                                 \
+    template class amber::database::Pyramid<T, MomentAggregates>;                                  \
+    template class amber::database::Pyramid<T, OhlcAggregates>;
+
+INSTANTIATE_PYRAMID(double)
+INSTANTIATE_PYRAMID(float)
+INSTANTIATE_PYRAMID(std::int16_t)
+INSTANTIATE_PYRAMID(std::int32_t)
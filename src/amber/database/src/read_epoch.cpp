@@ -0,0 +1,92 @@
+#include "read_epoch.hpp"
+
+#include <thread>
+
+using namespace amber::database;
+
+ReadEpoch &ReadEpoch::instance()
+{
+    static ReadEpoch epoch;
+    return epoch;
+}
+
+ReadEpoch::~ReadEpoch()
+{
+    for (auto *slot = _slots.load(); slot;)
+    {
+        auto *next = slot->next;
+        delete slot;
+        slot = next;
+    }
+}
+
+std::atomic<unsigned int> *ReadEpoch::_enter()
+{
+    // Gives the thread's slot back once the thread exits, by which time it holds no guards
+    thread_local struct Owner
+    {
+        Slot *slot = nullptr;
+
+        ~Owner()
+        {
+            if (slot)
+            {
+                slot->in_use.store(false, std::memory_order_release);
+            }
+        }
+    } owner;
+    if (!owner.slot)
+    {
+        owner.slot = _claim_slot();
+    }
+
+    for (;;)
+    {
+        const auto index = _epoch.load() & 1;
+        auto &readers = owner.slot->readers[index];
+        readers.fetch_add(1);
+
+        // If the epoch flipped in the meantime, synchronize() might already have seen our counter
+        // empty, so go again with the new one
+        if ((_epoch.load() & 1) == index)
+        {
+            return &readers;
+        }
+        readers.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+ReadEpoch::Slot *ReadEpoch::_claim_slot()
+{
+    // Take over the slot of a thread which has exited if there is one
+    for (auto *slot = _slots.load(); slot; slot = slot->next)
+    {
+        bool in_use = false;
+        if (slot->in_use.compare_exchange_strong(in_use, true))
+        {
+            return slot;
+        }
+    }
+
+    // Otherwise add a new one. It's in the list before its counters are first used, so
+    // synchronize() either sees it or the reader sees the new epoch.
+    auto *slot = new Slot;
+    slot->next = _slots.load();
+    while (!_slots.compare_exchange_weak(slot->next, slot))
+    {
+    }
+    return slot;
+}
+
+void ReadEpoch::synchronize()
+{
+    std::lock_guard<std::mutex> _(_synchronize_mut);
+    const auto index = _epoch.fetch_add(1) & 1;
+    for (auto *slot = _slots.load(); slot; slot = slot->next)
+    {
+        while (slot->readers[index].load() != 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+namespace amber::database
+{
+/**
+ * @brief Lets a thread free memory which lock-free readers might still be looking at, once they
+ * have all finished with it.
+ *
+ * Readers hold a Guard while they use anything which might be retired. To retire something, first
+ * make it unreachable for new readers, then call synchronize(), which waits for every reader which
+ * could still have a reference to it to drop its guard. After that it can be freed.
+ *
+ * Each thread counts its readers in a slot of its own, which sits on a cache line of its own, so
+ * taking a guard never touches memory another reader is writing to. Every slot has one counter for
+ * each of two epochs. synchronize() flips the epoch and waits for the old counter of every slot to
+ * drain, so new readers never hold it up.
+ */
+class ReadEpoch
+{
+    // Slots are only ever added to the list, and are handed on to another thread once the thread
+    // which had one exits
+    struct alignas(64) Slot
+    {
+        std::atomic<unsigned int> readers[2] = {0, 0};
+        std::atomic<bool> in_use{true};
+        Slot *next = nullptr;
+    };
+
+  public:
+    static ReadEpoch &instance();
+
+    ReadEpoch() = default;
+    ~ReadEpoch();
+
+    ReadEpoch(const ReadEpoch &) = delete;
+    ReadEpoch &operator=(const ReadEpoch &) = delete;
+
+    class Guard
+    {
+      public:
+        Guard() : _readers(instance()._enter())
+        {
+        }
+
+        ~Guard()
+        {
+            _readers->fetch_sub(1, std::memory_order_release);
+        }
+
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+
+      private:
+        std::atomic<unsigned int> *_readers;
+    };
+
+    /**
+     * @brief Wait until no reader can still see anything made unreachable before this was called.
+     */
+    void synchronize();
+
+  private:
+    std::atomic<unsigned int> *_enter();
+    Slot *_claim_slot();
+
+    std::atomic<unsigned int> _epoch{0};
+    std::atomic<Slot *> _slots{nullptr};
+    std::mutex _synchronize_mut;
+};
+} // namespace amber::database
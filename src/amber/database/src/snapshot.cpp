@@ -0,0 +1,257 @@
+#include "snapshot.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace amber::database;
+
+namespace
+{
+constexpr char MAGIC[8] = {'A', 'M', 'B', 'E', 'R', 'D', 'B', '\0'};
+constexpr std::uint32_t VERSION = 4;
+
+// Written in native byte order, so a file from a machine of the other endianness is rejected
+constexpr std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+/**
+ * @brief A read-only mapping of a whole file, which is unmapped when the last user lets go of it.
+ */
+class MappedFile
+{
+  public:
+    explicit MappedFile(const std::string &path)
+    {
+#ifdef _WIN32
+        _file = CreateFileA(path.c_str(),
+                            GENERIC_READ,
+                            FILE_SHARE_READ,
+                            nullptr,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+        if (_file == INVALID_HANDLE_VALUE)
+        {
+            throw std::runtime_error("Unable to open " + path);
+        }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(_file, &size))
+        {
+            CloseHandle(_file);
+            throw std::runtime_error("Unable to get the size of " + path);
+        }
+        _size = static_cast<std::size_t>(size.QuadPart);
+
+        if (_size)
+        {
+            _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            _data = _mapping ? MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+            if (!_data)
+            {
+                if (_mapping)
+                    CloseHandle(_mapping);
+                CloseHandle(_file);
+                throw std::runtime_error("Unable to map " + path);
+            }
+        }
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Unable to open " + path);
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Unable to get the size of " + path);
+        }
+        _size = static_cast<std::size_t>(info.st_size);
+
+        if (_size)
+        {
+            _data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (_data == MAP_FAILED)
+            {
+                _data = nullptr;
+                ::close(fd);
+                throw std::runtime_error("Unable to map " + path);
+            }
+        }
+
+        // The mapping stays valid once the descriptor is closed
+        ::close(fd);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (_data)
+            UnmapViewOfFile(_data);
+        if (_mapping)
+            CloseHandle(_mapping);
+        CloseHandle(_file);
+#else
+        if (_data)
+            munmap(_data, _size);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const
+    {
+        return static_cast<const char *>(_data);
+    }
+
+    std::size_t size() const
+    {
+        return _size;
+    }
+
+  private:
+#ifdef _WIN32
+    HANDLE _file = INVALID_HANDLE_VALUE;
+    HANDLE _mapping = nullptr;
+#endif
+    void *_data = nullptr;
+    std::size_t _size = 0;
+};
+} // namespace
+
+SnapshotWriter::SnapshotWriter(const std::string &path)
+    : _file(path + ".tmp", std::ios::binary | std::ios::trunc), _path(path)
+{
+    if (!_file)
+    {
+        throw std::runtime_error("Unable to create " + path + ".tmp");
+    }
+
+    write_bytes(MAGIC, sizeof(MAGIC));
+    write(VERSION);
+    write(BYTE_ORDER_MARK);
+}
+
+void SnapshotWriter::write(const std::string &value)
+{
+    write<std::uint64_t>(value.size());
+    write_bytes(value.data(), value.size());
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    // Abandoned part way through, so the old snapshot (if any) stays as it was
+    if (!_closed)
+    {
+        _file.close();
+        std::remove((_path + ".tmp").c_str());
+    }
+}
+
+void SnapshotWriter::close()
+{
+    const auto temp_path = _path + ".tmp";
+    _file.close();
+    _closed = true;
+    if (_file.fail())
+    {
+        std::remove(temp_path.c_str());
+        throw std::runtime_error("Unable to write " + temp_path);
+    }
+
+    // Replacing the old file rather than overwriting it leaves anyone who has it mapped with the
+    // old contents, and a crash never leaves a half written snapshot behind
+#ifdef _WIN32
+    const bool renamed = MoveFileExA(temp_path.c_str(), _path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    const bool renamed = ::rename(temp_path.c_str(), _path.c_str()) == 0;
+#endif
+    if (!renamed)
+    {
+        std::remove(temp_path.c_str());
+        throw std::runtime_error("Unable to replace " + _path);
+    }
+}
+
+void SnapshotWriter::write_bytes(const void *data, std::size_t size)
+{
+    _file.write(static_cast<const char *>(data), size);
+    _offset += size;
+}
+
+void SnapshotWriter::align()
+{
+    static const char padding[SNAPSHOT_ALIGNMENT] = {};
+    const auto misalignment = _offset % SNAPSHOT_ALIGNMENT;
+    if (misalignment)
+    {
+        write_bytes(padding, SNAPSHOT_ALIGNMENT - misalignment);
+    }
+}
+
+SnapshotReader::SnapshotReader(const std::string &path)
+{
+    const auto file = std::make_shared<const MappedFile>(path);
+    _data = file->data();
+    _size = file->size();
+    _mapping = file;
+
+    if (_size < sizeof(MAGIC) || std::memcmp(_data, MAGIC, sizeof(MAGIC)) != 0)
+    {
+        throw std::runtime_error(path + " is not a snapshot");
+    }
+    _offset = sizeof(MAGIC);
+
+    if (read<std::uint32_t>() != VERSION || read<std::uint32_t>() != BYTE_ORDER_MARK)
+    {
+        throw std::runtime_error(path + " is from an incompatible version");
+    }
+}
+
+std::string SnapshotReader::read_string()
+{
+    const auto size = read<std::uint64_t>();
+    const auto *data = bytes(size);
+    return std::string(data, size);
+}
+
+bool SnapshotReader::at_end() const
+{
+    return _offset == _size;
+}
+
+const char *SnapshotReader::bytes(std::size_t size)
+{
+    if (size > _size - _offset)
+    {
+        throw std::runtime_error("Snapshot is truncated");
+    }
+    const auto *data = _data + _offset;
+    _offset += size;
+    return data;
+}
+
+void SnapshotReader::align()
+{
+    const auto misalignment = _offset % SnapshotWriter::SNAPSHOT_ALIGNMENT;
+    if (misalignment)
+    {
+        bytes(SnapshotWriter::SNAPSHOT_ALIGNMENT - misalignment);
+    }
+}
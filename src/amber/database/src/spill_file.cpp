@@ -0,0 +1,135 @@
+#include "spill_file.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+#endif
+
+using namespace amber::database;
+
+SpillFile::SpillFile(const std::string &directory)
+{
+#ifdef _WIN32
+    char path[MAX_PATH];
+    if (!GetTempFileNameA(directory.c_str(), "amb", 0, path))
+    {
+        throw std::runtime_error("Unable to create a spill file in " + directory);
+    }
+    _file = CreateFileA(path,
+                        GENERIC_READ | GENERIC_WRITE,
+                        0,
+                        nullptr,
+                        CREATE_ALWAYS,
+                        FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+                        nullptr);
+    if (_file == INVALID_HANDLE_VALUE)
+    {
+        DeleteFileA(path);
+        throw std::runtime_error("Unable to create a spill file in " + directory);
+    }
+#else
+    const auto pattern = directory + "/amber-spill-XXXXXX";
+    std::vector<char> path(pattern.begin(), pattern.end());
+    path.push_back('\0');
+    _fd = mkstemp(path.data());
+    if (_fd < 0)
+    {
+        throw std::runtime_error("Unable to create a spill file in " + directory);
+    }
+    unlink(path.data());
+#endif
+}
+
+SpillFile::~SpillFile()
+{
+#ifdef _WIN32
+    CloseHandle(_file);
+#else
+    close(_fd);
+#endif
+}
+
+std::uint64_t SpillFile::append(const void *data, std::size_t size)
+{
+    // Only the end of the file needs protecting, the writes themselves could overlap safely
+    std::uint64_t offset;
+    {
+        std::lock_guard<std::mutex> _(_mut);
+        offset = _size;
+        _size += size;
+    }
+
+    auto bytes = static_cast<const char *>(data);
+    auto position = offset;
+    while (size)
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(position);
+        overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+        DWORD written = 0;
+        const auto chunk = static_cast<DWORD>(std::min<std::size_t>(size, 1 << 30));
+        if (!WriteFile(_file, bytes, chunk, &written, &overlapped) || written == 0)
+        {
+            throw std::runtime_error("Unable to write to the spill file");
+        }
+#else
+        const auto written = pwrite(_fd, bytes, size, static_cast<off_t>(position));
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            throw std::runtime_error("Unable to write to the spill file");
+        }
+#endif
+        bytes += written;
+        position += written;
+        size -= written;
+    }
+    return offset;
+}
+
+void SpillFile::read(std::uint64_t offset, void *data, std::size_t size) const
+{
+    auto bytes = static_cast<char *>(data);
+    while (size)
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD read = 0;
+        const auto chunk = static_cast<DWORD>(std::min<std::size_t>(size, 1 << 30));
+        if (!ReadFile(_file, bytes, chunk, &read, &overlapped) || read == 0)
+        {
+            throw std::runtime_error("Unable to read from the spill file");
+        }
+#else
+        const auto read = pread(_fd, bytes, size, static_cast<off_t>(offset));
+        if (read < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (read <= 0)
+        {
+            throw std::runtime_error("Unable to read from the spill file");
+        }
+#endif
+        bytes += read;
+        offset += read;
+        size -= read;
+    }
+}
+
+std::uint64_t SpillFile::size() const
+{
+    std::lock_guard<std::mutex> _(_mut);
+    return _size;
+}
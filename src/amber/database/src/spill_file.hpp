@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+namespace amber::database
+{
+/**
+ * @brief A scratch file which cold samples are written out to when memory runs short, so they can
+ * be read back later.
+ *
+ * The file is deleted as soon as it has been created, so nothing is left behind however the process
+ * ends. It only ever grows: space written for something which is later thrown away isn't reused.
+ *
+ * Any number of threads may append to and read from the file at the same time.
+ */
+class SpillFile
+{
+  public:
+    /**
+     * @brief Create an empty spill file.
+     *
+     * @param directory Where to create the file.
+     * @throws std::runtime_error if the file can't be created.
+     */
+    explicit SpillFile(const std::string &directory);
+    ~SpillFile();
+    SpillFile(const SpillFile &) = delete;
+    SpillFile &operator=(const SpillFile &) = delete;
+
+    /**
+     * @brief Write some bytes to the end of the file.
+     *
+     * @return Where the bytes start in the file.
+     * @throws std::runtime_error if the bytes can't be written, e.g. because the disk is full.
+     */
+    std::uint64_t append(const void *data, std::size_t size);
+
+    /**
+     * @brief Read back bytes written by append().
+     *
+     * @throws std::runtime_error if the bytes can't be read.
+     */
+    void read(std::uint64_t offset, void *data, std::size_t size) const;
+
+    /**
+     * @brief The number of bytes written to the file so far.
+     */
+    std::uint64_t size() const;
+
+  private:
+#ifdef _WIN32
+    HANDLE _file = INVALID_HANDLE_VALUE;
+#else
+    int _fd = -1;
+#endif
+    mutable std::mutex _mut;
+    std::uint64_t _size = 0;
+};
+} // namespace amber::database
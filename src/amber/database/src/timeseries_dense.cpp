@@ -1,61 +1,66 @@
 #include "timeseries_dense.hpp"
+#include "read_epoch.hpp"
 
 #include <algorithm>
-#include <limits>
-#include <numeric>
-
-#ifdef _MSC_VER
-#include <intrin.h>
-#endif
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 using namespace amber::database;
 
-TimeSeriesDense::TimeSeriesDense(double start, double interval)
-    : _data(1), _interval(interval), _start(start)
+template <typename T, typename Set>
+TimeSeriesDense<T, Set>::TimeSeriesDense(double start,
+                                    double interval,
+                                    std::shared_ptr<ChunkArena> arena)
+    : _pyramid(std::move(arena)), _interval(interval), _start(start), _size(0)
 {
 }
 
-TimeSeriesDense::TimeSeriesDense(double start, double interval, std::vector<double> init)
-    : _data(1), _interval(interval), _start(start)
+template <typename T, typename Set>
+TimeSeriesDense<T, Set>::TimeSeriesDense(double start,
+                                    double interval,
+                                    const std::vector<T> &init,
+                                    std::shared_ptr<ChunkArena> arena)
+    : _pyramid(std::move(arena)), _interval(interval), _start(start), _size(0)
 {
-    for (double d : init)
-    {
-        _data[0].push_back(DataStore{d, d, d});
-    }
-
-    int row = 1;
-    auto size = init.size() >> 1;
-    while (size)
-    {
-        _data.resize(row + 1);
-        for (std::size_t i = 0; i < size; ++i)
-        {
-            _data[row].push_back(
-                DataStore{_data[row - 1][2 * i].sum + _data[row - 1][2 * i + 1].sum,
-                          std::min(_data[row - 1][2 * i].min, _data[row - 1][2 * i + 1].min),
-                          std::max(_data[row - 1][2 * i].max, _data[row - 1][2 * i + 1].max)});
-        }
-        size >>= 1;
-        ++row;
-    }
+    _pyramid.bulk_load(init.data(), init.size());
+    _size.store(_pyramid.size(), std::memory_order_release);
 }
 
-std::size_t TimeSeriesDense::get_samples(TSSample *samples,
-                                         double timestamp_start,
-                                         double bin_width,
-                                         std::size_t num_samples) const
+template <typename T, typename Set>
+TimeSeriesDense<T, Set>::TimeSeriesDense(double start,
+                                    double interval,
+                                    std::vector<T> &&init,
+                                    std::shared_ptr<ChunkArena> arena)
+    : _pyramid(std::move(arena)), _interval(interval), _start(start), _size(0)
 {
-    // TODO find a more efficient solution to concurrent access
-    std::lock_guard<std::recursive_mutex> _(_mut);
+    _pyramid.bulk_load(std::move(init));
+    _size.store(_pyramid.size(), std::memory_order_release);
+}
 
-    // Keep track of which sample we are writing to
-    auto *current_sample = samples;
+template <typename T, typename Set>
+template <typename Visit>
+std::size_t TimeSeriesDense<T, Set>::_visit_bins(std::size_t published,
+                                                 double timestamp_start,
+                                                 double bin_width,
+                                                 std::size_t num_bins,
+                                                 Visit &&visit) const
+{
+    // Take a snapshot of the number of committed samples, anything below this is fully written.
+    // With a retention, samples before the first are dropped once we no longer hold the guard.
+    ReadEpoch::Guard guard;
+    const auto size = std::min(published, _size.load(std::memory_order_acquire));
+    const auto first = std::min(_pyramid.first(), size);
 
     // The span is important for use later on
-    auto span = get_span();
+    auto span = _span(first, size);
+
+    // Keep track of how many bins have been visited
+    std::size_t count = 0;
 
     // Iterate through the bins
-    for (std::size_t bin_index = 0; bin_index < num_samples; ++bin_index)
+    for (std::size_t bin_index = 0; bin_index < num_bins; ++bin_index)
     {
         // Work out the timestamps of the start and end of the bin
         const auto bin_span = std::make_pair<double, double>(
@@ -63,186 +68,396 @@ std::size_t TimeSeriesDense::get_samples(TSSample *samples,
 
         const bool bin_is_before_first_sample = bin_span.second < span.first;
         const bool bin_is_after_last_sample = bin_span.first > span.second;
-        if (_data[0].empty() || bin_is_before_first_sample || bin_is_after_last_sample)
+        if (size == 0 || bin_is_before_first_sample || bin_is_after_last_sample)
         {
             // The bin is completely devoid of any samples - don't output anything
             continue;
         }
         else
         {
-            current_sample->timestamp = bin_span.first;
-            auto index_first = static_cast<long long>((bin_span.first - span.first) / _interval);
-            index_first = std::max(index_first, static_cast<long long>(0));
-            auto index_last = static_cast<long long>((bin_span.second - span.first) / _interval);
-            index_last = std::min(index_last, static_cast<long long>(_data[0].size()));
+            auto index_first = static_cast<long long>((bin_span.first - _start) / _interval);
+            index_first = std::max(index_first, static_cast<long long>(first));
+            auto index_last = static_cast<long long>((bin_span.second - _start) / _interval);
+            index_last = std::min(index_last, static_cast<long long>(size));
 
-            if (index_first == index_last)
+            if (index_first >= static_cast<long long>(size))
             {
-                const auto value = _data[0][index_first].sum;
-                current_sample->average = current_sample->min = current_sample->max = value;
-                ++current_sample;
+                // The bin starts exactly where the data ends
+                continue;
+            }
+            visit(bin_index, bin_span.first, index_first, index_last, size);
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+template <typename T, typename Set>
+template <typename Emit>
+std::size_t TimeSeriesDense<T, Set>::_reduce_bins(std::size_t published,
+                                                  double timestamp_start,
+                                                  double bin_width,
+                                                  std::size_t num_bins,
+                                                  std::size_t *error,
+                                                  bool samples_only,
+                                                  Emit &&emit) const
+{
+    // Scratch space is kept from one call to the next, so a frame's worth of bins doesn't cost any
+    // allocations once the buffers have grown to fit. Nothing called from here comes back in.
+    thread_local struct
+    {
+        std::vector<double> timestamps;
+        std::vector<std::pair<std::size_t, std::size_t>> ranges;
+        std::vector<DataStore<T, Set>> results;
+        std::vector<bool> empty;
+    } scratch;
+    auto &timestamps = scratch.timestamps;
+    auto &ranges = scratch.ranges;
+    auto &results = scratch.results;
+    auto &empty = scratch.empty;
+    timestamps.clear();
+    ranges.clear();
+    empty.clear();
+
+    // Work out the range of every bin before reducing any of them, which the guard keeps valid in
+    // between
+    ReadEpoch::Guard guard;
+    std::size_t size = 0;
+    _visit_bins(published,
+                timestamp_start,
+                bin_width,
+                num_bins,
+                [&](std::size_t, double timestamp, long long first, long long last, std::size_t n) {
+                    timestamps.push_back(timestamp);
+                    ranges.emplace_back(first, last);
+                    size = n;
+                });
+
+    results.resize(ranges.size());
+    if (error)
+    {
+        for (const auto &[first, last] : ranges)
+        {
+            empty.push_back(first == last);
+        }
+        const auto width = static_cast<std::size_t>(bin_width / _interval);
+        *error = _pyramid.reduce_snapped(
+            ranges.data(), ranges.size(), size, width, results.data(), samples_only);
+    }
+    else
+    {
+        _pyramid.reduce(ranges.data(), ranges.size(), size, results.data(), samples_only);
+    }
+
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < ranges.size(); ++i)
+    {
+        if (error && !empty[i] && ranges[i].first == ranges[i].second)
+        {
+            // Both edges of a narrow bin at the end of the data were snapped to the same place
+            continue;
+        }
+        emit(timestamps[i], ranges[i].first, ranges[i].second, size, results[i]);
+        ++count;
+    }
+    return count;
+}
+
+template <typename T, typename Set>
+std::size_t TimeSeriesDense<T, Set>::get_samples(TSSample *samples,
+                                                 double timestamp_start,
+                                                 double bin_width,
+                                                 std::size_t num_samples) const
+{
+    return get_samples_at(published(), samples, timestamp_start, bin_width, num_samples);
+}
+
+template <typename T, typename Set>
+std::size_t TimeSeriesDense<T, Set>::get_samples_at(std::size_t published,
+                                                    TSSample *samples,
+                                                    double timestamp_start,
+                                                    double bin_width,
+                                                    std::size_t num_samples) const
+{
+    return _get_samples(published, samples, timestamp_start, bin_width, num_samples, nullptr);
+}
+
+template <typename T, typename Set>
+std::size_t TimeSeriesDense<T, Set>::get_samples_approx(std::size_t published,
+                                                        TSSample *samples,
+                                                        double timestamp_start,
+                                                        double bin_width,
+                                                        std::size_t num_samples,
+                                                        double &error) const
+{
+    std::size_t snapped = 0;
+    const auto count =
+        _get_samples(published, samples, timestamp_start, bin_width, num_samples, &snapped);
+    error = snapped * _interval;
+    return count;
+}
+
+template <typename T, typename Set>
+std::size_t TimeSeriesDense<T, Set>::_get_samples(std::size_t published,
+                                                  TSSample *samples,
+                                                  double timestamp_start,
+                                                  double bin_width,
+                                                  std::size_t num_samples,
+                                                  std::size_t *error) const
+{
+    // Keep track of which sample we are writing to
+    auto *current_sample = samples;
+    return _reduce_bins(
+        published,
+        timestamp_start,
+        bin_width,
+        num_samples,
+        error,
+        true,
+        [this, &current_sample](double timestamp,
+                                std::size_t first,
+                                std::size_t last,
+                                std::size_t,
+                                const DataStore<T, Set> &results) {
+            auto &sample = *current_sample++;
+            sample.timestamp = timestamp;
+            if (first == last)
+            {
+                sample.average = sample.min = sample.max = _pyramid[first];
+                return;
+            }
+
+            if constexpr (Set::sum)
+            {
+                sample.average = static_cast<double>(results.sum) / (last - first);
             }
             else
             {
-                const auto results = _reduce(index_first, index_last);
-                current_sample->average = std::get<0>(results);
-                current_sample->min = std::get<1>(results);
-                current_sample->max = std::get<2>(results);
-                ++current_sample;
+                sample.average = (static_cast<double>(results.min) + results.max) / 2;
             }
-        }
+            sample.min = results.min;
+            sample.max = results.max;
+        });
+}
+
+template <typename T, typename Set>
+std::size_t TimeSeriesDense<T, Set>::get_stats(TSStats *stats,
+                                               double timestamp_start,
+                                               double bin_width,
+                                               std::size_t num_bins) const
+{
+    auto *current_stat = stats;
+    return _reduce_bins(
+        published(),
+        timestamp_start,
+        bin_width,
+        num_bins,
+        nullptr,
+        false,
+        [this, &current_stat](double timestamp,
+                              std::size_t first,
+                              std::size_t last,
+                              std::size_t size,
+                              DataStore<T, Set> results) {
+            // A bin narrower than a sample still reports the sample it falls in
+            if (first == last)
+            {
+                results = _pyramid.reduce(first, ++last, size);
+            }
+            const auto count = last - first;
+            const auto nan = std::nan("");
+
+            auto &stat = *current_stat++;
+            stat.timestamp = timestamp;
+            stat.count = count;
+            stat.min = results.min;
+            stat.max = results.max;
+            stat.average = nan;
+            stat.rms = stat.stddev = nan;
+            stat.first = stat.last = nan;
+            if constexpr (Set::sum)
+            {
+                stat.average = static_cast<double>(results.sum) / count;
+            }
+            if constexpr (Set::sum_squares)
+            {
+                const auto mean_square = results.sum_squares / count;
+                stat.rms = std::sqrt(mean_square);
+                stat.stddev = std::sqrt(std::max(0.0, mean_square - stat.average * stat.average));
+            }
+            if constexpr (Set::first_last)
+            {
+                stat.first = results.first;
+                stat.last = results.last;
+            }
+        });
+}
+
+template <typename T, typename Set>
+void TimeSeriesDense<T, Set>::enable_histograms(double low, double high, unsigned int buckets)
+{
+    std::lock_guard<std::mutex> _(_write_mut);
+    _pyramid.enable_histograms(low, high, buckets);
+}
+
+template <typename T, typename Set> unsigned int TimeSeriesDense<T, Set>::histogram_buckets() const
+{
+    return _pyramid.histogram_buckets();
+}
+
+template <typename T, typename Set>
+void TimeSeriesDense<T, Set>::get_histograms(std::uint64_t *counts,
+                                             double timestamp_start,
+                                             double bin_width,
+                                             std::size_t num_bins) const
+{
+    const auto buckets = _pyramid.histogram_buckets();
+    if (!buckets)
+    {
+        throw std::logic_error("Histograms aren't being kept for this timeseries");
     }
 
-    const auto count = current_sample - samples;
-    return count;
+    // Every bin gets a histogram, so they line up with the columns of the plot
+    std::fill(counts, counts + num_bins * buckets, 0);
+    _visit_bins(
+        published(),
+        timestamp_start,
+        bin_width,
+        num_bins,
+        [this, counts, buckets](
+            std::size_t bin, double, long long first, long long last, std::size_t size) {
+            last = std::max(last, first + 1);
+            _pyramid.histogram(first, last, size, counts + bin * buckets);
+        });
 }
 
-TSSample TimeSeriesDense::get_sample(double timestamp, double bin_width) const
+template <typename T, typename Set>
+TSSample TimeSeriesDense<T, Set>::get_sample(double timestamp, double bin_width) const
 {
     TSSample sample;
     get_samples(&sample, timestamp, bin_width, 1);
     return sample;
 }
 
-std::pair<double, double> TimeSeriesDense::get_span() const
+template <typename T, typename Set>
+std::pair<double, double> TimeSeriesDense<T, Set>::get_span() const
 {
-    std::lock_guard<std::recursive_mutex> _(_mut);
-    const double last = _start + (_data[0].size() * _interval);
-    return std::make_pair(_start, last);
+    return get_span_at(published());
 }
 
-std::size_t TimeSeriesDense::memory_usage() const
+template <typename T, typename Set>
+std::pair<double, double> TimeSeriesDense<T, Set>::get_span_at(std::size_t published) const
 {
-    std::size_t size = _data.size() * sizeof(ChunkedVector<DataStore, CHUNK_SIZE>);
-    std::size_t total_bytes =
-        std::accumulate(_data.begin(), _data.end(), size, [](std::size_t total, const auto &row) {
-            const std::size_t capacity = row.capacity();
-            return total + (capacity * sizeof(row[0]));
-        });
-    return total_bytes;
+    const auto size = std::min(published, _size.load(std::memory_order_acquire));
+    return _span(std::min(_pyramid.first(), size), size);
 }
 
-std::size_t TimeSeriesDense::size() const
+template <typename T, typename Set>
+std::pair<double, double> TimeSeriesDense<T, Set>::_span(std::size_t first, std::size_t size) const
 {
-    return _data[0].size();
+    const double last = _start + (size * _interval);
+    return std::make_pair(_start + (first * _interval), last);
 }
 
-void TimeSeriesDense::push_sample(double value)
+template <typename T, typename Set> std::size_t TimeSeriesDense<T, Set>::memory_usage() const
 {
-    std::lock_guard<std::recursive_mutex> _(_mut);
-    _data[0].push_back(DataStore{value, value, value});
-    std::size_t sz = _data[0].size();
-    std::size_t index = 0;
-    while (sz /= 2)
-    {
-        ++index;
-        if (index >= _data.size())
-        {
-            _data.resize(index + 1);
-        }
-        const auto &prev = _data[index - 1];
-        auto &buf = _data[index];
-        if (sz > buf.size())
-        {
-            const auto last = prev[prev.size() - 1];
-            const auto second_last = prev[prev.size() - 2];
+    return _pyramid.memory_usage(_size.load(std::memory_order_acquire));
+}
 
-            const auto sum = last.sum + second_last.sum;
-            const auto min = std::min(last.min, second_last.min);
-            const auto max = std::max(last.max, second_last.max);
-            buf.push_back(DataStore{sum, min, max});
-        }
-    }
+template <typename T, typename Set>
+std::size_t TimeSeriesDense<T, Set>::logical_memory_usage() const
+{
+    return _pyramid.logical_memory_usage(_size.load(std::memory_order_acquire));
 }
 
-#if defined(__GNUC__) || defined(__GNUG__)
-int TimeSeriesDense::count_trailing_zeros(unsigned long long value)
-{
-    return __builtin_ctzll(value | (1ULL << 63));
-};
-
-int TimeSeriesDense::count_leading_zeros(unsigned long long value)
-{
-    return __builtin_clzll(value | 1ULL);
-};
-
-#elif defined _MSC_VER
-int TimeSeriesDense::count_trailing_zeros(unsigned long long value)
-{
-    unsigned long leading;
-    _BitScanForward64(&leading, value | (1ULL << 63));
-    return leading;
-};
-
-int TimeSeriesDense::count_leading_zeros(unsigned long long value)
-{
-    unsigned long leading;
-    _BitScanReverse64(&leading, value | 1ULL);
-    return 63 ^ leading;
-};
-
-#endif
-
-/**
- * @brief Fin
- *
- * @param begin
- * @param end
- * @return std::tuple<double, double, double>
- */
-std::tuple<double, double, double> TimeSeriesDense::_reduce(std::size_t begin,
-                                                            std::size_t end) const
-{
-    // Data is stored in an array of arrays like so:
-    // [1 2 3 4 5 6 7 8]
-    // [3 7 11 15]
-    // [10 26]
-    // [36]
-    //
-    // The first row contains the raw samples.
-    // Each subsequent row contains the sum of two elements in the row above.
-    //   I.e. e[N][M] = e[N-1][2M] + e[N-1][2M+1]
-    // Where:
-    //  - N is the row number
-    //  - M is the element in the array
-    // Note: the data structure also contains the min and max, but they are left out here for
-    // brevity.
-    //
-    // Each element contains the sum of 2^R raw samples, where R is the index of the row in
-    // which it lives. The job of this algorithm is to return the sum, min & max for each element in
-    // this list, by visiting the smallest numver of elements possible.
-
-    // Find the average, min and max for samples between begin and end
-    const auto distance = end - begin;
-    const auto row_max = static_cast<int>(_data.size() - 1);
-    double sum = 0;
-    double min = std::numeric_limits<double>::max();
-    double max = std::numeric_limits<double>::lowest();
-
-    // Run from start to fininsh greedily consuming the highest rows possible
-    for (auto iter = begin; iter < end;)
+template <typename T, typename Set> std::size_t TimeSeriesDense<T, Set>::size() const
+{
+    const auto size = _size.load(std::memory_order_acquire);
+    return size - std::min(_pyramid.first(), size);
+}
+
+template <typename T, typename Set>
+void TimeSeriesDense<T, Set>::set_retention(double seconds)
+{
+    std::lock_guard<std::mutex> _(_write_mut);
+    _pyramid.set_retention(static_cast<std::size_t>(std::max(1.0, std::ceil(seconds / _interval))));
+}
+
+template <typename T, typename Set>
+void TimeSeriesDense<T, Set>::set_geometry(const PyramidGeometry &geometry)
+{
+    std::lock_guard<std::mutex> _(_write_mut);
+    _pyramid.set_geometry(geometry);
+}
+
+template <typename T, typename Set> std::size_t TimeSeriesDense<T, Set>::published() const
+{
+    return _size.load(std::memory_order_acquire);
+}
+
+template <typename T, typename Set> void TimeSeriesDense<T, Set>::save(SnapshotWriter &writer) const
+{
+    save_at(writer, published());
+}
+
+template <typename T, typename Set>
+void TimeSeriesDense<T, Set>::save_at(SnapshotWriter &writer, std::size_t published) const
+{
+    writer.write(SnapshotSeriesType::Dense);
+    writer.write(snapshot_sample_type<T>());
+    writer.write(Set::id);
+
+    // The window may move on at any time, so where it starts is read once, and the guard keeps
+    // everything from there until it has been saved
+    ReadEpoch::Guard guard;
+    const auto size = std::min(published, _size.load(std::memory_order_acquire));
+    const auto first = std::min(_pyramid.first(), size);
+    writer.write(_start + (first * _interval));
+    writer.write(_interval);
+    _pyramid.save(writer, first, size);
+}
+
+template <typename T, typename Set>
+std::optional<double> TimeSeriesDense<T, Set>::spill_candidate() const
+{
+    if (const auto chunk = _pyramid.spill_candidate())
     {
-        // Count the number of least significant zeros, which gives us an idea of the largest chunk
-        // we are aligned to
-        auto row = count_trailing_zeros(iter);
-        row = std::min(row, row_max);
-
-        // If the remaining number of samples is smaller than one chunk on this row then we would
-        // have consumed too much Work out the largest chunk that that will fit in this chunk (by
-        // getting log2 of it)
-        const auto distance_remaining = end - iter;
-        const auto log2_dist = 63 - count_leading_zeros(distance_remaining);
-        row = std::min(log2_dist, row);
-
-        const auto index = iter >> row;
-        const auto &s = _data[row][index];
-        sum += s.sum;
-        min = std::min(s.min, min);
-        max = std::max(s.max, max);
-
-        iter += (1U << row);
+        return _start + static_cast<double>(*chunk * Pyramid<T, Set>::CHUNK_SIZE) * _interval;
     }
+    return std::nullopt;
+}
 
-    auto average = sum / distance;
-    return std::make_tuple(average, min, max);
+template <typename T, typename Set>
+std::size_t TimeSeriesDense<T, Set>::spill(const std::shared_ptr<SpillFile> &file)
+{
+    return _pyramid.spill(file);
 }
+
+template <typename T, typename Set> std::size_t TimeSeriesDense<T, Set>::spilled_bytes() const
+{
+    return _pyramid.spilled_bytes();
+}
+
+template <typename T, typename Set>
+std::shared_ptr<TimeSeriesDense<T, Set>>
+TimeSeriesDense<T, Set>::load(SnapshotReader &reader, std::shared_ptr<ChunkArena> arena)
+{
+    const auto start = reader.read<double>();
+    const auto interval = reader.read<double>();
+    auto ts = std::make_shared<TimeSeriesDense>(start, interval, std::move(arena));
+    ts->_pyramid.load(reader);
+    ts->_size.store(ts->_pyramid.size(), std::memory_order_release);
+    return ts;
+}
+
+#define INSTANTIATE_TIMESERIES_DENSE(T)                                                            \
+    template class amber::database::TimeSeriesDense<T, EnvelopeAggregates>;                        \
+    template class amber::database::TimeSeriesDense<T, DefaultAggregates>;                         \
+    template class amber::database::TimeSeriesDense<T, MomentAggregates>;                          \
+    template class amber::database::TimeSeriesDense<T, OhlcAggregates>;
+
+INSTANTIATE_TIMESERIES_DENSE(double)
+INSTANTIATE_TIMESERIES_DENSE(float)
+INSTANTIATE_TIMESERIES_DENSE(std::int16_t)
+INSTANTIATE_TIMESERIES_DENSE(std::int32_t)
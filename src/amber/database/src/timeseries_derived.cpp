@@ -0,0 +1,476 @@
+#include "timeseries_derived.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+
+using namespace amber::database;
+
+Expression::Expression(std::shared_ptr<TimeSeries> series)
+    : _node(std::make_shared<const Node>(Node{Op::Series, std::move(series), 0, nullptr, nullptr}))
+{
+}
+
+Expression::Expression(double constant)
+    : _node(std::make_shared<const Node>(Node{Op::Constant, nullptr, constant, nullptr, nullptr}))
+{
+}
+
+std::optional<Expression::Affine> Expression::affine() const
+{
+    return _affine(*_node);
+}
+
+std::optional<Expression::Affine> Expression::_affine(const Node &node)
+{
+    if (node.op == Op::Series)
+    {
+        return Affine{node.series, 1, 0};
+    }
+    if (node.op == Op::Constant)
+    {
+        return Affine{nullptr, 0, node.constant};
+    }
+
+    const auto lhs = _affine(*node.lhs);
+    if (!lhs)
+    {
+        return std::nullopt;
+    }
+    if (node.op == Op::Negate)
+    {
+        return Affine{lhs->series, -lhs->scale, -lhs->offset};
+    }
+    if (node.op == Op::Abs)
+    {
+        // Folding the sign into the min and max isn't enough, the average would be wrong
+        if (lhs->series)
+        {
+            return std::nullopt;
+        }
+        return Affine{nullptr, 0, std::fabs(lhs->offset)};
+    }
+
+    const auto rhs = _affine(*node.rhs);
+    if (!rhs || (lhs->series && rhs->series && lhs->series != rhs->series))
+    {
+        return std::nullopt;
+    }
+    const auto series = lhs->series ? lhs->series : rhs->series;
+    switch (node.op)
+    {
+    case Op::Add:
+        return Affine{series, lhs->scale + rhs->scale, lhs->offset + rhs->offset};
+    case Op::Subtract:
+        return Affine{series, lhs->scale - rhs->scale, lhs->offset - rhs->offset};
+    case Op::Multiply:
+        // Only affine if one side is a constant, i.e. has no scale
+        if (lhs->series && rhs->series)
+        {
+            return std::nullopt;
+        }
+        return Affine{series,
+                      lhs->scale * rhs->offset + rhs->scale * lhs->offset,
+                      lhs->offset * rhs->offset};
+    case Op::Divide:
+        if (rhs->series)
+        {
+            return std::nullopt;
+        }
+        return Affine{series, lhs->scale / rhs->offset, lhs->offset / rhs->offset};
+    default:
+        return std::nullopt;
+    }
+}
+
+Expression amber::database::operator+(const Expression &lhs, const Expression &rhs)
+{
+    return Expression(std::make_shared<const Expression::Node>(
+        Expression::Node{Expression::Op::Add, nullptr, 0, lhs._node, rhs._node}));
+}
+
+Expression amber::database::operator-(const Expression &lhs, const Expression &rhs)
+{
+    return Expression(std::make_shared<const Expression::Node>(
+        Expression::Node{Expression::Op::Subtract, nullptr, 0, lhs._node, rhs._node}));
+}
+
+Expression amber::database::operator*(const Expression &lhs, const Expression &rhs)
+{
+    return Expression(std::make_shared<const Expression::Node>(
+        Expression::Node{Expression::Op::Multiply, nullptr, 0, lhs._node, rhs._node}));
+}
+
+Expression amber::database::operator/(const Expression &lhs, const Expression &rhs)
+{
+    return Expression(std::make_shared<const Expression::Node>(
+        Expression::Node{Expression::Op::Divide, nullptr, 0, lhs._node, rhs._node}));
+}
+
+Expression amber::database::operator-(const Expression &operand)
+{
+    return Expression(std::make_shared<const Expression::Node>(
+        Expression::Node{Expression::Op::Negate, nullptr, 0, operand._node, nullptr}));
+}
+
+Expression amber::database::abs(const Expression &operand)
+{
+    return Expression(std::make_shared<const Expression::Node>(
+        Expression::Node{Expression::Op::Abs, nullptr, 0, operand._node, nullptr}));
+}
+
+TimeSeriesDerived::TimeSeriesDerived(Expression expression, std::shared_ptr<ChunkArena> arena)
+    : _affine(expression.affine()), _arena(std::move(arena)), _cache(nullptr), _start(0),
+      _interval(0)
+{
+    _compile(*expression._node);
+    if (_inputs.empty())
+    {
+        throw std::invalid_argument("A derived timeseries needs at least one input");
+    }
+}
+
+void TimeSeriesDerived::_compile(const Expression::Node &node)
+{
+    if (node.lhs)
+    {
+        _compile(*node.lhs);
+    }
+    if (node.rhs)
+    {
+        _compile(*node.rhs);
+    }
+
+    std::size_t input = 0;
+    if (node.op == Expression::Op::Series)
+    {
+        // The same series may appear more than once, but it only needs reading once
+        const auto it = std::find(_inputs.begin(), _inputs.end(), node.series);
+        input = it - _inputs.begin();
+        if (it == _inputs.end())
+        {
+            _inputs.push_back(node.series);
+        }
+    }
+    _program.push_back(Instruction{node.op, input, node.constant});
+}
+
+std::size_t TimeSeriesDerived::get_samples(TSSample *samples,
+                                           double timestamp_start,
+                                           double bin_width,
+                                           std::size_t num_samples) const
+{
+    if (_affine)
+    {
+        const auto count =
+            _affine->series->get_samples(samples, timestamp_start, bin_width, num_samples);
+        const auto scale = _affine->scale;
+        const auto offset = _affine->offset;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto &sample = samples[i];
+            sample.average = scale * sample.average + offset;
+            sample.min = scale * sample.min + offset;
+            sample.max = scale * sample.max + offset;
+            if (scale < 0)
+            {
+                std::swap(sample.min, sample.max);
+            }
+        }
+        return count;
+    }
+
+    if (const auto *cache = _catch_up())
+    {
+        return cache->get_samples(samples, timestamp_start, bin_width, num_samples);
+    }
+    return 0;
+}
+
+std::size_t TimeSeriesDerived::get_stats(TSStats *stats,
+                                         double timestamp_start,
+                                         double bin_width,
+                                         std::size_t num_bins) const
+{
+    if (_affine)
+    {
+        const auto count =
+            _affine->series->get_stats(stats, timestamp_start, bin_width, num_bins);
+        const auto scale = _affine->scale;
+        const auto offset = _affine->offset;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto &stat = stats[i];
+
+            // The mean square of the mapped samples follows from the mean square and mean of the
+            // originals, but there's no need for the mean if there's no offset
+            if (offset != 0)
+            {
+                const auto mean_square = scale * scale * stat.rms * stat.rms +
+                                         2 * scale * offset * stat.average + offset * offset;
+                stat.rms = std::sqrt(mean_square < 0 ? 0 : mean_square);
+            }
+            else
+            {
+                stat.rms = std::fabs(scale) * stat.rms;
+            }
+            stat.stddev = std::fabs(scale) * stat.stddev;
+            stat.average = scale * stat.average + offset;
+            stat.min = scale * stat.min + offset;
+            stat.max = scale * stat.max + offset;
+            stat.first = scale * stat.first + offset;
+            stat.last = scale * stat.last + offset;
+            if (scale < 0)
+            {
+                std::swap(stat.min, stat.max);
+            }
+        }
+        return count;
+    }
+
+    if (const auto *cache = _catch_up())
+    {
+        return cache->get_stats(stats, timestamp_start, bin_width, num_bins);
+    }
+    return 0;
+}
+
+TSSample TimeSeriesDerived::get_sample(double timestamp, double bin_width) const
+{
+    TSSample sample;
+    get_samples(&sample, timestamp, bin_width, 1);
+    return sample;
+}
+
+std::pair<double, double> TimeSeriesDerived::get_span() const
+{
+    if (_affine)
+    {
+        return _affine->series->get_span();
+    }
+
+    // Everything which can be evaluated, whether it has been yet or not
+    const auto timebase = _timebase();
+    if (!timebase)
+    {
+        return _inputs.front()->get_span();
+    }
+    const auto [start, interval] = *timebase;
+    return std::make_pair(start, start + _available(*timebase) * interval);
+}
+
+std::size_t TimeSeriesDerived::memory_usage() const
+{
+    const auto *cache = _cache.load(std::memory_order_acquire);
+    return cache ? cache->memory_usage() : 0;
+}
+
+std::size_t TimeSeriesDerived::logical_memory_usage() const
+{
+    const auto *cache = _cache.load(std::memory_order_acquire);
+    return cache ? cache->logical_memory_usage() : 0;
+}
+
+std::size_t TimeSeriesDerived::size() const
+{
+    if (_affine)
+    {
+        return _affine->series->size();
+    }
+    const auto timebase = _timebase();
+    return timebase ? _available(*timebase) : 0;
+}
+
+void TimeSeriesDerived::save(SnapshotWriter &writer) const
+{
+    if (!_affine)
+    {
+        if (const auto *cache = _catch_up())
+        {
+            cache->save(writer);
+            return;
+        }
+    }
+
+    // Affine series are never evaluated for reading, so they're evaluated just for the snapshot
+    const auto timebase = _timebase().value_or(std::make_pair(0.0, 1.0));
+    Cache evaluated(timebase.first, timebase.second, _arena);
+    std::vector<double> held(_inputs.size(), std::nan(""));
+    _evaluate(evaluated, timebase, _available(timebase), held);
+    evaluated.save(writer);
+}
+
+std::optional<double> TimeSeriesDerived::spill_candidate() const
+{
+    const auto *cache = _cache.load(std::memory_order_acquire);
+    return cache ? cache->spill_candidate() : std::nullopt;
+}
+
+std::size_t TimeSeriesDerived::spill(const std::shared_ptr<SpillFile> &file)
+{
+    auto *cache = _cache.load(std::memory_order_acquire);
+    return cache ? cache->spill(file) : 0;
+}
+
+std::size_t TimeSeriesDerived::spilled_bytes() const
+{
+    const auto *cache = _cache.load(std::memory_order_acquire);
+    return cache ? cache->spilled_bytes() : 0;
+}
+
+std::optional<std::pair<double, double>> TimeSeriesDerived::_timebase() const
+{
+    // Once there's a cache its timebase is fixed
+    if (_cache.load(std::memory_order_acquire))
+    {
+        return std::make_pair(_start, _interval);
+    }
+
+    const auto &input = *_inputs.front();
+    const auto size = input.size();
+    if (size == 0)
+    {
+        return std::nullopt;
+    }
+    const auto span = input.get_span();
+    return std::make_pair(span.first, (span.second - span.first) / size);
+}
+
+std::size_t TimeSeriesDerived::_available(const std::pair<double, double> &timebase) const
+{
+    const auto [start, interval] = timebase;
+    if (interval <= 0)
+    {
+        return 0;
+    }
+
+    // A sample can be evaluated once every input has reached the middle of it
+    auto available = std::numeric_limits<std::size_t>::max();
+    for (const auto &input : _inputs)
+    {
+        if (input->size() == 0)
+        {
+            return 0;
+        }
+        const auto end = (input->get_span().second - start) / interval + 0.5;
+        available = std::min(available, static_cast<std::size_t>(std::max(0.0, end)));
+    }
+    return available;
+}
+
+void TimeSeriesDerived::_evaluate(Cache &into,
+                                  const std::pair<double, double> &timebase,
+                                  std::size_t count,
+                                  std::vector<double> &held) const
+{
+    const auto [start, interval] = timebase;
+    std::vector<TSStats> stats(EVALUATE_BATCH);
+    std::vector<std::vector<double>> values(_inputs.size(), std::vector<double>(EVALUATE_BATCH));
+    std::vector<std::vector<double>> stack(_program.size(), std::vector<double>(EVALUATE_BATCH));
+
+    for (auto done = into.size(); done < count;)
+    {
+        const auto batch = std::min(count - done, EVALUATE_BATCH);
+
+        // Offsetting the bins by half an interval keeps rounding from picking the wrong sample
+        const auto batch_start = start + (done + 0.5) * interval;
+        for (std::size_t input = 0; input < _inputs.size(); ++input)
+        {
+            auto &value = values[input];
+            const auto found = _inputs[input]->get_stats(stats.data(), batch_start, interval, batch);
+            std::size_t next = 0;
+            for (std::size_t i = 0; i < found; ++i)
+            {
+                const auto &stat = stats[i];
+                const auto bin = std::llround((stat.timestamp - batch_start) / interval);
+                const auto index = static_cast<std::size_t>(
+                    std::clamp(bin, static_cast<long long>(next), static_cast<long long>(batch - 1)));
+                std::fill(value.begin() + next, value.begin() + index, held[input]);
+                held[input] =
+                    std::isnan(stat.average) ? (stat.min + stat.max) / 2 : stat.average;
+                value[index] = held[input];
+                next = index + 1;
+            }
+            std::fill(value.begin() + next, value.begin() + batch, held[input]);
+        }
+
+        // Run the program over the whole batch one instruction at a time
+        std::size_t depth = 0;
+        const auto unary = [&](auto op) {
+            auto &top = stack[depth - 1];
+            std::transform(top.begin(), top.begin() + batch, top.begin(), op);
+        };
+        const auto binary = [&](auto op) {
+            // Takes the top two values and leaves the result in their place
+            --depth;
+            auto &lhs = stack[depth - 1];
+            std::transform(
+                lhs.begin(), lhs.begin() + batch, stack[depth].begin(), lhs.begin(), op);
+        };
+        for (const auto &instruction : _program)
+        {
+            switch (instruction.op)
+            {
+            case Expression::Op::Series:
+                std::copy_n(values[instruction.input].begin(), batch, stack[depth++].begin());
+                break;
+            case Expression::Op::Constant:
+                std::fill_n(stack[depth++].begin(), batch, instruction.constant);
+                break;
+            case Expression::Op::Add:
+                binary(std::plus<double>());
+                break;
+            case Expression::Op::Subtract:
+                binary(std::minus<double>());
+                break;
+            case Expression::Op::Multiply:
+                binary(std::multiplies<double>());
+                break;
+            case Expression::Op::Divide:
+                binary(std::divides<double>());
+                break;
+            case Expression::Op::Negate:
+                unary(std::negate<double>());
+                break;
+            case Expression::Op::Abs:
+                unary([](double value) { return std::fabs(value); });
+                break;
+            }
+        }
+
+        into.push_samples(stack.front().data(), batch);
+        done += batch;
+    }
+}
+
+const TimeSeriesDerived::Cache *TimeSeriesDerived::_catch_up() const
+{
+    auto *cache = _cache.load(std::memory_order_acquire);
+    if (cache && cache->size() >= _available(std::make_pair(_start, _interval)))
+    {
+        return cache;
+    }
+
+    // Only one reader evaluates, any others wait for it rather than repeating the work
+    std::lock_guard<std::mutex> _(_evaluate_mut);
+    cache = _cache.load(std::memory_order_relaxed);
+    if (!cache)
+    {
+        const auto timebase = _timebase();
+        if (!timebase)
+        {
+            return nullptr;
+        }
+        std::tie(_start, _interval) = *timebase;
+        _held.assign(_inputs.size(), std::nan(""));
+        _cache_storage = std::make_unique<Cache>(_start, _interval, _arena);
+        cache = _cache_storage.get();
+        _cache.store(cache, std::memory_order_release);
+    }
+    const auto timebase = std::make_pair(_start, _interval);
+    _evaluate(*cache, timebase, _available(timebase), _held);
+    return cache;
+}
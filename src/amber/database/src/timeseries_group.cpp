@@ -0,0 +1,245 @@
+#include "timeseries_group.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+using namespace amber::database;
+
+template <typename T> class TimeSeriesGroup<T>::Channel : public TimeSeries
+{
+  public:
+    Channel(std::shared_ptr<TimeSeriesGroup> group, std::size_t index)
+        : _group(std::move(group)), _index(index)
+    {
+    }
+
+    std::size_t get_samples(TSSample *samples,
+                            double timestamp_start,
+                            double bin_width,
+                            std::size_t num_samples) const override
+    {
+        return get_samples_at(published(), samples, timestamp_start, bin_width, num_samples);
+    }
+
+    std::size_t get_samples_at(std::size_t published,
+                               TSSample *samples,
+                               double timestamp_start,
+                               double bin_width,
+                               std::size_t num_samples) const override
+    {
+        const auto size = std::min(published, _group->size());
+        return _group->_get_samples(
+            &samples, _index, 1, size, timestamp_start, bin_width, num_samples);
+    }
+
+    TSSample get_sample(double timestamp, double bin_width) const override
+    {
+        TSSample sample;
+        get_samples(&sample, timestamp, bin_width, 1);
+        return sample;
+    }
+
+    std::pair<double, double> get_span() const override
+    {
+        return _group->get_span();
+    }
+
+    std::pair<double, double> get_span_at(std::size_t published) const override
+    {
+        return _group->_span(std::min(published, _group->size()));
+    }
+
+    std::size_t memory_usage() const override
+    {
+        return _pyramid().memory_usage(_group->size());
+    }
+
+    std::size_t logical_memory_usage() const override
+    {
+        return _pyramid().logical_memory_usage(_group->size());
+    }
+
+    std::size_t size() const override
+    {
+        return _group->size();
+    }
+
+    void save(SnapshotWriter &writer) const override
+    {
+        save_at(writer, published());
+    }
+
+    std::size_t published() const override
+    {
+        return _group->size();
+    }
+
+    void save_at(SnapshotWriter &writer, std::size_t published) const override
+    {
+        // Laid out exactly like a TimeSeriesDense, which is what it loads back as
+        writer.write(SnapshotSeriesType::Dense);
+        writer.write(snapshot_sample_type<T>());
+        writer.write(DefaultAggregates::id);
+        writer.write(_group->_start);
+        writer.write(_group->_interval);
+        _pyramid().save(writer, 0, std::min(published, _group->size()));
+    }
+
+    std::optional<double> spill_candidate() const override
+    {
+        if (const auto chunk = _pyramid().spill_candidate())
+        {
+            const auto index = static_cast<double>(*chunk * Pyramid<T>::CHUNK_SIZE);
+            return _group->_start + index * _group->_interval;
+        }
+        return std::nullopt;
+    }
+
+    std::size_t spill(const std::shared_ptr<SpillFile> &file) override
+    {
+        return _pyramid().spill(file);
+    }
+
+    std::size_t spilled_bytes() const override
+    {
+        return _pyramid().spilled_bytes();
+    }
+
+  private:
+    Pyramid<T> &_pyramid() const
+    {
+        return *_group->_channels[_index];
+    }
+
+    std::shared_ptr<TimeSeriesGroup> _group;
+    std::size_t _index;
+};
+
+template <typename T>
+TimeSeriesGroup<T>::TimeSeriesGroup(std::size_t num_channels,
+                                    double start,
+                                    double interval,
+                                    std::shared_ptr<ChunkArena> arena)
+    : _interval(interval), _start(start), _size(0)
+{
+    _channels.reserve(num_channels);
+    for (std::size_t i = 0; i < num_channels; ++i)
+    {
+        _channels.push_back(std::make_unique<Pyramid<T>>(arena));
+    }
+}
+
+template <typename T>
+std::size_t TimeSeriesGroup<T>::get_samples(TSSample *const *samples,
+                                            double timestamp_start,
+                                            double bin_width,
+                                            std::size_t num_bins) const
+{
+    const auto size = _size.load(std::memory_order_acquire);
+    return _get_samples(samples, 0, _channels.size(), size, timestamp_start, bin_width, num_bins);
+}
+
+template <typename T>
+std::size_t TimeSeriesGroup<T>::_get_samples(TSSample *const *samples,
+                                             std::size_t first_channel,
+                                             std::size_t num_channels,
+                                             std::size_t size,
+                                             double timestamp_start,
+                                             double bin_width,
+                                             std::size_t num_bins) const
+{
+    // Every channel is read up to the same size, so they all end up with the same bins
+    const auto span = _span(size);
+
+    std::vector<double> timestamps;
+    std::vector<std::pair<std::size_t, std::size_t>> ranges;
+    timestamps.reserve(num_bins);
+    ranges.reserve(num_bins);
+    for (std::size_t bin_index = 0; bin_index < num_bins; ++bin_index)
+    {
+        const auto bin_start = timestamp_start + bin_width * bin_index;
+        const auto bin_end = timestamp_start + bin_width * (bin_index + 1);
+        if (size == 0 || bin_end < span.first || bin_start > span.second)
+        {
+            continue;
+        }
+
+        auto index_first = static_cast<long long>((bin_start - span.first) / _interval);
+        index_first = std::max(index_first, static_cast<long long>(0));
+        auto index_last = static_cast<long long>((bin_end - span.first) / _interval);
+        index_last = std::min(index_last, static_cast<long long>(size));
+        if (index_first >= static_cast<long long>(size))
+        {
+            continue;
+        }
+        timestamps.push_back(bin_start);
+        ranges.emplace_back(index_first, index_last);
+    }
+
+    // Now the ranges are known, every channel is reduced over them in one batch
+    std::vector<DataStore<T, DefaultAggregates>> results(ranges.size());
+    for (std::size_t channel = 0; channel < num_channels; ++channel)
+    {
+        const auto &pyramid = *_channels[first_channel + channel];
+        pyramid.reduce(ranges.data(), ranges.size(), size, results.data());
+        for (std::size_t i = 0; i < ranges.size(); ++i)
+        {
+            const auto [first, last] = ranges[i];
+            auto &sample = samples[channel][i];
+            sample.timestamp = timestamps[i];
+            if (first == last)
+            {
+                sample.average = sample.min = sample.max = pyramid[first];
+            }
+            else
+            {
+                sample.average = static_cast<double>(results[i].sum) / (last - first);
+                sample.min = results[i].min;
+                sample.max = results[i].max;
+            }
+        }
+    }
+    return ranges.size();
+}
+
+template <typename T> std::pair<double, double> TimeSeriesGroup<T>::get_span() const
+{
+    return _span(_size.load(std::memory_order_acquire));
+}
+
+template <typename T> std::pair<double, double> TimeSeriesGroup<T>::_span(std::size_t size) const
+{
+    return std::make_pair(_start, _start + (size * _interval));
+}
+
+template <typename T> std::size_t TimeSeriesGroup<T>::size() const
+{
+    return _size.load(std::memory_order_acquire);
+}
+
+template <typename T> std::size_t TimeSeriesGroup<T>::memory_usage() const
+{
+    const auto size = _size.load(std::memory_order_acquire);
+    std::size_t total = 0;
+    for (const auto &pyramid : _channels)
+    {
+        total += pyramid->memory_usage(size);
+    }
+    return total;
+}
+
+template <typename T> std::shared_ptr<TimeSeries> TimeSeriesGroup<T>::channel(std::size_t index)
+{
+    if (index >= _channels.size())
+    {
+        throw std::out_of_range("No such channel");
+    }
+    return std::make_shared<Channel>(this->shared_from_this(), index);
+}
+
+template class amber::database::TimeSeriesGroup<double>;
+template class amber::database::TimeSeriesGroup<float>;
+template class amber::database::TimeSeriesGroup<std::int16_t>;
+template class amber::database::TimeSeriesGroup<std::int32_t>;
@@ -0,0 +1,283 @@
+#include "timeseries_sparse.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+using namespace amber::database;
+
+TimeSeriesSparse::TimeSeriesSparse(double resolution, std::shared_ptr<ChunkArena> arena)
+    : _resolution(resolution), _values(arena), _offsets(arena), _chunks(std::move(arena)), _size(0),
+      _published_chunks(0)
+{
+}
+
+std::size_t TimeSeriesSparse::get_samples(TSSample *samples,
+                                          double timestamp_start,
+                                          double bin_width,
+                                          std::size_t num_bins) const
+{
+    return get_samples_at(published(), samples, timestamp_start, bin_width, num_bins);
+}
+
+std::size_t TimeSeriesSparse::get_samples_at(std::size_t published,
+                                             TSSample *samples,
+                                             double timestamp_start,
+                                             double bin_width,
+                                             std::size_t num_bins) const
+{
+    // Take a snapshot of the number of committed samples, anything below this is fully written
+    const auto size = std::min(published, _size.load(std::memory_order_acquire));
+    if (size == 0)
+    {
+        return 0;
+    }
+    const auto num_chunks = _num_chunks(size);
+
+    // Keep track of which sample we are writing to
+    auto *current_sample = samples;
+
+    // Bins share edges, so the end of one bin is the start of the next
+    const auto edge = [&](std::size_t bin_index) {
+        const auto timestamp = timestamp_start + bin_width * bin_index;
+        return _lower_bound(
+            static_cast<std::int64_t>(std::ceil(timestamp / _resolution)), size, num_chunks);
+    };
+
+    auto index_first = edge(0);
+    for (std::size_t bin_index = 0; bin_index < num_bins; ++bin_index)
+    {
+        const auto index_last = edge(bin_index + 1);
+        if (index_first != index_last)
+        {
+            const auto results = _values.reduce(index_first, index_last, size);
+            current_sample->timestamp = timestamp_start + bin_width * bin_index;
+            current_sample->average = results.sum / (index_last - index_first);
+            current_sample->min = results.min;
+            current_sample->max = results.max;
+            ++current_sample;
+        }
+        index_first = index_last;
+    }
+
+    const auto count = current_sample - samples;
+    return count;
+}
+
+TSSample TimeSeriesSparse::get_sample(double timestamp, double bin_width) const
+{
+    TSSample sample;
+    get_samples(&sample, timestamp, bin_width, 1);
+    return sample;
+}
+
+std::pair<double, double> TimeSeriesSparse::get_span() const
+{
+    return get_span_at(published());
+}
+
+std::pair<double, double> TimeSeriesSparse::get_span_at(std::size_t published) const
+{
+    const auto size = std::min(published, _size.load(std::memory_order_acquire));
+    if (size == 0)
+    {
+        return std::make_pair(0.0, 0.0);
+    }
+
+    const auto num_chunks = _num_chunks(size);
+    const auto first = _chunks[0].first_tick * _resolution;
+    const auto last = _tick(size - 1, num_chunks - 1) * _resolution;
+    return std::make_pair(first, last);
+}
+
+std::size_t TimeSeriesSparse::memory_usage() const
+{
+    const auto size = _size.load(std::memory_order_acquire);
+    return _values.memory_usage(size) + _timestamp_memory_usage(size);
+}
+
+std::size_t TimeSeriesSparse::logical_memory_usage() const
+{
+    const auto size = _size.load(std::memory_order_acquire);
+    return _values.logical_memory_usage(size) + _timestamp_memory_usage(size);
+}
+
+std::size_t TimeSeriesSparse::_timestamp_memory_usage(std::size_t size) const
+{
+    const auto num_chunks = _num_chunks(size);
+    const auto offset_chunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    const auto index_chunks = (num_chunks + INDEX_CHUNK_SIZE - 1) / INDEX_CHUNK_SIZE;
+    return sizeof(_offsets) + offset_chunks * CHUNK_SIZE * sizeof(std::uint32_t) + sizeof(_chunks) +
+           index_chunks * INDEX_CHUNK_SIZE * sizeof(TimeChunk);
+}
+
+std::size_t TimeSeriesSparse::size() const
+{
+    return _size.load(std::memory_order_acquire);
+}
+
+std::size_t TimeSeriesSparse::published() const
+{
+    return _size.load(std::memory_order_acquire);
+}
+
+void TimeSeriesSparse::save(SnapshotWriter &writer) const
+{
+    save_at(writer, published());
+}
+
+void TimeSeriesSparse::save_at(SnapshotWriter &writer, std::size_t published) const
+{
+    const auto size = std::min(published, _size.load(std::memory_order_acquire));
+    writer.write(SnapshotSeriesType::Sparse);
+    writer.write(_resolution);
+    writer.write(_chunks, _num_chunks(size));
+    writer.write(_offsets, size);
+    _values.save(writer, 0, size);
+}
+
+std::shared_ptr<TimeSeriesSparse> TimeSeriesSparse::load(SnapshotReader &reader,
+                                                         std::shared_ptr<ChunkArena> arena)
+{
+    auto ts = std::make_shared<TimeSeriesSparse>(reader.read<double>(), std::move(arena));
+    reader.read(ts->_chunks);
+    reader.read(ts->_offsets);
+    ts->_values.load(reader);
+    if (ts->_values.size() != ts->_offsets.size() ||
+        ts->_chunks.empty() != ts->_offsets.empty())
+    {
+        throw std::runtime_error("Snapshot timestamps don't match its samples");
+    }
+
+    ts->_published_chunks.store(ts->_chunks.size(), std::memory_order_release);
+    ts->_size.store(ts->_offsets.size(), std::memory_order_release);
+    return ts;
+}
+
+void TimeSeriesSparse::push_sample(double timestamp, double value)
+{
+    push_samples(&timestamp, &value, 1);
+}
+
+void TimeSeriesSparse::push_samples(const double *timestamps,
+                                    const double *values,
+                                    std::size_t count)
+{
+    std::lock_guard<std::mutex> _(_write_mut);
+
+    // Check the ordering up front so a bad batch doesn't leave us half written
+    auto previous = _offsets.empty() ? std::numeric_limits<std::int64_t>::min()
+                                     : _tick(_offsets.size() - 1, _chunks.size() - 1);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto tick = _to_tick(timestamps[i]);
+        if (tick < previous)
+        {
+            throw std::invalid_argument("Timestamps must not go backwards");
+        }
+        previous = tick;
+    }
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        _append(_to_tick(timestamps[i]));
+    }
+    _values.push(values, count);
+
+    // Publish the chunks before the samples which live in them
+    _published_chunks.store(_chunks.size(), std::memory_order_release);
+    _size.store(_offsets.size(), std::memory_order_release);
+}
+
+std::int64_t TimeSeriesSparse::_to_tick(double timestamp) const
+{
+    return std::llround(timestamp / _resolution);
+}
+
+std::int64_t TimeSeriesSparse::_tick(std::size_t index, std::size_t chunk) const
+{
+    return _chunks[chunk].first_tick + _offsets[index];
+}
+
+std::size_t TimeSeriesSparse::_num_chunks(std::size_t size) const
+{
+    // The writer might have published a chunk which starts after the samples we can see, ignore it
+    auto num_chunks = _published_chunks.load(std::memory_order_acquire);
+    while (num_chunks > 0 && _chunks[num_chunks - 1].first_index >= size)
+    {
+        --num_chunks;
+    }
+    return num_chunks;
+}
+
+std::size_t TimeSeriesSparse::_chunk_end(std::size_t chunk,
+                                         std::size_t size,
+                                         std::size_t num_chunks) const
+{
+    return (chunk + 1 < num_chunks) ? _chunks[chunk + 1].first_index : size;
+}
+
+/**
+ * @brief Find the index of the first sample whose timestamp is at or after a given tick.
+ *
+ * @return The index of the sample, or size if there is no such sample.
+ */
+std::size_t TimeSeriesSparse::_lower_bound(std::int64_t tick,
+                                           std::size_t size,
+                                           std::size_t num_chunks) const
+{
+    // Find the first chunk which starts at or after the tick
+    std::size_t lo = 0;
+    std::size_t hi = num_chunks;
+    while (lo < hi)
+    {
+        const auto mid = lo + (hi - lo) / 2;
+        if (_chunks[mid].first_tick < tick)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    if (lo == 0)
+    {
+        return 0;
+    }
+
+    // The sample we're after could still be in the tail of the chunk before that one
+    const auto chunk = lo - 1;
+    const auto offset = tick - _chunks[chunk].first_tick;
+    std::size_t first = _chunks[chunk].first_index;
+    std::size_t last = _chunk_end(chunk, size, num_chunks);
+    while (first < last)
+    {
+        const auto mid = first + (last - first) / 2;
+        if (_offsets[mid] < offset)
+        {
+            first = mid + 1;
+        }
+        else
+        {
+            last = mid;
+        }
+    }
+    return first;
+}
+
+void TimeSeriesSparse::_append(std::int64_t tick)
+{
+    const auto index = _offsets.size();
+    const bool start_new_chunk = _chunks.empty() ||
+                                 index - _chunks.back().first_index >= TIME_CHUNK_SIZE ||
+                                 tick - _chunks.back().first_tick >
+                                     std::numeric_limits<std::uint32_t>::max();
+    if (start_new_chunk)
+    {
+        _chunks.push_back(TimeChunk{tick, index});
+    }
+    _offsets.push_back(static_cast<std::uint32_t>(tick - _chunks.back().first_tick));
+}
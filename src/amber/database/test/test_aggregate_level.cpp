@@ -0,0 +1,128 @@
+#include <database/aggregate_level.hpp>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace amber::database;
+
+namespace
+{
+template <typename T, typename Set> DataStore<T, Set> single(T value)
+{
+    DataStore<T, Set> result{};
+    result.min = value;
+    result.max = value;
+    if constexpr (Set::sum)
+    {
+        result.sum = value;
+    }
+    if constexpr (Set::sum_squares)
+    {
+        result.sum_squares = double(value) * value;
+    }
+    if constexpr (Set::first_last)
+    {
+        result.first = value;
+        result.last = value;
+    }
+    return result;
+}
+} // namespace
+
+TEST(AggregateLevel, GathersWhatWasScattered)
+{
+    AggregateLevel<std::int16_t, OhlcAggregates, 64> level;
+    std::vector<DataStore<std::int16_t, OhlcAggregates>> values;
+    for (int i = 0; i < 1000; ++i)
+    {
+        values.push_back(single<std::int16_t, OhlcAggregates>(std::int16_t((i * 37) % 201 - 100)));
+    }
+    level.push(values.data(), 300);
+    level.push(values.data() + 300, values.size() - 300);
+    ASSERT_EQ(level.size(), values.size());
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+        const auto value = level[i];
+        ASSERT_EQ(value.min, values[i].min);
+        ASSERT_EQ(value.sum, values[i].sum);
+        ASSERT_EQ(value.last, values[i].last);
+    }
+
+    // Each aggregate lives in its own array, without padding in between
+    ASSERT_EQ((AggregateLevel<std::int16_t, DefaultAggregates, 64>::ELEMENT_SIZE), 12);
+    ASSERT_EQ((AggregateLevel<float, EnvelopeAggregates, 64>::ELEMENT_SIZE), 8);
+}
+
+TEST(AggregateLevel, CombinesAcrossChunks)
+{
+    typedef DataStore<double, MomentAggregates> Store;
+    AggregateLevel<double, MomentAggregates, 64> level;
+    std::vector<Store> values;
+    for (int i = 0; i < 500; ++i)
+    {
+        values.push_back(single<double, MomentAggregates>((i * 13) % 97 - 40.5));
+    }
+    level.push(values.data(), values.size());
+
+    for (const auto &[begin, end] : {std::pair<std::size_t, std::size_t>{0, 1},
+                                     {0, 500},
+                                     {63, 65},
+                                     {10, 300},
+                                     {128, 192}})
+    {
+        const auto result = level.combine(begin, end);
+        double min = values[begin].min, max = values[begin].max, sum = 0.0, sum_squares = 0.0;
+        for (auto i = begin; i < end; ++i)
+        {
+            min = std::min(min, values[i].min);
+            max = std::max(max, values[i].max);
+            sum += values[i].sum;
+            sum_squares += values[i].sum_squares;
+        }
+        ASSERT_EQ(result.min, min);
+        ASSERT_EQ(result.max, max);
+        ASSERT_DOUBLE_EQ(result.sum, sum);
+        ASSERT_DOUBLE_EQ(result.sum_squares, sum_squares);
+
+        // Only the columns asked for are scanned, the rest are left at zero
+        const auto envelope = level.combine<EnvelopeAggregates>(begin, end);
+        ASSERT_EQ(envelope.min, min);
+        ASSERT_EQ(envelope.max, max);
+        ASSERT_EQ(envelope.sum, 0.0);
+        ASSERT_EQ(envelope.sum_squares, 0.0);
+        const auto samples = level.combine<SampleAggregates<MomentAggregates>>(begin, end);
+        ASSERT_EQ(samples.sum, result.sum);
+        ASSERT_EQ(samples.sum_squares, 0.0);
+    }
+}
+
+TEST(AggregateLevel, PushCombined)
+{
+    AggregateLevel<int, OhlcAggregates, 64> below;
+    AggregateLevel<int, OhlcAggregates, 64> above;
+    std::vector<DataStore<int, OhlcAggregates>> values;
+    for (int i = 0; i < 1000; ++i)
+    {
+        values.push_back(single<int, OhlcAggregates>((i * 7919) % 1000));
+    }
+
+    // Elements of the level above only appear once all of their run has
+    for (std::size_t pushed = 0; pushed < values.size(); pushed += 77)
+    {
+        const auto count = std::min<std::size_t>(77, values.size() - pushed);
+        below.push(values.data() + pushed, count);
+        above.push_combined(below, 2);
+        ASSERT_EQ(above.size(), (pushed + count) / 4);
+    }
+    for (std::size_t i = 0; i < above.size(); ++i)
+    {
+        const auto expected = below.combine(i * 4, i * 4 + 4);
+        const auto value = above[i];
+        ASSERT_EQ(value.min, expected.min);
+        ASSERT_EQ(value.max, expected.max);
+        ASSERT_EQ(value.sum, expected.sum);
+        ASSERT_EQ(value.first, expected.first);
+        ASSERT_EQ(value.last, expected.last);
+    }
+}
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <numeric>
+#include <vector>
+#include <database/bin_cache.hpp>
+#include <database/timeseries_dense.hpp>
+#include <database/timeseries_sparse.hpp>
+
+using namespace amber::database;
+
+namespace
+{
+// What the timeseries gives when asked for each grid bin in turn
+std::vector<TSSample> uncached(const TimeSeries &ts, double start, double width, std::size_t bins)
+{
+    std::vector<TSSample> samples;
+    const auto first = static_cast<long long>(std::floor(start / width));
+    for (std::size_t i = 0; i < bins; ++i)
+    {
+        TSSample sample;
+        if (ts.get_samples(&sample, (first + static_cast<long long>(i)) * width, width, 1))
+        {
+            samples.push_back(sample);
+        }
+    }
+    return samples;
+}
+
+void expect_same(const std::vector<TSSample> &expected, const std::vector<TSSample> &actual)
+{
+    ASSERT_EQ(expected.size(), actual.size());
+    for (std::size_t i = 0; i < expected.size(); ++i)
+    {
+        EXPECT_FLOAT_EQ(expected[i].timestamp, actual[i].timestamp);
+        EXPECT_FLOAT_EQ(expected[i].average, actual[i].average);
+        EXPECT_FLOAT_EQ(expected[i].min, actual[i].min);
+        EXPECT_FLOAT_EQ(expected[i].max, actual[i].max);
+    }
+}
+
+std::vector<TSSample> cached(BinCache &cache,
+                             const TimeSeries &ts,
+                             double start,
+                             double width,
+                             std::size_t bins)
+{
+    std::vector<TSSample> samples(bins);
+    samples.resize(cache.get_samples(ts, samples.data(), start, width, bins));
+    return samples;
+}
+} // namespace
+
+TEST(BinCache, MatchesTimeSeries)
+{
+    std::vector<double> data(10000);
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = std::sin(i * 0.01);
+    }
+    TimeSeriesDense ts(0.0, 1.0, data);
+
+    BinCache cache;
+    expect_same(uncached(ts, -123.4, 7.5, 1500), cached(cache, ts, -123.4, 7.5, 1500));
+
+    // Again, this time from the cache
+    expect_same(uncached(ts, -123.4, 7.5, 1500), cached(cache, ts, -123.4, 7.5, 1500));
+    EXPECT_GT(cache.hits(), 0);
+}
+
+TEST(BinCache, PanningOnlyFetchesNewBins)
+{
+    std::vector<double> data(100000, 1.0);
+    TimeSeriesDense ts(0.0, 1.0, data);
+
+    BinCache cache;
+    const double width = 10.0;
+    const std::size_t bins = 4096;
+    cached(cache, ts, 0.0, width, bins);
+    ASSERT_EQ(cache.misses(), bins);
+
+    // Pan right by three bins at a time, with a little noise in the width
+    for (int frame = 1; frame <= 100; ++frame)
+    {
+        const auto misses = cache.misses();
+        const auto start = frame * 3 * width + 0.5;
+        const auto samples = cached(cache, ts, start, width * (1.0 + 1e-12), bins);
+        expect_same(uncached(ts, start, width, bins), samples);
+        EXPECT_EQ(cache.misses() - misses, 3);
+    }
+}
+
+TEST(BinCache, ChangingWidthStartsAgain)
+{
+    std::vector<double> data(1000, 1.0);
+    TimeSeriesDense ts(0.0, 1.0, data);
+
+    BinCache cache;
+    cached(cache, ts, 0.0, 1.0, 100);
+    cached(cache, ts, 0.0, 2.0, 100);
+    EXPECT_EQ(cache.hits(), 0);
+    EXPECT_EQ(cache.misses(), 200);
+}
+
+TEST(BinCache, BinsAtTheEndFollowNewData)
+{
+    TimeSeriesDense ts(0.0, 1.0);
+    BinCache cache;
+
+    // The latest bins have to be fetched every time, as they keep changing
+    for (int i = 0; i < 100; ++i)
+    {
+        ts.push_sample(i);
+        expect_same(uncached(ts, 0.0, 4.0, 50), cached(cache, ts, 0.0, 4.0, 50));
+    }
+}
+
+TEST(BinCache, DroppedSamplesAreFetchedAgain)
+{
+    TimeSeriesDense ts(0.0, 1.0);
+    ts.set_retention(20'000.0);
+    BinCache cache;
+
+    // Bins which were complete have to be fetched again once their oldest samples are dropped
+    std::vector<double> values(5000);
+    for (int i = 0; i < 40; ++i)
+    {
+        std::iota(values.begin(), values.end(), i * 5000.0);
+        ts.push_samples(values.data(), values.size());
+        expect_same(uncached(ts, 0.0, 1000.0, 250), cached(cache, ts, 0.0, 1000.0, 250));
+    }
+}
+
+TEST(BinCache, SparseSeries)
+{
+    TimeSeriesSparse ts;
+    BinCache cache;
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        ts.push_sample(i * 0.37, i % 7);
+        if (i % 10 == 0)
+        {
+            expect_same(uncached(ts, 0.0, 1.5, 300), cached(cache, ts, 0.0, 1.5, 300));
+        }
+    }
+    EXPECT_GT(cache.hits(), 0);
+}
@@ -0,0 +1,71 @@
+#include <cstdint>
+#include <database/chunk_arena.hpp>
+#include <database/chunked_vector.hpp>
+#include <gtest/gtest.h>
+
+using namespace amber::database;
+
+TEST(ChunkArena, SharesRegions)
+{
+    ChunkArena arena;
+    auto a = arena.allocate(128 * 1024);
+    auto b = arena.allocate(128 * 1024);
+    ASSERT_EQ(arena.reserved_bytes(), ChunkArena::REGION_SIZE);
+    ASSERT_EQ(arena.allocated_bytes(), 256 * 1024);
+
+    // Chunks are handed out one after the other from an aligned region
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(a) % ChunkArena::REGION_SIZE, 0);
+    ASSERT_EQ(static_cast<char *>(b) - static_cast<char *>(a), 128 * 1024);
+
+    arena.deallocate(a, 128 * 1024);
+    arena.deallocate(b, 128 * 1024);
+    ASSERT_EQ(arena.allocated_bytes(), 0);
+    ASSERT_EQ(arena.reserved_bytes(), ChunkArena::REGION_SIZE);
+}
+
+TEST(ChunkArena, RecyclesChunks)
+{
+    ChunkArena arena;
+    auto a = arena.allocate(1000);
+    arena.deallocate(a, 1000);
+    ASSERT_EQ(arena.allocate(1000), a);
+
+    // Chunks of a different size don't get it
+    auto b = arena.allocate(2000);
+    arena.deallocate(b, 2000);
+    ASSERT_NE(arena.allocate(1000), b);
+}
+
+TEST(ChunkArena, LargeChunks)
+{
+    ChunkArena arena;
+    const auto size = ChunkArena::REGION_SIZE + 1;
+    auto chunk = static_cast<char *>(arena.allocate(size));
+    chunk[0] = 1;
+    chunk[size - 1] = 2;
+    ASSERT_GE(arena.reserved_bytes(), size);
+
+    // These go straight back to the OS
+    arena.deallocate(chunk, size);
+    ASSERT_EQ(arena.reserved_bytes(), 0);
+    ASSERT_EQ(arena.allocated_bytes(), 0);
+}
+
+TEST(ChunkArena, ChunkedVector)
+{
+    auto arena = std::make_shared<ChunkArena>();
+    {
+        ChunkedVector<double, 1024> data(arena);
+        for (int i = 0; i < 10000; i++)
+        {
+            data.push(i);
+        }
+        ASSERT_EQ(arena->allocated_bytes(), 10 * 1024 * sizeof(double));
+
+        // Released chunks go back to the arena once the caller is done with them
+        data.release(0);
+        ASSERT_EQ(arena->allocated_bytes(), 9 * 1024 * sizeof(double));
+        ASSERT_EQ(data.at(9999), 9999);
+    }
+    ASSERT_EQ(arena->allocated_bytes(), 0);
+}
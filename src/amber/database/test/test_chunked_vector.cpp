@@ -1,5 +1,8 @@
 #include <database/chunked_vector.hpp>
 #include <gtest/gtest.h>
+#include <numeric>
+#include <thread>
+#include <vector>
 
 using namespace amber::database;
 
@@ -61,3 +64,165 @@ TEST(ChunkedVector, checkCapacity)
     }
     ASSERT_EQ(data.capacity(), 2048);
 }
+
+TEST(ChunkedVector, pushRun)
+{
+    std::vector<int> values(3000);
+    for (int i = 0; i < 3000; i++)
+    {
+        values[i] = i;
+    }
+
+    ChunkedVector<int, 1024> data;
+    data.push(1234);
+    data.push(values.data(), values.size());
+    ASSERT_EQ(data.size(), 3001);
+    ASSERT_EQ(data.capacity(), 3072);
+    ASSERT_EQ(data[0], 1234);
+    for (int i = 0; i < 3000; i++)
+    {
+        ASSERT_EQ(data[i + 1], i);
+    }
+}
+
+TEST(ChunkedVector, resize)
+{
+    ChunkedVector<int, 1024> data;
+    data.resize(2500);
+    ASSERT_EQ(data.size(), 2500);
+    ASSERT_EQ(data.capacity(), 3072);
+
+    for (int i = 0; i < 2500; i++)
+    {
+        data[i] = i;
+    }
+    data.push(2500);
+    for (int i = 0; i <= 2500; i++)
+    {
+        ASSERT_EQ(data.at(i), i);
+    }
+}
+
+TEST(ChunkedVector, adopt)
+{
+    std::vector<int> values(2500);
+    std::iota(values.begin(), values.end(), 0);
+    const int *buffer = values.data();
+
+    ChunkedVector<int, 1024> data;
+    data.adopt(std::move(values));
+    ASSERT_EQ(data.size(), 2500);
+
+    // Whole chunks use the adopted buffer, the remainder is copied
+    ASSERT_EQ(&data[0], buffer);
+    ASSERT_EQ(&data[2047], buffer + 2047);
+
+    data.push(2500);
+    for (int i = 0; i <= 2500; i++)
+    {
+        ASSERT_EQ(data.at(i), i);
+    }
+
+    ASSERT_THROW(data.adopt(std::vector<int>(10)), std::logic_error);
+}
+
+TEST(ChunkedVector, window)
+{
+    const auto arena = std::make_shared<ChunkArena>();
+    ChunkedVector<int, 1024> data(arena);
+    data.set_window(3000);
+
+    // Once the window is full, trimmed chunks are reused rather than allocating new ones
+    std::size_t allocated = 0;
+    for (int i = 0; i < 100'000; i++)
+    {
+        data.push(i);
+        data.trim(data.size() - std::min<std::size_t>(data.size(), 3000));
+        if (i == 10'000)
+        {
+            allocated = arena->allocated_bytes();
+        }
+    }
+    ASSERT_EQ(arena->allocated_bytes(), allocated);
+    for (int i = 100'000 - 3000; i < 100'000; i++)
+    {
+        ASSERT_EQ(data[i], i);
+    }
+
+    // Without trimming, the ring grows rather than filling up, and nothing is lost
+    ChunkedVector<int, 1024> untrimmed(arena);
+    untrimmed.set_window(3000);
+    std::vector<int> values(10'000);
+    std::iota(values.begin(), values.end(), 0);
+    untrimmed.push(values.data(), values.size());
+    for (int i = 0; i < 10'000; i++)
+    {
+        ASSERT_EQ(untrimmed[i], i);
+    }
+    untrimmed.trim(9000);
+    untrimmed.push(values.data(), values.size());
+    ASSERT_EQ(untrimmed[9500], 9500);
+    ASSERT_EQ(untrimmed[19'999], 9999);
+    ASSERT_THROW(untrimmed.set_window(3000), std::logic_error);
+}
+
+TEST(ChunkedVector, spans)
+{
+    ChunkedVector<int, 1024> data;
+    for (int i = 0; i < 5000; i++)
+    {
+        data.push(i);
+    }
+
+    // Spans start and stop at chunk boundaries, apart from at the ends of the range
+    std::vector<std::size_t> sizes;
+    int expected = 1000;
+    for (const auto span : data.spans(1000, 4500))
+    {
+        sizes.push_back(span.size());
+        for (auto value : span)
+        {
+            ASSERT_EQ(value, expected++);
+        }
+    }
+    ASSERT_EQ(expected, 4500);
+    ASSERT_EQ(sizes, (std::vector<std::size_t>{24, 1024, 1024, 1024, 404}));
+
+    const auto empty = data.spans(100, 100);
+    ASSERT_FALSE(empty.begin() != empty.end());
+
+    // Spans of a non-const vector can be written through
+    data.resize(6000);
+    for (auto span : data.spans(5000, 6000))
+    {
+        std::iota(span.begin(), span.end(), 0);
+    }
+    ASSERT_EQ(data.at(5119), 119);
+    ASSERT_EQ(data.at(5999), 879);
+}
+
+TEST(ChunkedVector, readWhilePushing)
+{
+    ChunkedVector<std::size_t, 64> data;
+    std::thread writer([&data]() {
+        for (std::size_t i = 0; i < 100000; i++)
+        {
+            data.push(i);
+        }
+    });
+
+    // Everything below the published size must already have been written
+    std::size_t checked = 0;
+    while (checked < 100000)
+    {
+        const auto size = data.size();
+        for (const auto span : data.spans(checked, size))
+        {
+            for (auto value : span)
+            {
+                ASSERT_EQ(value, checked++);
+            }
+        }
+    }
+    writer.join();
+}
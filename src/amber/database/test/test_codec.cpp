@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+#include "codec.hpp"
+
+using namespace amber::database;
+
+namespace
+{
+template <typename T> void expect_round_trip(const std::vector<T> &values)
+{
+    std::vector<std::uint8_t> encoded;
+    codec::encode(values.data(), values.size(), encoded);
+
+    std::vector<T> decoded(values.size());
+    codec::decode(encoded.data(), decoded.size(), decoded.data());
+
+    // Compare bits, so NaNs and negative zeros have to come back exactly
+    ASSERT_EQ(std::memcmp(values.data(), decoded.data(), values.size() * sizeof(T)), 0);
+}
+
+template <typename T> std::vector<T> random_walk(std::size_t count, double step)
+{
+    std::mt19937 rng(99);
+    std::normal_distribution<double> dist(0.0, step);
+    std::vector<T> values(count);
+    double value = 0;
+    for (auto &v : values)
+    {
+        value += dist(rng);
+        v = static_cast<T>(value);
+    }
+    return values;
+}
+} // namespace
+
+TEST(Codec, Doubles)
+{
+    expect_round_trip(random_walk<double>(10000, 1.0));
+    expect_round_trip(std::vector<double>{1.0});
+    expect_round_trip(std::vector<double>{0.0,
+                                          -0.0,
+                                          std::numeric_limits<double>::quiet_NaN(),
+                                          std::numeric_limits<double>::infinity(),
+                                          -std::numeric_limits<double>::infinity(),
+                                          std::numeric_limits<double>::denorm_min(),
+                                          std::numeric_limits<double>::max(),
+                                          std::numeric_limits<double>::lowest(),
+                                          1.0,
+                                          1.0,
+                                          2.0});
+}
+
+TEST(Codec, Floats)
+{
+    expect_round_trip(random_walk<float>(10000, 1.0));
+    expect_round_trip(std::vector<float>{0.0f,
+                                         -0.0f,
+                                         std::numeric_limits<float>::quiet_NaN(),
+                                         std::numeric_limits<float>::infinity(),
+                                         std::numeric_limits<float>::max(),
+                                         std::numeric_limits<float>::lowest()});
+}
+
+TEST(Codec, Integers)
+{
+    expect_round_trip(random_walk<std::int16_t>(10000, 20.0));
+    expect_round_trip(random_walk<std::int32_t>(10000, 1e5));
+    expect_round_trip(std::vector<std::int16_t>{-32768, 32767, -32768, 0, 0, 1, -1});
+    expect_round_trip(std::vector<std::int32_t>{std::numeric_limits<std::int32_t>::min(),
+                                                std::numeric_limits<std::int32_t>::max(),
+                                                0,
+                                                std::numeric_limits<std::int32_t>::min()});
+}
+
+TEST(Codec, SlowSignalsCompressWell)
+{
+    // A slowly varying 16-bit ADC reading
+    std::vector<std::int16_t> adc(4096);
+    for (std::size_t i = 0; i < adc.size(); ++i)
+    {
+        adc[i] = static_cast<std::int16_t>(1000 * std::sin(i * 0.001));
+    }
+    std::vector<std::uint8_t> encoded;
+    codec::encode(adc.data(), adc.size(), encoded);
+    EXPECT_LT(encoded.size() * 3, adc.size() * sizeof(std::int16_t));
+
+    // A sensor which only reports to a couple of decimal places
+    std::vector<double> sensor(4096);
+    for (std::size_t i = 0; i < sensor.size(); ++i)
+    {
+        sensor[i] = std::round(20 + 5 * std::sin(i * 0.0005)) / 4;
+    }
+    encoded.clear();
+    codec::encode(sensor.data(), sensor.size(), encoded);
+    EXPECT_LT(encoded.size() * 10, sensor.size() * sizeof(double));
+}
@@ -1,13 +1,19 @@
 #include <database/database.hpp>
 #include <database/timeseries_dense.hpp>
+#include <database/timeseries_group.hpp>
+#include <database/timeseries_sparse.hpp>
 #include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
 
 using namespace amber::database;
 
 TEST(Database, putAndGetTimeseries)
 {
     Database db;
-    db.register_timeseries("a", std::make_shared<TimeSeriesDense>(0.0, 1.0));
+    db.register_timeseries("a", std::make_shared<TimeSeriesDense<>>(0.0, 1.0));
     ASSERT_EQ(db.data().size(), 1);
     db.data().at("a");
 }
@@ -15,7 +21,7 @@ TEST(Database, putAndGetTimeseries)
 TEST(Database, countSamples)
 {
     Database db;
-    auto a = std::make_shared<TimeSeriesDense>(0.0, 1.0);
+    auto a = std::make_shared<TimeSeriesDense<>>(0.0, 1.0);
     db.register_timeseries("a", a);
 
     a->push_sample(123);
@@ -25,7 +31,7 @@ TEST(Database, countSamples)
 TEST(Database, memoryUsage)
 {
     Database db;
-    auto a = std::make_shared<TimeSeriesDense>(0.0, 1.0);
+    auto a = std::make_shared<TimeSeriesDense<>>(0.0, 1.0);
     db.register_timeseries("a", a);
 
     for (int i = 0; i < 128; i++)
@@ -35,3 +41,167 @@ TEST(Database, memoryUsage)
 
     ASSERT_GE(db.memory_usage(), sizeof(double) * 128);
 }
+
+TEST(Database, memoryBudget)
+{
+    Database db;
+    db.set_memory_budget(16 * 1024 * 1024, ::testing::TempDir());
+    auto a = std::make_shared<TimeSeriesDense<>>(0.0, 1.0, db.arena());
+    db.register_timeseries("a", a);
+
+    // Noise doesn't compress, so the only way to get under budget is to spill. The mip-maps alone
+    // take up about 11MiB.
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    std::vector<double> samples(4'000'000);
+    for (auto &sample : samples)
+    {
+        sample = dist(rng);
+    }
+    a->push_samples(samples.data(), samples.size());
+
+    db.enforce_memory_budget();
+    EXPECT_LE(db.memory_usage(), 16 * 1024 * 1024);
+    EXPECT_GT(db.spilled_bytes(), samples.size() * sizeof(double) / 2);
+
+    // Spilled samples are still there when zoomed right in
+    for (std::size_t i = 0; i < samples.size(); i += 99'991)
+    {
+        ASSERT_FLOAT_EQ(a->get_sample(static_cast<double>(i), 1.0).average, samples[i]);
+    }
+}
+
+TEST(Database, handles)
+{
+    Database db;
+    const auto a = std::make_shared<TimeSeriesDense<>>(0.0, 1.0);
+    const auto b = std::make_shared<TimeSeriesDense<>>(0.0, 1.0);
+    ASSERT_EQ(db.register_timeseries("a", a), 0);
+    ASSERT_EQ(db.register_timeseries("b", b), 1);
+    ASSERT_EQ(db.get(0), a);
+    ASSERT_EQ(db.get(1), b);
+    ASSERT_EQ(db.find("b"), 1);
+    ASSERT_FALSE(db.find("c"));
+    ASSERT_THROW(db.get(2), std::out_of_range);
+
+    // Replacing a timeseries keeps its handle, and old registries are left as they were
+    const auto before = db.registry();
+    const auto c = std::make_shared<TimeSeriesDense<>>(0.0, 1.0);
+    ASSERT_EQ(db.register_timeseries("a", c), 0);
+    ASSERT_EQ(db.get(0), c);
+    ASSERT_EQ(before->series[0].ts, a);
+    ASSERT_EQ(db.registry()->series.size(), 2);
+}
+
+TEST(Database, views)
+{
+    Database db;
+    const auto dense = std::make_shared<TimeSeriesDense<>>(0.0, 1.0);
+    const auto sparse = std::make_shared<TimeSeriesSparse>();
+    const auto group = std::make_shared<TimeSeriesGroup<float>>(2, 0.0, 1.0);
+    db.register_timeseries("dense", dense);
+    db.register_timeseries("sparse", sparse);
+    db.register_timeseries("left", group->channel(0));
+    db.register_timeseries("right", group->channel(1));
+
+    const auto push = [&](int count) {
+        for (int i = 0; i < count; ++i)
+        {
+            const auto t = static_cast<double>(dense->size());
+            const float frame[] = {static_cast<float>(t), -static_cast<float>(t)};
+            dense->push_sample(t);
+            sparse->push_sample(t + 0.5, t);
+            group->push_frame(frame);
+        }
+    };
+    const auto read = [](const ReadView &view, SeriesHandle handle) {
+        std::vector<TSSample> samples(100);
+        samples.resize(view.get_samples(handle, samples.data(), 0.0, 1000.0, samples.size()));
+        return samples;
+    };
+
+    push(30'000);
+    const auto view = db.view();
+    std::vector<std::vector<TSSample>> before;
+    for (SeriesHandle handle = 0; handle < 4; ++handle)
+    {
+        before.push_back(read(view, handle));
+        ASSERT_EQ(view.published(handle), 30'000);
+    }
+
+    // Samples pushed after the view was taken don't show up in it
+    push(20'000);
+    for (SeriesHandle handle = 0; handle < 4; ++handle)
+    {
+        const auto after = read(view, handle);
+        ASSERT_EQ(after.size(), before[handle].size());
+        EXPECT_EQ(after.back().max, before[handle].back().max);
+        EXPECT_LE(view.get_span(handle).second, 30'000.0);
+    }
+    EXPECT_EQ(read(view, 0).back().max, 29'999.0);
+    EXPECT_EQ(read(db.view(), 0).back().max, 49'999.0);
+    EXPECT_EQ(db.view().get_span(2), std::make_pair(0.0, 50'000.0));
+    EXPECT_THROW(view.published(4), std::out_of_range);
+
+    // A default view has nothing in it at all
+    EXPECT_TRUE(ReadView().registry().series.empty());
+}
+
+TEST(Database, notifiesListeners)
+{
+    Database db;
+    std::vector<SeriesHandle> registered;
+    const auto id = db.add_listener([&registered](SeriesHandle handle) {
+        registered.push_back(handle);
+    });
+
+    const auto generation = db.generation();
+    db.register_timeseries("a", std::make_shared<TimeSeriesDense<>>(0.0, 1.0));
+    db.register_timeseries("b", std::make_shared<TimeSeriesDense<>>(0.0, 1.0));
+    ASSERT_EQ(registered, (std::vector<SeriesHandle>{0, 1}));
+    ASSERT_EQ(db.generation(), generation + 2);
+
+    db.remove_listener(id);
+    db.register_timeseries("c", std::make_shared<TimeSeriesDense<>>(0.0, 1.0));
+    ASSERT_EQ(registered.size(), 2);
+
+    // A listener can remove itself and register a timeseries of its own
+    std::size_t self = 0;
+    self = db.add_listener([&db, &self, &registered](SeriesHandle handle) {
+        registered.push_back(handle);
+        db.remove_listener(self);
+        db.register_timeseries("e", std::make_shared<TimeSeriesDense<>>(0.0, 1.0));
+    });
+    db.register_timeseries("d", std::make_shared<TimeSeriesDense<>>(0.0, 1.0));
+    ASSERT_EQ(registered, (std::vector<SeriesHandle>{0, 1, 3}));
+    ASSERT_TRUE(db.find("e"));
+}
+
+TEST(Database, registerWhileReading)
+{
+    Database db;
+    std::thread writer([&db]() {
+        for (int i = 0; i < 500; i++)
+        {
+            const auto ts = std::make_shared<TimeSeriesDense<>>(0.0, 1.0);
+            db.register_timeseries(std::to_string(i), ts);
+        }
+    });
+
+    // Every registry a reader sees is complete, however far through the writer is
+    std::size_t seen = 0;
+    while (seen < 500)
+    {
+        const auto registry = db.registry();
+        ASSERT_EQ(registry->series.size(), registry->handles.size());
+        ASSERT_EQ(registry->series.size(), registry->generation);
+        for (std::size_t handle = 0; handle < registry->series.size(); ++handle)
+        {
+            ASSERT_EQ(registry->handles.at(std::to_string(handle)), handle);
+            ASSERT_TRUE(registry->series[handle].ts);
+        }
+        db.memory_usage();
+        seen = registry->series.size();
+    }
+    writer.join();
+}
@@ -0,0 +1,138 @@
+#include <database/kernels.hpp>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace amber::database;
+
+namespace
+{
+const kernels::Isa ALL_ISAS[] = {
+    kernels::Isa::Scalar, kernels::Isa::SSE2, kernels::Isa::AVX2, kernels::Isa::AVX512};
+
+template <typename T> std::vector<T> random_samples(std::size_t count)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<double> dist(-1000.0, 1000.0);
+    std::vector<T> samples(count);
+    for (auto &sample : samples)
+    {
+        sample = static_cast<T>(dist(rng));
+    }
+    return samples;
+}
+
+template <typename T> bool bitwise_equal(const T &a, const T &b)
+{
+    return std::memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+// Every kernel must give exactly the same answer as the scalar one, including the rounding of the
+// floating point sums, for any length and alignment
+template <typename T> void check_kernels()
+{
+    const auto samples = random_samples<T>(256);
+    for (auto isa : ALL_ISAS)
+    {
+        if (!kernels::is_supported(isa))
+        {
+            continue;
+        }
+
+        for (std::size_t offset = 0; offset < 8; ++offset)
+        {
+            for (std::size_t count = 1; count <= 100; ++count)
+            {
+                const T *values = samples.data() + offset;
+                const auto expected = kernels::reduce(values, count, kernels::Isa::Scalar);
+                const auto actual = kernels::reduce(values, count, isa);
+                ASSERT_TRUE(bitwise_equal(expected.sum, actual.sum));
+                ASSERT_EQ(expected.min, actual.min);
+                ASSERT_EQ(expected.max, actual.max);
+
+                ASSERT_EQ(actual.min, *std::min_element(values, values + count));
+                ASSERT_EQ(actual.max, *std::max_element(values, values + count));
+            }
+        }
+    }
+}
+
+// The same goes for the folds along a single column, whose mins and maxes must also match a plain
+// scan
+template <typename T> void check_folds()
+{
+    const auto samples = random_samples<T>(256);
+    for (auto isa : ALL_ISAS)
+    {
+        if (!kernels::is_supported(isa))
+        {
+            continue;
+        }
+
+        for (std::size_t offset = 0; offset < 8; ++offset)
+        {
+            for (std::size_t count = 1; count <= 100; ++count)
+            {
+                const T *values = samples.data() + offset;
+                using kernels::Fold;
+                const auto expected = kernels::fold<Fold::Sum>(values, count, kernels::Isa::Scalar);
+                const auto actual = kernels::fold<Fold::Sum>(values, count, isa);
+                ASSERT_TRUE(bitwise_equal(expected, actual));
+                ASSERT_EQ(kernels::fold<Fold::Min>(values, count, isa),
+                          *std::min_element(values, values + count));
+                ASSERT_EQ(kernels::fold<Fold::Max>(values, count, isa),
+                          *std::max_element(values, values + count));
+            }
+        }
+    }
+}
+} // namespace
+
+TEST(Kernels, ScalarIsAlwaysSupported)
+{
+    ASSERT_TRUE(kernels::is_supported(kernels::Isa::Scalar));
+    ASSERT_TRUE(kernels::is_supported(kernels::active_isa()));
+}
+
+TEST(Kernels, DoubleMatchesScalar)
+{
+    check_kernels<double>();
+}
+
+TEST(Kernels, FloatMatchesScalar)
+{
+    check_kernels<float>();
+}
+
+TEST(Kernels, Int16MatchesScalar)
+{
+    check_kernels<std::int16_t>();
+}
+
+TEST(Kernels, Int32MatchesScalar)
+{
+    check_kernels<std::int32_t>();
+}
+
+TEST(Kernels, DispatchedMatchesScalar)
+{
+    const auto samples = random_samples<double>(1000);
+    const auto expected = kernels::reduce(samples.data(), samples.size(), kernels::Isa::Scalar);
+    const auto actual = kernels::reduce(samples.data(), samples.size());
+    ASSERT_TRUE(bitwise_equal(expected.sum, actual.sum));
+    ASSERT_EQ(expected.min, actual.min);
+    ASSERT_EQ(expected.max, actual.max);
+}
+
+TEST(Kernels, FoldsMatchScalar)
+{
+    check_folds<double>();
+    check_folds<float>();
+    check_folds<std::int16_t>();
+    check_folds<std::int32_t>();
+    check_folds<std::int64_t>();
+}
@@ -0,0 +1,638 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <database/pyramid.hpp>
+#include "read_epoch.hpp"
+#include "spill_file.hpp"
+
+using namespace amber::database;
+
+namespace
+{
+std::vector<double> random_samples(std::size_t count)
+{
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    std::vector<double> samples(count);
+    for (auto &sample : samples)
+    {
+        sample = dist(rng);
+    }
+    return samples;
+}
+
+// Reduce a spread of ranges from both pyramids, which must agree exactly
+void expect_same(const Pyramid<double> &expected, const Pyramid<double> &actual)
+{
+    ASSERT_EQ(expected.size(), actual.size());
+    const auto size = expected.size();
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<std::size_t> dist(0, size - 1);
+    for (int i = 0; i < 1000; ++i)
+    {
+        auto begin = dist(rng);
+        auto end = dist(rng);
+        if (begin > end)
+        {
+            std::swap(begin, end);
+        }
+        ++end;
+
+        const auto a = expected.reduce(begin, end, size);
+        const auto b = actual.reduce(begin, end, size);
+        ASSERT_EQ(a.sum, b.sum);
+        ASSERT_EQ(a.min, b.min);
+        ASSERT_EQ(a.max, b.max);
+    }
+
+    const auto a = expected.reduce(0, size, size);
+    const auto b = actual.reduce(0, size, size);
+    ASSERT_EQ(a.sum, b.sum);
+}
+} // namespace
+
+TEST(Pyramid, BulkLoadMatchesPush)
+{
+    const auto samples = random_samples(1'000'000 + 123);
+    Pyramid<double> pushed;
+    pushed.push(samples.data(), samples.size());
+
+    for (unsigned int threads : {1, 3, 4, 8})
+    {
+        Pyramid<double> loaded;
+        loaded.bulk_load(samples.data(), samples.size(), threads);
+        expect_same(pushed, loaded);
+    }
+}
+
+TEST(Pyramid, BulkLoadByMoveMatchesPush)
+{
+    const auto samples = random_samples(300'000);
+    Pyramid<double> pushed;
+    pushed.push(samples.data(), samples.size());
+
+    auto copy = samples;
+    Pyramid<double> loaded;
+    loaded.bulk_load(std::move(copy), 4);
+    expect_same(pushed, loaded);
+
+    // Pushing after a bulk load carries on as normal
+    pushed.push(samples.data(), 1000);
+    loaded.push(samples.data(), 1000);
+    expect_same(pushed, loaded);
+}
+
+TEST(Pyramid, BulkLoadSmall)
+{
+    const auto samples = random_samples(100);
+    Pyramid<double> pushed;
+    pushed.push(samples.data(), samples.size());
+
+    Pyramid<double> loaded;
+    loaded.bulk_load(samples.data(), samples.size(), 4);
+    expect_same(pushed, loaded);
+
+    ASSERT_THROW(loaded.bulk_load(samples.data(), samples.size()), std::logic_error);
+}
+
+TEST(Pyramid, CompressedMatchesUncompressed)
+{
+    // A slowly varying signal, quantized like a real sensor, so chunks actually compress
+    std::vector<double> samples(300'000);
+    for (std::size_t i = 0; i < samples.size(); ++i)
+    {
+        samples[i] = std::round(100 * std::sin(i * 1e-4));
+    }
+
+    Pyramid<double> plain;
+    plain.push(samples.data(), samples.size());
+    Pyramid<double> compressed;
+    compressed.push(samples.data(), samples.size());
+    compressed.compress();
+
+    // Most of the raw samples' memory should be saved, the levels stay as they are
+    const auto saved = compressed.logical_memory_usage(samples.size()) -
+                       compressed.memory_usage(samples.size());
+    EXPECT_GT(saved * 2, samples.size() * sizeof(double));
+    expect_same(plain, compressed);
+    for (std::size_t i = 0; i < samples.size(); i += 997)
+    {
+        ASSERT_EQ(compressed[i], samples[i]);
+    }
+
+    // New samples carry on where the compressed ones left off
+    plain.push(samples.data(), 50'000);
+    compressed.push(samples.data(), 50'000);
+    compressed.compress();
+    expect_same(plain, compressed);
+}
+
+TEST(Pyramid, NoiseIsLeftUncompressed)
+{
+    const auto samples = random_samples(100'000);
+    Pyramid<double> pyramid;
+    pyramid.push(samples.data(), samples.size());
+    pyramid.compress();
+    EXPECT_EQ(pyramid.memory_usage(samples.size()), pyramid.logical_memory_usage(samples.size()));
+}
+
+TEST(Pyramid, ReadWhileCompressing)
+{
+    std::vector<std::int16_t> samples(2'000'000);
+    for (std::size_t i = 0; i < samples.size(); ++i)
+    {
+        samples[i] = static_cast<std::int16_t>(i / 1000);
+    }
+
+    Pyramid<std::int16_t> pyramid;
+    pyramid.push(samples.data(), samples.size());
+
+    // Keep reading short runs, which go straight to the raw samples, while the chunks are
+    // compressed and freed underneath
+    std::atomic<bool> done{false};
+    std::thread reader([&]() {
+        std::mt19937 rng(3);
+        std::uniform_int_distribution<std::size_t> dist(0, samples.size() - 20);
+        while (!done)
+        {
+            const auto begin = dist(rng);
+            const auto result = pyramid.reduce(begin, begin + 13, samples.size());
+            ASSERT_EQ(result.min, samples[begin]);
+            ASSERT_EQ(result.max, samples[begin + 12]);
+        }
+    });
+    pyramid.compress();
+    done = true;
+    reader.join();
+
+    EXPECT_LT(pyramid.memory_usage(samples.size()), pyramid.logical_memory_usage(samples.size()));
+}
+
+TEST(Pyramid, SpilledMatchesResident)
+{
+    // Rounding the first half makes it compress, so both kinds of chunk get spilled. Every chunk
+    // is sealed, so spilling builds the levels over the same samples as reading the other pyramid
+    // does, and sums are added up in the same order in both.
+    auto samples = random_samples(12 * Pyramid<double>::CHUNK_SIZE);
+    for (std::size_t i = 0; i < samples.size() / 2; ++i)
+    {
+        samples[i] = std::round(samples[i] * 10);
+    }
+
+    Pyramid<double> plain;
+    plain.push(samples.data(), samples.size());
+    Pyramid<double> spilled;
+    spilled.push(samples.data(), samples.size());
+
+    const auto file = std::make_shared<SpillFile>(::testing::TempDir());
+    const auto resident = spilled.memory_usage(samples.size());
+    while (spilled.spill(file))
+    {
+    }
+    ASSERT_FALSE(spilled.spill_candidate());
+    EXPECT_GT(spilled.spilled_bytes(), 0);
+    EXPECT_GT(resident - spilled.memory_usage(samples.size()), samples.size() * sizeof(double) / 2);
+
+    for (std::size_t i = 0; i < samples.size(); i += 97)
+    {
+        ASSERT_EQ(spilled[i], samples[i]);
+    }
+
+    // Narrow ranges read spilled samples back, so come out exactly the same
+    const auto size = samples.size();
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<std::size_t> dist(0, size - Pyramid<double>::MIN_ROUNDED_RANGE);
+    for (int i = 0; i < 1000; ++i)
+    {
+        const auto begin = dist(rng);
+        const auto end = begin + 1 + dist(rng) % (Pyramid<double>::MIN_ROUNDED_RANGE - 1);
+        const auto a = plain.reduce(begin, end, size);
+        const auto b = spilled.reduce(begin, end, size);
+        ASSERT_EQ(a.sum, b.sum);
+        ASSERT_EQ(a.min, b.min);
+        ASSERT_EQ(a.max, b.max);
+    }
+
+    // Wide ranges over spilled chunks snap their ends to the block whose middle they cover
+    const auto round = [](std::size_t index) {
+        const auto block_begin = index & ~std::size_t(31);
+        return index - block_begin > 16 ? block_begin + 32 : block_begin;
+    };
+    const auto sealed = size / Pyramid<double>::CHUNK_SIZE * Pyramid<double>::CHUNK_SIZE;
+    std::uniform_int_distribution<std::size_t> wide_dist(0, sealed);
+    for (int i = 0; i < 1000; ++i)
+    {
+        auto begin = wide_dist(rng);
+        auto end = wide_dist(rng);
+        if (begin > end)
+        {
+            std::swap(begin, end);
+        }
+        if (end - begin < Pyramid<double>::MIN_ROUNDED_RANGE)
+        {
+            continue;
+        }
+
+        // A begin exactly on a block's middle keeps the block, so round begin down from there
+        const auto a = plain.reduce(round(begin - (begin % 32 == 16 ? 1 : 0)), round(end), size);
+        const auto b = spilled.reduce(begin, end, size);
+        ASSERT_NEAR(a.sum, b.sum, 1e-6);
+        ASSERT_EQ(a.min, b.min);
+        ASSERT_EQ(a.max, b.max);
+    }
+}
+
+TEST(Pyramid, AggregateSets)
+{
+    std::vector<std::int32_t> samples(100'000);
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<std::int32_t> values(-50'000, 50'000);
+    for (auto &sample : samples)
+    {
+        sample = values(rng);
+    }
+
+    Pyramid<std::int32_t, EnvelopeAggregates> envelope;
+    envelope.push(samples.data(), samples.size());
+    Pyramid<std::int32_t, MomentAggregates> moments;
+    moments.push(samples.data(), samples.size());
+    Pyramid<std::int32_t, OhlcAggregates> ohlc;
+    ohlc.push(samples.data(), samples.size());
+
+    // Dropping the sum leaves the levels two thirds the size, once reading builds them
+    envelope.reduce(0, samples.size(), samples.size());
+    moments.reduce(0, samples.size(), samples.size());
+    EXPECT_LT(envelope.logical_memory_usage(samples.size()),
+              moments.logical_memory_usage(samples.size()));
+
+    const auto size = samples.size();
+    std::uniform_int_distribution<std::size_t> dist(0, size - 1);
+    for (int i = 0; i < 1000; ++i)
+    {
+        auto begin = dist(rng);
+        auto end = dist(rng);
+        if (begin > end)
+        {
+            std::swap(begin, end);
+        }
+        ++end;
+
+        std::int64_t sum = 0;
+        double sum_squares = 0;
+        for (auto j = begin; j < end; ++j)
+        {
+            sum += samples[j];
+            sum_squares += static_cast<double>(samples[j]) * samples[j];
+        }
+        const auto min = *std::min_element(&samples[begin], &samples[end]);
+        const auto max = *std::max_element(&samples[begin], &samples[end]);
+
+        const auto a = envelope.reduce(begin, end, size);
+        ASSERT_EQ(a.min, min);
+        ASSERT_EQ(a.max, max);
+
+        const auto b = moments.reduce(begin, end, size);
+        ASSERT_EQ(b.sum, sum);
+        ASSERT_DOUBLE_EQ(b.sum_squares, sum_squares);
+        ASSERT_EQ(b.min, min);
+        ASSERT_EQ(b.max, max);
+
+        const auto c = ohlc.reduce(begin, end, size);
+        ASSERT_EQ(c.sum, sum);
+        ASSERT_EQ(c.first, samples[begin]);
+        ASSERT_EQ(c.last, samples[end - 1]);
+        ASSERT_EQ(c.min, min);
+        ASSERT_EQ(c.max, max);
+    }
+}
+
+TEST(Pyramid, Geometries)
+{
+    const auto samples = random_samples(300'000 + 77);
+    const auto size = samples.size();
+
+    std::size_t previous_memory = 0;
+    for (unsigned int fan_in_shift = 1; fan_in_shift <= 4; ++fan_in_shift)
+    {
+        for (unsigned int block_shift : {1, 5, 8})
+        {
+            Pyramid<double> pushed;
+            pushed.set_geometry({block_shift, fan_in_shift});
+            pushed.push(samples.data(), samples.size());
+            Pyramid<double> loaded;
+            loaded.set_geometry({block_shift, fan_in_shift});
+            loaded.bulk_load(samples.data(), samples.size(), 4);
+            expect_same(pushed, loaded);
+
+            std::mt19937 rng(block_shift + fan_in_shift);
+            std::uniform_int_distribution<std::size_t> dist(0, size - 1);
+            for (int i = 0; i < 500; ++i)
+            {
+                auto begin = dist(rng);
+                auto end = dist(rng);
+                if (begin > end)
+                {
+                    std::swap(begin, end);
+                }
+                ++end;
+
+                double sum = 0;
+                for (auto j = begin; j < end; ++j)
+                {
+                    sum += samples[j];
+                }
+                const auto result = pushed.reduce(begin, end, size);
+                ASSERT_NEAR(result.sum, sum, 1e-9);
+                ASSERT_EQ(result.min, *std::min_element(&samples[begin], &samples[end]));
+                ASSERT_EQ(result.max, *std::max_element(&samples[begin], &samples[end]));
+            }
+
+            // Batches of bins work along whichever levels there are, and snapping still moves
+            // edges by no more than half a bin
+            std::vector<std::pair<std::size_t, std::size_t>> ranges;
+            for (std::size_t begin = 3; begin + 1000 <= size; begin += 1000)
+            {
+                ranges.emplace_back(begin, begin + 1000);
+            }
+            std::vector<DataStore<double, DefaultAggregates>> results(ranges.size());
+            pushed.reduce(ranges.data(), ranges.size(), size, results.data());
+            for (std::size_t i = 0; i < ranges.size(); ++i)
+            {
+                const auto expected = pushed.reduce(ranges[i].first, ranges[i].second, size);
+                ASSERT_EQ(results[i].min, expected.min);
+                ASSERT_EQ(results[i].max, expected.max);
+            }
+            const auto error =
+                pushed.reduce_snapped(ranges.data(), ranges.size(), size, 1000, results.data());
+            ASSERT_LE(error, 500u);
+
+            // A wider fan-in has fewer levels to store
+            if (block_shift == 5)
+            {
+                const auto memory = pushed.logical_memory_usage(size);
+                if (previous_memory)
+                {
+                    EXPECT_LT(memory, previous_memory);
+                }
+                previous_memory = memory;
+            }
+        }
+    }
+
+    Pyramid<double> pyramid;
+    ASSERT_THROW(pyramid.set_geometry({0, 1}), std::invalid_argument);
+    ASSERT_THROW(pyramid.set_geometry({9, 1}), std::invalid_argument);
+    ASSERT_THROW(pyramid.set_geometry({5, 5}), std::invalid_argument);
+    pyramid.push(samples.data(), 1);
+    ASSERT_THROW(pyramid.set_geometry({5, 2}), std::logic_error);
+}
+
+TEST(Pyramid, Histograms)
+{
+    // Some of the samples fall outside the histogram's range, and the first half compresses
+    auto samples = random_samples(300'000);
+    for (std::size_t i = 0; i < samples.size() / 2; ++i)
+    {
+        samples[i] = std::round(samples[i] * 10) / 8;
+    }
+    constexpr unsigned int BUCKETS = 16;
+    const auto bucket = [](double value) {
+        const auto position = (value + 1.0) / 2.0 * BUCKETS;
+        return position < 0 ? 0u : std::min(BUCKETS - 1, static_cast<unsigned int>(position));
+    };
+
+    // Enable the histograms part way through, once some chunks have been compressed
+    Pyramid<double> pyramid;
+    pyramid.push(samples.data(), samples.size() / 2);
+    pyramid.compress();
+    EXPECT_EQ(pyramid.histogram_buckets(), 0);
+    pyramid.reduce(0, samples.size() / 2, samples.size() / 2);
+    const auto before = pyramid.logical_memory_usage(samples.size() / 2);
+    pyramid.enable_histograms(-1.0, 1.0, BUCKETS);
+    EXPECT_GT(pyramid.logical_memory_usage(samples.size() / 2), before);
+    EXPECT_THROW(pyramid.enable_histograms(-1.0, 1.0, BUCKETS), std::logic_error);
+    pyramid.push(samples.data() + samples.size() / 2, samples.size() - samples.size() / 2);
+    ASSERT_EQ(pyramid.histogram_buckets(), BUCKETS);
+
+    // Spilled samples are read back for anything narrower than the rounded range
+    const auto file = std::make_shared<SpillFile>(::testing::TempDir());
+    pyramid.spill(file);
+
+    const auto size = samples.size();
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<std::size_t> dist(0, size - 1);
+    for (int i = 0; i < 300; ++i)
+    {
+        auto begin = dist(rng);
+        auto end = dist(rng);
+        if (begin > end)
+        {
+            std::swap(begin, end);
+        }
+        ++end;
+        if (end - begin >= 64 * 1024 && begin < Pyramid<double>::CHUNK_SIZE)
+        {
+            continue;
+        }
+
+        std::vector<std::uint64_t> expected(BUCKETS);
+        for (auto j = begin; j < end; ++j)
+        {
+            ++expected[bucket(samples[j])];
+        }
+        std::vector<std::uint64_t> counts(BUCKETS);
+        pyramid.histogram(begin, end, size, counts.data());
+        ASSERT_EQ(counts, expected) << begin << ".." << end;
+    }
+
+    EXPECT_THROW(Pyramid<double>().enable_histograms(1.0, 1.0, 16), std::invalid_argument);
+    EXPECT_THROW(Pyramid<double>().enable_histograms(0.0, 1.0, 12), std::invalid_argument);
+}
+
+TEST(Pyramid, Retention)
+{
+    constexpr std::size_t RETENTION = 100'000;
+    constexpr std::size_t CHUNK_SIZE = Pyramid<double>::CHUNK_SIZE;
+    const auto samples = random_samples(1'000'000);
+    const auto arena = std::make_shared<ChunkArena>();
+    Pyramid<double> pyramid(arena);
+    pyramid.set_retention(RETENTION);
+
+    // Spill some chunks along the way, which age out just like the others. Recycling here rather
+    // than leaving it to the worker means the windows never have to grow.
+    const auto file = std::make_shared<SpillFile>(::testing::TempDir());
+    std::size_t reserved = 0;
+    for (std::size_t pushed = 0; pushed < samples.size();)
+    {
+        const auto count = std::min<std::size_t>(7777, samples.size() - pushed);
+        pyramid.push(samples.data() + pushed, count);
+        pushed += count;
+        pyramid.compress();
+        if (pushed % 10 == 0)
+        {
+            pyramid.spill(file);
+        }
+
+        // Past the point where the top level appears, the arena shouldn't need to grow
+        if (pushed > 600'000 && !reserved)
+        {
+            reserved = arena->reserved_bytes();
+        }
+    }
+    EXPECT_EQ(arena->reserved_bytes(), reserved);
+
+    const auto size = pyramid.size();
+    const auto first = pyramid.first();
+    ASSERT_EQ(first, (size - RETENTION) / CHUNK_SIZE * CHUNK_SIZE);
+
+    // Whatever is left reduces exactly as it did before the rest was dropped
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<std::size_t> dist(first, size - 1);
+    for (int i = 0; i < 300; ++i)
+    {
+        auto begin = dist(rng);
+        auto end = dist(rng);
+        if (begin > end)
+        {
+            std::swap(begin, end);
+        }
+        end = std::min(end + 1, begin + Pyramid<double>::MIN_ROUNDED_RANGE - 1);
+
+        double sum = 0;
+        double min = samples[begin];
+        double max = samples[begin];
+        for (auto j = begin; j < end; ++j)
+        {
+            sum += samples[j];
+            min = std::min(min, samples[j]);
+            max = std::max(max, samples[j]);
+        }
+        const auto result = pyramid.reduce(begin, end, size);
+        ASSERT_NEAR(result.sum, sum, 1e-9);
+        ASSERT_EQ(result.min, min);
+        ASSERT_EQ(result.max, max);
+    }
+
+    std::vector<double> kept(size - first);
+    pyramid.read(first, size, kept.data());
+    ASSERT_TRUE(std::equal(kept.begin(), kept.end(), samples.begin() + first));
+    ASSERT_THROW(pyramid.enable_histograms(0.0, 1.0, 16), std::logic_error);
+    ASSERT_THROW(pyramid.set_retention(10), std::logic_error);
+}
+
+TEST(Pyramid, RetentionDoesNotWaitForReaders)
+{
+    constexpr std::size_t CHUNK_SIZE = Pyramid<double>::CHUNK_SIZE;
+    const auto samples = random_samples(13 * CHUNK_SIZE);
+    Pyramid<double> pyramid;
+    pyramid.set_retention(2 * CHUNK_SIZE);
+    pyramid.push(samples.data(), 3 * CHUNK_SIZE);
+
+    // A reader part way through a query doesn't stop chunks being dropped, only recycled. Far more
+    // chunks are dropped than the windows leave room for while the worker waits for this guard, so
+    // they have to grow rather than the writer waiting for it too.
+    {
+        ReadEpoch::Guard guard;
+        pyramid.push(samples.data() + 3 * CHUNK_SIZE, 10 * CHUNK_SIZE);
+        EXPECT_EQ(pyramid.first(), 11 * CHUNK_SIZE);
+    }
+    const auto size = pyramid.size();
+    const auto result = pyramid.reduce(pyramid.first(), size, size);
+    EXPECT_EQ(result.max, *std::max_element(samples.begin() + 11 * CHUNK_SIZE, samples.end()));
+    std::vector<double> kept(size - pyramid.first());
+    pyramid.read(pyramid.first(), size, kept.data());
+    EXPECT_TRUE(std::equal(kept.begin(), kept.end(), samples.begin() + 11 * CHUNK_SIZE));
+}
+
+TEST(Pyramid, BatchedReduceMatchesReduce)
+{
+    const auto samples = random_samples(1'000'000 + 123);
+    Pyramid<double> pyramid;
+    pyramid.push(samples.data(), samples.size());
+    const auto size = pyramid.size();
+
+    // Bins of a few widths either side of a power of two, including empty and single sample ones
+    for (std::size_t width : {1, 3, 700, 4096, 5000, 65535, 100'000})
+    {
+        std::vector<std::pair<std::size_t, std::size_t>> ranges;
+        for (std::size_t begin = 17; begin + width <= size; begin += width)
+        {
+            ranges.emplace_back(begin, begin + width);
+        }
+        ranges.emplace_back(size, size);
+
+        std::vector<DataStore<double, DefaultAggregates>> results(ranges.size());
+        pyramid.reduce(ranges.data(), ranges.size(), size, results.data());
+        for (std::size_t i = 0; i < ranges.size(); ++i)
+        {
+            const auto expected = pyramid.reduce(ranges[i].first, ranges[i].second, size);
+            ASSERT_NEAR(results[i].sum, expected.sum, 1e-9);
+            ASSERT_EQ(results[i].min, expected.min);
+            ASSERT_EQ(results[i].max, expected.max);
+        }
+    }
+}
+
+TEST(Pyramid, DeferredLevels)
+{
+    constexpr std::size_t CHUNK_SIZE = Pyramid<double>::CHUNK_SIZE;
+    const auto samples = random_samples(10 * CHUNK_SIZE);
+    const auto brute_force = [&samples](std::size_t begin, std::size_t end) {
+        DataStore<double, DefaultAggregates> result{0.0, samples[begin], samples[begin]};
+        for (auto i = begin; i < end; ++i)
+        {
+            result.sum += samples[i];
+            result.min = std::min(result.min, samples[i]);
+            result.max = std::max(result.max, samples[i]);
+        }
+        return result;
+    };
+
+    // Pushing only stores the raw samples, and reading builds the levels
+    Pyramid<double> pyramid;
+    std::size_t size = 8 * CHUNK_SIZE;
+    pyramid.push(samples.data(), size);
+    const auto unbuilt = pyramid.logical_memory_usage(size);
+    pyramid.reduce(0, size, size);
+    EXPECT_GT(pyramid.logical_memory_usage(size), unbuilt);
+
+    // Samples pushed since are covered from the raw samples until the levels catch up, which they
+    // may have done already by the time they're read
+    pyramid.push(samples.data() + size, CHUNK_SIZE / 2 + 3);
+    size += CHUNK_SIZE / 2 + 3;
+    for (const auto &[begin, end] : {std::pair<std::size_t, std::size_t>{0, size},
+                                     {8 * CHUNK_SIZE - 100, size},
+                                     {CHUNK_SIZE + 5, size - 1}})
+    {
+        const auto expected = brute_force(begin, end);
+        const auto result = pyramid.reduce(begin, end, size);
+        ASSERT_NEAR(result.sum, expected.sum, 1e-9);
+        ASSERT_EQ(result.min, expected.min);
+        ASSERT_EQ(result.max, expected.max);
+
+        std::pair<std::size_t, std::size_t> range{begin, end};
+        DataStore<double, DefaultAggregates> batched;
+        pyramid.reduce(&range, 1, size, &batched);
+        ASSERT_NEAR(batched.sum, expected.sum, 1e-9);
+        ASSERT_EQ(batched.min, expected.min);
+        ASSERT_EQ(batched.max, expected.max);
+    }
+
+    // Falling more than a chunk behind has the reader catch the levels up itself
+    pyramid.push(samples.data() + size, samples.size() - size);
+    size = samples.size();
+    const auto result = pyramid.reduce(0, size, size);
+    EXPECT_NEAR(result.sum, brute_force(0, size).sum, 1e-9);
+    EXPECT_EQ(pyramid.logical_memory_usage(size), [&samples]() {
+        Pyramid<double> loaded;
+        loaded.bulk_load(samples.data(), samples.size());
+        return loaded.logical_memory_usage(samples.size());
+    }());
+}
@@ -0,0 +1,289 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <database/database.hpp>
+#include <database/timeseries_dense.hpp>
+#include <database/timeseries_group.hpp>
+#include <database/timeseries_sparse.hpp>
+
+using namespace amber::database;
+
+namespace
+{
+class Snapshot : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        const auto *info = ::testing::UnitTest::GetInstance()->current_test_info();
+        _path = std::filesystem::temp_directory_path() /
+                (std::string("amber_snapshot_") + info->name() + ".db");
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove(_path);
+    }
+
+    std::string path() const
+    {
+        return _path.string();
+    }
+
+  private:
+    std::filesystem::path _path;
+};
+
+std::vector<TSSample> read_all(const TimeSeries &ts, double start, double width, std::size_t bins)
+{
+    std::vector<TSSample> samples(bins);
+    samples.resize(ts.get_samples(samples.data(), start, width, bins));
+    return samples;
+}
+
+void expect_same(const TimeSeries &expected, const TimeSeries &actual)
+{
+    ASSERT_EQ(expected.size(), actual.size());
+    ASSERT_EQ(expected.get_span(), actual.get_span());
+
+    const auto span = expected.get_span();
+    for (std::size_t bins : {1, 7, 1000})
+    {
+        const auto width = (span.second - span.first) / bins + 1e-3;
+        const auto a = read_all(expected, span.first, width, bins);
+        const auto b = read_all(actual, span.first, width, bins);
+        ASSERT_EQ(a.size(), b.size());
+        for (std::size_t i = 0; i < a.size(); ++i)
+        {
+            EXPECT_EQ(a[i].timestamp, b[i].timestamp);
+            EXPECT_EQ(a[i].average, b[i].average);
+            EXPECT_EQ(a[i].min, b[i].min);
+            EXPECT_EQ(a[i].max, b[i].max);
+        }
+    }
+}
+} // namespace
+
+TEST_F(Snapshot, SaveAndLoad)
+{
+    Database db;
+
+    std::vector<double> values(100'000);
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+        values[i] = std::sin(i * 0.001);
+    }
+    db.register_timeseries("dense", std::make_shared<TimeSeriesDense<double>>(10.0, 0.5, values));
+
+    // With a geometry of its own, which has to come back for the levels to make sense
+    auto adc = std::make_shared<TimeSeriesDense<std::int16_t>>(0.0, 1e-3);
+    adc->set_geometry({8, 4});
+    for (int i = 0; i < 50'000; ++i)
+    {
+        adc->push_sample(static_cast<std::int16_t>(i % 4000 - 2000));
+    }
+    db.register_timeseries("adc", adc);
+
+    auto events = std::make_shared<TimeSeriesSparse>();
+    for (int i = 0; i < 20'000; ++i)
+    {
+        events->push_sample(i * 0.01 + (i % 3) * 0.001, i % 17);
+    }
+    db.register_timeseries("events", events);
+
+    db.register_timeseries("empty", std::make_shared<TimeSeriesDense<float>>(0.0, 1.0));
+
+    auto ohlc = std::make_shared<TimeSeriesDense<float, OhlcAggregates>>(0.0, 1.0);
+    for (int i = 0; i < 10'000; ++i)
+    {
+        ohlc->push_sample(static_cast<float>(i % 77));
+    }
+    db.register_timeseries("ohlc", ohlc);
+
+    db.save(path());
+
+    Database loaded;
+    loaded.load(path());
+    ASSERT_EQ(loaded.data().size(), db.data().size());
+    for (const auto &[name, ts] : db.data())
+    {
+        expect_same(*ts, *loaded.data().at(name));
+    }
+
+    // The aggregates a series keeps come back with it
+    typedef TimeSeriesDense<float, OhlcAggregates> Ohlc;
+    const auto loaded_ohlc = loaded.data().at("ohlc");
+    ASSERT_TRUE(std::dynamic_pointer_cast<Ohlc>(loaded_ohlc));
+    TSStats stats;
+    ASSERT_EQ(loaded_ohlc->get_stats(&stats, 0.0, 100.0, 1), 1);
+    EXPECT_EQ(stats.first, 0.0);
+    EXPECT_EQ(stats.last, 22.0);
+}
+
+TEST_F(Snapshot, PushAfterLoad)
+{
+    Database db;
+    std::vector<double> values(40'000, 1.0);
+    db.register_timeseries("dense", std::make_shared<TimeSeriesDense<double>>(0.0, 1.0, values));
+    db.save(path());
+
+    Database loaded;
+    loaded.load(path());
+    auto ts = std::dynamic_pointer_cast<TimeSeriesDense<double>>(loaded.data().at("dense"));
+    ASSERT_TRUE(ts);
+
+    // The pushed samples land in memory, while the rest stays in the file
+    for (int i = 0; i < 10'000; ++i)
+    {
+        ts->push_sample(3.0);
+    }
+    ASSERT_EQ(ts->size(), 50'000);
+
+    const auto all = ts->get_sample(0.0, 50'000.0);
+    EXPECT_FLOAT_EQ(all.average, 1.4);
+    EXPECT_FLOAT_EQ(all.min, 1.0);
+    EXPECT_FLOAT_EQ(all.max, 3.0);
+}
+
+TEST_F(Snapshot, RetainedWindow)
+{
+    Database db;
+    auto ts = std::make_shared<TimeSeriesDense<std::int16_t>>(3.0, 0.5);
+    ts->set_retention(20'000.0);
+    for (int i = 0; i < 200'000; ++i)
+    {
+        ts->push_sample(static_cast<std::int16_t>(i % 1000));
+    }
+    db.register_timeseries("window", ts);
+    db.save(path());
+
+    // Only the samples which were kept are saved, starting from where they start
+    Database loaded;
+    loaded.load(path());
+    const auto window = loaded.data().at("window");
+    expect_same(*ts, *window);
+    EXPECT_GT(window->get_span().first, 3.0 + 100'000 * 0.5);
+}
+
+TEST_F(Snapshot, SaveWhilePushing)
+{
+    Database db;
+    auto ts = std::make_shared<TimeSeriesDense<float>>(0.0, 1.0);
+    ts->set_retention(50'000.0);
+    db.register_timeseries("window", ts);
+
+    // The window moves on while the series is being saved, which saves wherever it had got to
+    std::atomic<bool> done{false};
+    std::thread writer([&]() {
+        for (int i = 0; !done.load(); ++i)
+        {
+            ts->push_sample(static_cast<float>(i % 1000));
+        }
+    });
+    for (int i = 0; i < 20; ++i)
+    {
+        ASSERT_NO_THROW(db.save(path()));
+    }
+    done.store(true);
+    writer.join();
+
+    Database loaded;
+    loaded.load(path());
+    const auto window = loaded.data().at("window");
+    // Samples are dropped a chunk at a time
+    EXPECT_LT(window->size(), 50'000 + 16'384);
+}
+
+TEST_F(Snapshot, GroupChannelsLoadAsDense)
+{
+    Database db;
+    auto group = std::make_shared<TimeSeriesGroup<std::int16_t>>(2, 5.0, 0.1);
+    for (int i = 0; i < 30'000; ++i)
+    {
+        const std::int16_t frame[] = {static_cast<std::int16_t>(i % 100), -7};
+        group->push_frame(frame);
+    }
+    db.register_timeseries("left", group->channel(0));
+    db.register_timeseries("right", group->channel(1));
+    db.save(path());
+
+    Database loaded;
+    loaded.load(path());
+    for (const auto &[name, ts] : db.data())
+    {
+        const auto dense =
+            std::dynamic_pointer_cast<TimeSeriesDense<std::int16_t>>(loaded.data().at(name));
+        ASSERT_TRUE(dense);
+        expect_same(*ts, *dense);
+    }
+}
+
+TEST_F(Snapshot, OutlivesDatabase)
+{
+    std::shared_ptr<TimeSeries> ts;
+    {
+        Database db;
+        db.register_timeseries("dense",
+                               std::make_shared<TimeSeriesDense<float>>(
+                                   0.0, 1.0, std::vector<float>(100'000, 2.0f)));
+        db.save(path());
+
+        Database loaded;
+        loaded.load(path());
+        ts = loaded.data().at("dense");
+    }
+
+    const auto all = ts->get_sample(0.0, 100'000.0);
+    EXPECT_FLOAT_EQ(all.average, 2.0);
+}
+
+TEST_F(Snapshot, SaveOverLoaded)
+{
+    Database db;
+    db.register_timeseries("dense",
+                           std::make_shared<TimeSeriesDense<float>>(
+                               0.0, 1.0, std::vector<float>(100'000, 2.0f)));
+    db.save(path());
+
+    // Saving over the file the loaded series are mapped from doesn't change what they see
+    Database loaded;
+    loaded.load(path());
+    Database other;
+    other.register_timeseries("dense",
+                              std::make_shared<TimeSeriesDense<float>>(
+                                  0.0, 1.0, std::vector<float>(50'000, 5.0f)));
+    other.save(path());
+    EXPECT_FALSE(std::filesystem::exists(path() + ".tmp"));
+
+    const auto all = loaded.data().at("dense")->get_sample(0.0, 100'000.0);
+    EXPECT_FLOAT_EQ(all.average, 2.0);
+
+    Database reloaded;
+    reloaded.load(path());
+    EXPECT_EQ(reloaded.data().at("dense")->size(), 50'000);
+}
+
+TEST_F(Snapshot, RejectsBadFiles)
+{
+    Database db;
+    EXPECT_THROW(db.load(path()), std::runtime_error);
+
+    {
+        std::ofstream file(path(), std::ios::binary);
+        file << "definitely not a snapshot";
+    }
+    EXPECT_THROW(db.load(path()), std::runtime_error);
+
+    // A truncated snapshot loads nothing at all
+    Database source;
+    source.register_timeseries(
+        "dense", std::make_shared<TimeSeriesDense<double>>(0.0, 1.0, std::vector<double>(1000)));
+    source.save(path());
+    std::filesystem::resize_file(path(), std::filesystem::file_size(path()) - 100);
+    EXPECT_THROW(db.load(path()), std::runtime_error);
+    EXPECT_TRUE(db.data().empty());
+}
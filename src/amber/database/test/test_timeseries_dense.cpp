@@ -1,4 +1,11 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 #include <database/timeseries_dense.hpp>
 
 using namespace amber::database;
@@ -125,3 +132,289 @@ TEST(TimeSeriesDense, CheckSize)
     TimeSeriesDense db(0.0, 1.0, initial_values);
     ASSERT_EQ(db.size(), initial_values.size());
 }
+
+TEST(TimeSeriesDense, ReduceMatchesBruteForce)
+{
+    // Exercise bins which start and end at all sorts of offsets within the mip-map blocks
+    std::vector<double> values;
+    for (int i = 0; i < 1000; i++)
+    {
+        values.push_back((i * 7919) % 1013);
+    }
+    TimeSeriesDense db(0.0, 1.0, values);
+
+    for (std::size_t begin = 0; begin < values.size(); begin += 37)
+    {
+        for (std::size_t width = 2; begin + width <= values.size(); width = width * 3 + 1)
+        {
+            const auto first = values.begin() + begin;
+            const auto last = first + width;
+            const auto sum = std::accumulate(first, last, 0.0);
+            const auto a = db.get_sample(begin, width);
+            EXPECT_FLOAT_EQ(a.average, sum / width);
+            EXPECT_FLOAT_EQ(a.min, *std::min_element(first, last));
+            EXPECT_FLOAT_EQ(a.max, *std::max_element(first, last));
+        }
+    }
+}
+
+TEST(TimeSeriesDense, Stats)
+{
+    // A square wave between -2 and 4, with an RMS of sqrt(10) and a standard deviation of 3
+    std::vector<double> values;
+    for (int i = 0; i < 64'000; i++)
+    {
+        values.push_back(i % 2 ? 4.0 : -2.0);
+    }
+    TimeSeriesDense<double, MomentAggregates> moments(0.0, 1.0, values);
+
+    TSStats stats[4];
+    ASSERT_EQ(moments.get_stats(stats, 0.0, 16'000.0, 4), 4);
+    for (const auto &stat : stats)
+    {
+        EXPECT_EQ(stat.count, 16'000);
+        EXPECT_DOUBLE_EQ(stat.average, 1.0);
+        EXPECT_DOUBLE_EQ(stat.rms, std::sqrt(10.0));
+        EXPECT_DOUBLE_EQ(stat.stddev, 3.0);
+        EXPECT_TRUE(std::isnan(stat.first));
+    }
+
+    TimeSeriesDense<double, OhlcAggregates> ohlc(0.0, 1.0, values);
+    ASSERT_EQ(ohlc.get_stats(stats, 3.0, 1'000.0, 1), 1);
+    EXPECT_EQ(stats[0].first, 4.0);
+    EXPECT_EQ(stats[0].last, -2.0);
+    EXPECT_TRUE(std::isnan(stats[0].rms));
+
+    // Without the sum the average is the middle of the envelope, and takes less memory
+    TimeSeriesDense<double, EnvelopeAggregates> envelope(0.0, 1.0, values);
+    EXPECT_FLOAT_EQ(envelope.get_sample(0.0, 100.0).average, 1.0);
+    EXPECT_LT(envelope.memory_usage(), moments.memory_usage());
+}
+
+TEST(TimeSeriesDense, Histograms)
+{
+    // A slow ramp from 0 to 1 with a ripple on top, which an envelope would show as a solid band
+    std::vector<double> values;
+    for (int i = 0; i < 100'000; i++)
+    {
+        values.push_back(i / 100'000.0 + (i % 2 ? 0.25 : 0.0));
+    }
+    TimeSeriesDense db(0.0, 1.0, values);
+    std::vector<std::uint64_t> counts(5 * 8);
+    EXPECT_THROW(db.get_histograms(counts.data(), 0.0, 25'000.0, 5), std::logic_error);
+
+    const auto memory = db.memory_usage();
+    db.enable_histograms(0.0, 2.0, 8);
+    ASSERT_EQ(db.histogram_buckets(), 8);
+    EXPECT_GT(db.memory_usage(), memory);
+
+    // The first bin only has samples in the bottom bucket and the one a ripple above it, while the
+    // last bin is past the end
+    db.get_histograms(counts.data(), 0.0, 25'000.0, 5);
+    const std::vector<std::uint64_t> first(counts.begin(), counts.begin() + 8);
+    EXPECT_EQ(first, std::vector<std::uint64_t>({12'500, 12'500, 0, 0, 0, 0, 0, 0}));
+    const std::vector<std::uint64_t> last(counts.begin() + 32, counts.end());
+    EXPECT_EQ(last, std::vector<std::uint64_t>(8, 0));
+    EXPECT_EQ(std::accumulate(counts.begin(), counts.end(), std::uint64_t(0)), values.size());
+}
+
+TEST(TimeSeriesDense, PushSamplesMatchesPushSample)
+{
+    // Use enough samples to span a few chunks, pushed in awkwardly sized batches
+    std::vector<double> values;
+    for (int i = 0; i < 40'000; i++)
+    {
+        values.push_back((i * 7919) % 1013);
+    }
+
+    TimeSeriesDense single(0.0, 1.0);
+    for (auto value : values)
+    {
+        single.push_sample(value);
+    }
+
+    TimeSeriesDense batched(0.0, 1.0);
+    for (std::size_t i = 0; i < values.size(); i += 999)
+    {
+        batched.push_samples(&values[i], std::min<std::size_t>(999, values.size() - i));
+    }
+
+    ASSERT_EQ(batched.size(), values.size());
+    TSSample expected[100];
+    TSSample actual[100];
+    ASSERT_EQ(single.get_samples(expected, 3.0, 397.0, 100), 100);
+    ASSERT_EQ(batched.get_samples(actual, 3.0, 397.0, 100), 100);
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_FLOAT_EQ(actual[i].average, expected[i].average);
+        EXPECT_FLOAT_EQ(actual[i].min, expected[i].min);
+        EXPECT_FLOAT_EQ(actual[i].max, expected[i].max);
+    }
+}
+
+TEST(TimeSeriesDense, PushFloatSamples)
+{
+    TimeSeriesDense db(0.0, 1.0);
+    std::vector<float> values = {1.0f, 2.0f, 3.0f, 4.0f};
+    db.push_samples(values.data(), values.size());
+
+    ASSERT_EQ(db.size(), 4);
+    auto a = db.get_sample(0.0, 4.0);
+    EXPECT_FLOAT_EQ(a.average, 2.5);
+    EXPECT_FLOAT_EQ(a.min, 1.0);
+    EXPECT_FLOAT_EQ(a.max, 4.0);
+}
+
+TEST(TimeSeriesDense, Int16Samples)
+{
+    TimeSeriesDense<std::int16_t> db(0.0, 1.0);
+    std::vector<std::int16_t> values;
+    for (int i = 0; i < 4'000'000; i++)
+    {
+        values.push_back(i % 2 ? 32767 : -32768);
+    }
+    db.push_samples(values.data(), values.size());
+
+    // The sum of this lot would overflow 16 (and 32) bits many times over if it weren't widened
+    auto a = db.get_sample(0.0, values.size());
+    EXPECT_FLOAT_EQ(a.average, -0.5);
+    EXPECT_FLOAT_EQ(a.min, -32768);
+    EXPECT_FLOAT_EQ(a.max, 32767);
+
+    // Raw samples should take up a quarter of the space of doubles
+    TimeSeriesDense<double> doubles(0.0, 1.0);
+    doubles.push_samples(values.data(), values.size());
+    EXPECT_LT(db.logical_memory_usage(), doubles.logical_memory_usage() / 2);
+}
+
+TEST(TimeSeriesDense, FloatSamples)
+{
+    std::vector<float> initial_values = {0.5f, 1.5f, 2.5f, 3.5f};
+    TimeSeriesDense db(0.0, 1.0, initial_values);
+
+    auto a = db.get_sample(0.0, 4.0);
+    EXPECT_FLOAT_EQ(a.average, 2.0);
+    EXPECT_FLOAT_EQ(a.min, 0.5);
+    EXPECT_FLOAT_EQ(a.max, 3.5);
+}
+
+TEST(TimeSeriesDense, ConcurrentReadWrite)
+{
+    TimeSeriesDense db(0.0, 1.0);
+    constexpr int TOTAL_SAMPLES = 100'000;
+    std::atomic<bool> running = true;
+
+    std::thread writer([&db, &running]() {
+        for (int i = 0; i < TOTAL_SAMPLES; i++)
+        {
+            db.push_sample(i);
+        }
+        running = false;
+    });
+
+    // Readers should only ever see fully written data, so each bin must be internally consistent
+    // and never extend past the published span
+    TSSample samples[64];
+    while (running)
+    {
+        const auto n_samples = db.get_samples(samples, 0.0, TOTAL_SAMPLES / 64.0, 64);
+        const auto span = db.get_span();
+        for (std::size_t i = 0; i < n_samples; i++)
+        {
+            ASSERT_LE(samples[i].min, samples[i].average);
+            ASSERT_GE(samples[i].max, samples[i].average);
+            ASSERT_LT(samples[i].max, span.second + 1);
+        }
+    }
+
+    writer.join();
+    ASSERT_EQ(db.size(), TOTAL_SAMPLES);
+    auto a = db.get_sample(0.0, TOTAL_SAMPLES);
+    EXPECT_FLOAT_EQ(a.max, TOTAL_SAMPLES - 1);
+}
+
+TEST(TimeSeriesDense, Retention)
+{
+    TimeSeriesDense<std::int32_t> db(10.0, 0.5);
+    db.set_retention(10'000.0);
+    constexpr int TOTAL_SAMPLES = 1'000'000;
+    std::atomic<bool> running = true;
+
+    std::thread writer([&db, &running]() {
+        for (int i = 0; i < TOTAL_SAMPLES; i += 100)
+        {
+            std::vector<int> values(100);
+            std::iota(values.begin(), values.end(), i);
+            db.push_samples(values.data(), values.size());
+        }
+        running = false;
+    });
+
+    // Sample i is worth i, so a bin which saw samples being reused would hold values from its
+    // future
+    TSSample samples[64];
+    while (running)
+    {
+        const auto span = db.get_span();
+        const auto width = (span.second - span.first) / 60;
+        const auto n_samples = db.get_samples(samples, span.first - width, width, 64);
+        for (std::size_t i = 0; i < n_samples; i++)
+        {
+            const auto first_value = (samples[i].timestamp - 10.0) / 0.5;
+            ASSERT_LE(samples[i].max, first_value + width / 0.5 + 1);
+            ASSERT_LE(samples[i].min, samples[i].max);
+        }
+    }
+    writer.join();
+
+    // The window slides a chunk at a time, so it only ever holds up to a chunk more than asked
+    const auto retained = static_cast<std::size_t>(10'000.0 / 0.5);
+    const auto first = (TOTAL_SAMPLES - retained) / 16384 * 16384;
+    ASSERT_EQ(db.size(), TOTAL_SAMPLES - first);
+    ASSERT_EQ(db.get_span(), std::make_pair(10.0 + first * 0.5, 10.0 + TOTAL_SAMPLES * 0.5));
+    const auto all = db.get_sample(0.0, 1e9);
+    EXPECT_FLOAT_EQ(all.min, first);
+    EXPECT_FLOAT_EQ(all.max, TOTAL_SAMPLES - 1);
+}
+
+TEST(TimeSeriesDense, Approximate)
+{
+    // Sample i is worth i, so each bin's min and max show which samples ended up in it
+    std::vector<double> values(100'003);
+    std::iota(values.begin(), values.end(), 0.0);
+    TimeSeriesDense<double> db(0.0, 1.0, values);
+
+    TSSample samples[1100];
+    double error = 0.0;
+    const auto n_samples =
+        db.get_samples_approx(db.published(), samples, -150.3, 100.0, 1100, error);
+    ASSERT_GT(error, 0.0);
+    ASSERT_LE(error, 50.0);
+    ASSERT_GT(n_samples, 990u);
+
+    // Bins still tile, so no sample is left out or counted twice
+    for (std::size_t i = 0; i < n_samples; ++i)
+    {
+        ASSERT_GE(samples[i].min, samples[i].timestamp - error);
+        ASSERT_LE(samples[i].max, samples[i].timestamp + 100.0 + error);
+        if (i > 0)
+        {
+            ASSERT_EQ(samples[i].min, samples[i - 1].max + 1);
+        }
+    }
+    EXPECT_EQ(samples[0].min, 0.0);
+    EXPECT_EQ(samples[n_samples - 1].max, 100'002.0);
+
+    // Bins narrower than a block are read exactly
+    TSSample exact[100];
+    TSSample approx[100];
+    db.get_samples(exact, 500.5, 3.0, 100);
+    db.get_samples_approx(db.published(), approx, 500.5, 3.0, 100, error);
+    ASSERT_EQ(error, 0.0);
+    for (std::size_t i = 0; i < 100; ++i)
+    {
+        ASSERT_EQ(exact[i].average, approx[i].average);
+        ASSERT_EQ(exact[i].min, approx[i].min);
+        ASSERT_EQ(exact[i].max, approx[i].max);
+    }
+}
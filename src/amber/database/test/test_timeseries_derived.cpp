@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include <database/timeseries_dense.hpp>
+#include <database/timeseries_derived.hpp>
+
+using namespace amber::database;
+
+namespace
+{
+// Mapping a sample which has already been rounded to a float rounds it again
+void expect_same_bins(const TSSample *a, const TSSample *b, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        ASSERT_FLOAT_EQ(a[i].timestamp, b[i].timestamp);
+        ASSERT_NEAR(a[i].average, b[i].average, 1e-4);
+        ASSERT_NEAR(a[i].min, b[i].min, 1e-4);
+        ASSERT_NEAR(a[i].max, b[i].max, 1e-4);
+    }
+}
+} // namespace
+
+TEST(Expression, Affine)
+{
+    const auto ts = std::make_shared<TimeSeriesDense<>>(0.0, 1.0);
+    const auto other = std::make_shared<TimeSeriesDense<>>(0.0, 1.0);
+    const Expression a(ts);
+
+    const auto affine = ((a * 4.0 + 1.0) / 2.0 - a).affine();
+    ASSERT_TRUE(affine);
+    ASSERT_EQ(affine->series, ts);
+    ASSERT_DOUBLE_EQ(affine->scale, 1.0);
+    ASSERT_DOUBLE_EQ(affine->offset, 0.5);
+
+    const auto negated = (-(a - 3.0)).affine();
+    ASSERT_TRUE(negated);
+    ASSERT_DOUBLE_EQ(negated->scale, -1.0);
+    ASSERT_DOUBLE_EQ(negated->offset, 3.0);
+
+    ASSERT_FALSE((a * a).affine());
+    ASSERT_FALSE((a + Expression(other)).affine());
+    ASSERT_FALSE((1.0 / a).affine());
+    ASSERT_FALSE(abs(a).affine());
+
+    ASSERT_THROW(TimeSeriesDerived(Expression(2.0) * 3.0), std::invalid_argument);
+}
+
+TEST(TimeSeriesDerived, AffineReadsInputDirectly)
+{
+    std::vector<double> values;
+    for (int i = 0; i < 100'000; ++i)
+    {
+        values.push_back(std::sin(i * 0.001) * 100);
+    }
+    const auto input = std::make_shared<TimeSeriesDense<>>(1.0, 0.5, values);
+    TimeSeriesDerived derived(Expression(input) * -2.0 + 10.0);
+    ASSERT_TRUE(derived.is_affine());
+
+    for (auto &value : values)
+    {
+        value = value * -2.0 + 10.0;
+    }
+    TimeSeriesDense<> expected(1.0, 0.5, values);
+    ASSERT_EQ(derived.size(), expected.size());
+    ASSERT_EQ(derived.get_span(), expected.get_span());
+
+    for (const double bin_width : {0.25, 3.0, 700.0})
+    {
+        constexpr std::size_t BINS = 64;
+        std::vector<TSSample> actual(BINS), reference(BINS);
+        const auto count = derived.get_samples(actual.data(), 0.0, bin_width, BINS);
+        ASSERT_EQ(expected.get_samples(reference.data(), 0.0, bin_width, BINS), count);
+        expect_same_bins(actual.data(), reference.data(), count);
+    }
+
+    // Nothing is ever evaluated, so there's nothing to keep
+    ASSERT_EQ(derived.memory_usage(), 0u);
+}
+
+TEST(TimeSeriesDerived, EvaluatesLazily)
+{
+    const auto a = std::make_shared<TimeSeriesDense<float>>(2.0, 0.25);
+    const auto b = std::make_shared<TimeSeriesDense<std::int16_t>>(2.0, 0.25);
+    TimeSeriesDerived derived(abs(Expression(a) - Expression(b)) * 2.0);
+    ASSERT_FALSE(derived.is_affine());
+
+    TSSample sample;
+    ASSERT_EQ(derived.get_samples(&sample, 0.0, 1.0, 1), 0u);
+
+    std::vector<double> values;
+    const auto push = [&](int count) {
+        for (int i = 0; i < count; ++i)
+        {
+            const auto n = values.size();
+            const auto x = static_cast<float>(n % 777);
+            const auto y = static_cast<std::int16_t>((n * 7) % 1000);
+            a->push_sample(x);
+            b->push_sample(y);
+            values.push_back(std::fabs(x - y) * 2.0);
+        }
+    };
+    push(50'000);
+
+    // Pushing to the inputs doesn't do anything until the series is read
+    ASSERT_EQ(derived.size(), 50'000u);
+    ASSERT_EQ(derived.memory_usage(), 0u);
+
+    const auto check = [&] {
+        TimeSeriesDense<> expected(2.0, 0.25, values);
+        ASSERT_EQ(derived.get_span(), expected.get_span());
+        for (const double bin_width : {0.1, 3.0, 700.0})
+        {
+            constexpr std::size_t BINS = 64;
+            std::vector<TSSample> actual(BINS), reference(BINS);
+            const auto count = derived.get_samples(actual.data(), 1.0, bin_width, BINS);
+            ASSERT_EQ(expected.get_samples(reference.data(), 1.0, bin_width, BINS), count);
+            expect_same_bins(actual.data(), reference.data(), count);
+        }
+    };
+    check();
+    ASSERT_GT(derived.memory_usage(), 0u);
+
+    // Only new samples are evaluated, and only once both inputs have them
+    push(20'000);
+    a->push_sample(1.0f);
+    ASSERT_EQ(derived.size(), 70'000u);
+    check();
+}
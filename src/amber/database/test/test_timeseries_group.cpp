@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <database/timeseries_dense.hpp>
+#include <database/timeseries_group.hpp>
+
+using namespace amber::database;
+
+namespace
+{
+void expect_same_bins(const TSSample *a, const TSSample *b, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        ASSERT_FLOAT_EQ(a[i].timestamp, b[i].timestamp);
+        ASSERT_FLOAT_EQ(a[i].average, b[i].average);
+        ASSERT_FLOAT_EQ(a[i].min, b[i].min);
+        ASSERT_FLOAT_EQ(a[i].max, b[i].max);
+    }
+}
+} // namespace
+
+TEST(TimeSeriesGroup, MatchesDense)
+{
+    constexpr std::size_t CHANNELS = 3;
+    constexpr std::size_t FRAMES = 100'000;
+    auto group = std::make_shared<TimeSeriesGroup<float>>(CHANNELS, 2.0, 0.5);
+    std::vector<std::shared_ptr<TimeSeriesDense<float>>> dense;
+    for (std::size_t channel = 0; channel < CHANNELS; ++channel)
+    {
+        dense.push_back(std::make_shared<TimeSeriesDense<float>>(2.0, 0.5));
+    }
+
+    std::vector<double> frames;
+    for (std::size_t i = 0; i < FRAMES; ++i)
+    {
+        for (std::size_t channel = 0; channel < CHANNELS; ++channel)
+        {
+            const double value = (i * (channel + 1)) % 1000;
+            frames.push_back(value);
+            dense[channel]->push_sample(value);
+        }
+    }
+
+    // A few frames on their own, then the rest in one go
+    for (std::size_t i = 0; i < 10; ++i)
+    {
+        group->push_frame(&frames[i * CHANNELS]);
+    }
+    group->push_frames(&frames[10 * CHANNELS], FRAMES - 10);
+    ASSERT_EQ(group->size(), FRAMES);
+    ASSERT_EQ(group->get_span(), dense[0]->get_span());
+
+    for (const double bin_width : {0.25, 3.0, 100.0, 7000.0})
+    {
+        constexpr std::size_t BINS = 64;
+        std::vector<std::vector<TSSample>> grouped(CHANNELS, std::vector<TSSample>(BINS));
+        std::vector<TSSample *> outputs;
+        for (auto &bins : grouped)
+        {
+            outputs.push_back(bins.data());
+        }
+        const auto count = group->get_samples(outputs.data(), 0.0, bin_width, BINS);
+
+        for (std::size_t channel = 0; channel < CHANNELS; ++channel)
+        {
+            std::vector<TSSample> expected(BINS);
+            ASSERT_EQ(dense[channel]->get_samples(expected.data(), 0.0, bin_width, BINS), count);
+            expect_same_bins(grouped[channel].data(), expected.data(), count);
+
+            std::vector<TSSample> single(BINS);
+            const auto view = group->channel(channel);
+            ASSERT_EQ(view->get_samples(single.data(), 0.0, bin_width, BINS), count);
+            expect_same_bins(single.data(), expected.data(), count);
+        }
+    }
+}
+
+TEST(TimeSeriesGroup, Channels)
+{
+    auto group = std::make_shared<TimeSeriesGroup<>>(2, 0.0, 1.0);
+    const double frame[] = {1.0, -1.0};
+    group->push_frame(frame);
+
+    const auto right = group->channel(1);
+    EXPECT_EQ(right->size(), 1);
+    EXPECT_FLOAT_EQ(right->get_sample(0.0, 1.0).average, -1.0);
+    EXPECT_GT(right->memory_usage(), 0);
+    EXPECT_THROW(group->channel(2), std::out_of_range);
+
+    // The channel keeps its group alive
+    group.reset();
+    EXPECT_FLOAT_EQ(right->get_sample(0.0, 1.0).max, -1.0);
+}
+
+TEST(TimeSeriesGroup, ConcurrentReadWrite)
+{
+    constexpr std::size_t CHANNELS = 4;
+    constexpr int TOTAL_FRAMES = 50'000;
+    auto group = std::make_shared<TimeSeriesGroup<std::int32_t>>(CHANNELS, 0.0, 1.0);
+    std::atomic<bool> running = true;
+
+    std::thread writer([&group, &running]() {
+        std::int32_t frame[CHANNELS];
+        for (int i = 0; i < TOTAL_FRAMES; i++)
+        {
+            std::fill(std::begin(frame), std::end(frame), i);
+            group->push_frame(frame);
+        }
+        running = false;
+    });
+
+    // Frames are published all at once, so every channel must always agree
+    TSSample samples[CHANNELS][16];
+    TSSample *outputs[CHANNELS];
+    for (std::size_t channel = 0; channel < CHANNELS; ++channel)
+    {
+        outputs[channel] = samples[channel];
+    }
+    while (running)
+    {
+        const auto count = group->get_samples(outputs, 0.0, TOTAL_FRAMES / 16.0, 16);
+        for (std::size_t channel = 1; channel < CHANNELS; ++channel)
+        {
+            expect_same_bins(samples[0], samples[channel], count);
+        }
+    }
+
+    writer.join();
+    ASSERT_EQ(group->size(), TOTAL_FRAMES);
+}
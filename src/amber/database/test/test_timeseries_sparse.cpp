@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <numeric>
+#include <database/timeseries_sparse.hpp>
+
+using namespace amber::database;
+
+TEST(TimeSeriesSparse, addAndRetrieveTwoSamples)
+{
+    TimeSeriesSparse db;
+
+    db.push_sample(0.5, 1.0);
+    db.push_sample(0.7, 2.0);
+
+    auto a = db.get_sample(0.0, 0.6);
+    EXPECT_FLOAT_EQ(a.timestamp, 0.0);
+    EXPECT_FLOAT_EQ(a.average, 1.0);
+    EXPECT_FLOAT_EQ(a.min, 1.0);
+    EXPECT_FLOAT_EQ(a.max, 1.0);
+
+    auto b = db.get_sample(0.0, 1.0);
+    EXPECT_FLOAT_EQ(b.average, 1.5);
+    EXPECT_FLOAT_EQ(b.min, 1.0);
+    EXPECT_FLOAT_EQ(b.max, 2.0);
+}
+
+TEST(TimeSeriesSparse, EmptyBinsAreSkipped)
+{
+    TimeSeriesSparse db;
+    db.push_sample(0.5, 1.0);
+    db.push_sample(3.5, 2.0);
+
+    TSSample samples[5];
+    auto n_samples = db.get_samples(samples, 0.0, 1.0, 5);
+    ASSERT_EQ(n_samples, 2);
+    EXPECT_FLOAT_EQ(samples[0].timestamp, 0.0);
+    EXPECT_FLOAT_EQ(samples[0].average, 1.0);
+    EXPECT_FLOAT_EQ(samples[1].timestamp, 3.0);
+    EXPECT_FLOAT_EQ(samples[1].average, 2.0);
+}
+
+TEST(TimeSeriesSparse, EmptySet)
+{
+    TimeSeriesSparse db;
+
+    TSSample samples[5];
+    auto n_samples = db.get_samples(samples, 0.0, 1.0, 5);
+    EXPECT_EQ(n_samples, 0);
+    EXPECT_EQ(db.size(), 0);
+}
+
+TEST(TimeSeriesSparse, Span)
+{
+    TimeSeriesSparse db;
+    db.push_sample(1.25, 1.0);
+    db.push_sample(2.5, 1.0);
+    db.push_sample(10.0, 1.0);
+
+    auto span = db.get_span();
+    EXPECT_DOUBLE_EQ(span.first, 1.25);
+    EXPECT_DOUBLE_EQ(span.second, 10.0);
+    EXPECT_EQ(db.size(), 3);
+}
+
+TEST(TimeSeriesSparse, OutOfOrder)
+{
+    TimeSeriesSparse db;
+    db.push_sample(1.0, 1.0);
+    ASSERT_THROW(db.push_sample(0.5, 1.0), std::invalid_argument);
+
+    // A bad batch shouldn't get pushed at all
+    double timestamps[] = {2.0, 3.0, 2.5};
+    double values[] = {1.0, 2.0, 3.0};
+    ASSERT_THROW(db.push_samples(timestamps, values, 3), std::invalid_argument);
+    EXPECT_EQ(db.size(), 1);
+}
+
+TEST(TimeSeriesSparse, MatchesBruteForce)
+{
+    // Irregular timestamps with the odd long gap, so that we get plenty of full chunks as well as
+    // chunks cut short because their offsets would overflow
+    std::vector<double> timestamps;
+    std::vector<double> values;
+    double timestamp = 0.0;
+    for (int i = 0; i < 20'000; i++)
+    {
+        timestamp += (i % 5000 == 0) ? 5000.0 : ((i * 7919) % 13) * 1e-3;
+        timestamps.push_back(timestamp);
+        values.push_back((i * 104729) % 1009);
+    }
+
+    TimeSeriesSparse db;
+    for (std::size_t i = 0; i < timestamps.size(); i += 777)
+    {
+        const auto count = std::min<std::size_t>(777, timestamps.size() - i);
+        db.push_samples(&timestamps[i], &values[i], count);
+    }
+    ASSERT_EQ(db.size(), timestamps.size());
+
+    const auto span = db.get_span();
+    const std::size_t num_bins = 300;
+    const auto bin_width = (span.second - span.first) / (num_bins - 1);
+    TSSample samples[num_bins];
+    const auto n_samples = db.get_samples(samples, span.first, bin_width, num_bins);
+
+    std::size_t sample = 0;
+    for (std::size_t bin = 0; bin < num_bins; bin++)
+    {
+        const auto bin_start = span.first + bin * bin_width;
+        const auto first = std::lower_bound(timestamps.begin(), timestamps.end(), bin_start);
+        const auto last =
+            std::lower_bound(timestamps.begin(), timestamps.end(), bin_start + bin_width);
+        if (first == last)
+        {
+            continue;
+        }
+
+        ASSERT_LT(sample, n_samples);
+        const auto begin = values.begin() + (first - timestamps.begin());
+        const auto end = values.begin() + (last - timestamps.begin());
+        EXPECT_FLOAT_EQ(samples[sample].timestamp, bin_start);
+        EXPECT_FLOAT_EQ(samples[sample].average,
+                        std::accumulate(begin, end, 0.0) / (end - begin));
+        EXPECT_FLOAT_EQ(samples[sample].min, *std::min_element(begin, end));
+        EXPECT_FLOAT_EQ(samples[sample].max, *std::max_element(begin, end));
+        ++sample;
+    }
+    EXPECT_EQ(sample, n_samples);
+}
+
+TEST(TimeSeriesSparse, MemoryUsage)
+{
+    TimeSeriesSparse db;
+    for (int i = 0; i < 128; i++)
+    {
+        db.push_sample(i * 0.1, i);
+    }
+    ASSERT_GT(db.memory_usage(), 128 * (sizeof(double) + sizeof(std::uint32_t)));
+}
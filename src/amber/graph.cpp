@@ -221,7 +221,8 @@ double Graph::latest_visibile_sample_time() const
         const auto &ts = m_state.timeseries[i];
         if (ts.visible)
         {
-            const auto span = ts.ts->get_span();
+            // As of the frame's view, so it agrees with what gets drawn
+            const auto span = m_state.view.get_span(i);
             latest_sample_time = std::max(latest_sample_time, span.second);
         }
     }
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <memory>
 #include <string>
 #include <glm/glm.hpp>
 #include <glm/gtx/matrix_transform_2d.hpp>
+#include <database/bin_cache.hpp>
+#include <database/database.hpp>
 #include <database/timeseries.hpp>
 #include "utils/transform.hpp"
 
@@ -19,10 +22,29 @@ struct GraphState
         std::string name;
         bool visible = false;
         float y_offset = 0.0;
+        std::shared_ptr<database::BinCache> bin_cache = std::make_shared<database::BinCache>();
     };
 
     int plot_width = 2;
     bool show_line_segments = false;
+
+    // The number of bins the plot took from its caches and had to fetch from the database, during
+    // the last frame
+    std::size_t bin_cache_hits = 0;
+    std::size_t bin_cache_misses = 0;
+
+    // The furthest any bin edge was moved to draw the last frame approximately, in pixels, or 0 if
+    // it was drawn exactly
+    double snap_error = 0.0;
+
+    // Indexed by handle, as the timeseries are listed in the same order as the database's registry
     std::vector<TimeSeriesState> timeseries;
+
+    // The database generation which the list of timeseries was last brought up to date with
+    std::uint64_t database_generation = 0;
+
+    // The database as of the start of the frame, which everything drawn in the frame reads from so
+    // every timeseries stops at the same point
+    database::ReadView view;
 };
 } // namespace amber
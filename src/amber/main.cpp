@@ -1,3 +1,5 @@
+#include <cstdlib>
+#include <filesystem>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/fwd.hpp>
@@ -17,8 +19,20 @@
 
 using namespace amber;
 
-void init_timeseries(database::Database &database, GraphState &state)
+// Take a view of the database for the frame, and bring the plot's list of timeseries up to date
+// with it, as plugins may register timeseries with the database at any time. Cheap enough to call
+// every frame, as the list is left alone unless the database has changed.
+void sync_timeseries(const database::Database &database, GraphState &state)
 {
+    state.view = database.view();
+    const auto &registry = state.view.registry();
+    const auto generation = registry.generation;
+    if (generation == state.database_generation)
+    {
+        return;
+    }
+    state.database_generation = generation;
+
     const auto createGlmColour = [](int code) {
         float r = static_cast<float>(0xFF & (code >> 16)) / 256.0f;
         float g = static_cast<float>(0xFF & (code >> 8)) / 256.0f;
@@ -26,52 +40,49 @@ void init_timeseries(database::Database &database, GraphState &state)
         return glm::vec3(r, g, b);
     };
 
-    const auto pick_next_colour = [](auto begin, auto end, auto current) {
-        current++;
-        if (current == end)
+    // A nice selection of material colours from here (column 400):
+    // https://material.io/resources/color/
+    static const std::vector<glm::vec3> plot_colours = {createGlmColour(0xef5350),
+                                                        createGlmColour(0x42a5f5),
+                                                        createGlmColour(0xd4e157),
+                                                        createGlmColour(0xec407a),
+                                                        createGlmColour(0x26c6da),
+                                                        createGlmColour(0xffee58),
+                                                        createGlmColour(0xab47bc),
+                                                        createGlmColour(0x26a69a),
+                                                        createGlmColour(0xffca28),
+                                                        createGlmColour(0x7e57c2),
+                                                        createGlmColour(0x66bb6a),
+                                                        createGlmColour(0xffa726),
+                                                        createGlmColour(0x5c6bc0),
+                                                        createGlmColour(0x9ccc65),
+                                                        createGlmColour(0xff7043)};
+
+    // Handles are indices into the registry, so the plot's list lines up with it
+    for (database::SeriesHandle handle = 0; handle < registry.series.size(); ++handle)
+    {
+        const auto &entry = registry.series[handle];
+        if (handle == state.timeseries.size())
         {
-            current = begin;
+            GraphState::TimeSeriesState cont;
+            cont.name = entry.name;
+            cont.colour = plot_colours[handle % plot_colours.size()];
+            cont.visible = true;
+            cont.y_offset = 0.0f;
+            state.timeseries.push_back(std::move(cont));
         }
-        return current;
-    };
 
-    // A nice selection of material colours from here (column 400):
-    // https://material.io/resources/color/
-    std::vector<glm::vec3> plot_colours = {createGlmColour(0xef5350),
-                                           createGlmColour(0x42a5f5),
-                                           createGlmColour(0xd4e157),
-                                           createGlmColour(0xec407a),
-                                           createGlmColour(0x26c6da),
-                                           createGlmColour(0xffee58),
-                                           createGlmColour(0xab47bc),
-                                           createGlmColour(0x26a69a),
-                                           createGlmColour(0xffca28),
-                                           createGlmColour(0x7e57c2),
-                                           createGlmColour(0x66bb6a),
-                                           createGlmColour(0xffa726),
-                                           createGlmColour(0x5c6bc0),
-                                           createGlmColour(0x9ccc65),
-                                           createGlmColour(0xff7043)};
-
-    const auto &data = database.data();
-    state.timeseries.resize(data.size());
-    auto colour = plot_colours.begin();
-    std::transform(data.begin(),
-                   data.end(),
-                   state.timeseries.begin(),
-                   [&colour, &plot_colours, &pick_next_colour](const auto &ts) {
-                       GraphState::TimeSeriesState cont;
-                       cont.name = ts.first;
-                       cont.ts = ts.second;
-                       cont.colour = *colour;
-                       colour = pick_next_colour(plot_colours.begin(), plot_colours.end(), colour);
-                       cont.visible = true;
-                       cont.y_offset = 0.0f;
-                       return cont;
-                   });
+        // A timeseries which has been replaced needs its cached bins throwing away too
+        auto &cont = state.timeseries[handle];
+        if (cont.ts != entry.ts)
+        {
+            cont.ts = entry.ts;
+            cont.bin_cache = std::make_shared<database::BinCache>();
+        }
+    }
 }
 
-int main()
+int main(int argc, char *argv[])
 {
     spdlog::info("Initializing...");
 
@@ -80,6 +91,21 @@ int main()
         // Create the timeseries database - this is where all the data goes!
         database::Database db;
 
+        // Spill the oldest samples to disk rather than running out of memory, if asked to
+        if (const char *budget = std::getenv("AMBER_MEMORY_BUDGET_MB"))
+        {
+            db.set_memory_budget(std::stoull(budget) * 1024 * 1024,
+                                 std::filesystem::temp_directory_path().string());
+            spdlog::info("Memory budget is {} MiB", budget);
+        }
+
+        // Pick up where a previous session left off, if we're given a snapshot to open
+        if (argc > 1)
+        {
+            db.load(argv[1]);
+            spdlog::info("Loaded snapshot {}", argv[1]);
+        }
+
         // Create and launch a selection of example plugins
         PluginContext plugin_context(db);
         PluginManager plugin_manager;
@@ -100,7 +126,7 @@ int main()
         }
 
         GraphState state;
-        init_timeseries(db, state);
+        sync_timeseries(db, state);
 
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -122,6 +148,7 @@ int main()
         while (!window.should_close())
         {
             glfwPollEvents();
+            sync_timeseries(db, state);
             window.render();
         }
     }
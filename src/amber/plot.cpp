@@ -3,6 +3,7 @@
 #include <glm/fwd.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/matrix_transform_2d.hpp>
+#include <algorithm>
 #include "plot.hpp"
 #include <database/timeseries.hpp>
 #include "resources.hpp"
@@ -137,13 +138,63 @@ void Plot::draw()
     const auto plot_size_gs = screen2graph_delta(plot_size_px);
     const auto interval_gs = PIXELS_PER_COL * plot_size_gs.x / num_samples;
 
-    for (auto &time_series : m_state.timeseries)
+    m_state.bin_cache_hits = 0;
+    m_state.bin_cache_misses = 0;
+    m_state.snap_error = 0.0;
+
+    // Zooming throws the bin caches away, so rather than reading every bin exactly each frame
+    // while it goes on, make do with approximate bins until the view settles
+    if (interval_gs != m_bin_width_old)
+    {
+        m_bin_width_old = interval_gs;
+        m_settle_frames = SETTLE_FRAMES;
+    }
+    else if (m_settle_frames > 0)
+    {
+        --m_settle_frames;
+    }
+    // Panning keeps the bin width, so the caches still hit on nearly every bin and reading them
+    // exactly is cheap
+    const bool approximate = m_settle_frames > 0;
+
+    for (database::SeriesHandle handle = 0; handle < m_state.timeseries.size(); ++handle)
     {
+        auto &time_series = m_state.timeseries[handle];
         if (time_series.visible)
         {
             std::vector<database::TSSample> samples(num_samples);
-            auto n_samples = time_series.ts->get_samples(
-                samples.data(), plot_position_gs.x, interval_gs, num_samples);
+            std::size_t n_samples = 0;
+            if (approximate)
+            {
+                // Edges may be off by up to half a column, which nobody sees while it's zooming
+                double error = 0.0;
+                n_samples = time_series.ts->get_samples_approx(m_state.view.published(handle),
+                                                               samples.data(),
+                                                               plot_position_gs.x,
+                                                               interval_gs,
+                                                               num_samples,
+                                                               error);
+                m_state.snap_error =
+                    std::max(m_state.snap_error, PIXELS_PER_COL * error / interval_gs);
+            }
+            else
+            {
+                // Most of the bins are usually the same as last frame, so go via the cache. Every
+                // timeseries is read as of the frame's view, so their right hand edges line up.
+                auto &cache = *time_series.bin_cache;
+                const auto hits = cache.hits();
+                const auto misses = cache.misses();
+
+                n_samples = cache.get_samples(*time_series.ts,
+                                              m_state.view.published(handle),
+                                              samples.data(),
+                                              plot_position_gs.x,
+                                              interval_gs,
+                                              num_samples);
+
+                m_state.bin_cache_hits += cache.hits() - hits;
+                m_state.bin_cache_misses += cache.misses() - misses;
+            }
             samples.resize(n_samples);
 
             draw_plot(samples, time_series.colour, time_series.y_offset);
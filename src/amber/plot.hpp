@@ -48,6 +48,7 @@ class Plot : public View
     Window &m_window;
     static constexpr size_t PIXELS_PER_COL = 1;
     static constexpr size_t COLS_MAX = 8192; // Number of preallocated buffer space for samples
+    static constexpr int SETTLE_FRAMES = 10; // Frames to wait after a zoom before drawing exactly
     unsigned int m_vao;
     unsigned int m_vbo;
     Program m_shader;
@@ -56,5 +57,10 @@ class Plot : public View
 
     bool m_is_dragging = false;
     glm::dvec2 m_cursor_pos_old;
+
+    // While the view is zooming, bins are drawn approximately, and only drawn exactly again once
+    // the bin width has stayed the same for a few frames
+    double m_bin_width_old = 0.0;
+    int m_settle_frames = 0;
 };
 } // namespace amber
@@ -1,8 +1,11 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <spdlog/spdlog.h>
 
 #include "ui.hpp"
 
+#include <chrono>
+
 using namespace amber;
 
 ImGuiMenuView::ImGuiMenuView(Window_GLFW &window,
@@ -22,11 +25,18 @@ ImGuiMenuView::ImGuiMenuView(Window_GLFW &window,
 
 void ImGuiMenuView::draw()
 {
+    poll_snapshot();
+
     ImVec2 menubar_size;
     if (ImGui::BeginMainMenuBar())
     {
         if (ImGui::BeginMenu("File"))
         {
+            // Only one snapshot is saved at a time
+            if (ImGui::MenuItem("Save Snapshot", nullptr, false, !m_snapshot.valid()))
+            {
+                save_snapshot();
+            }
             if (ImGui::MenuItem("Close", "Esc"))
             {
                 m_window.request_close();
@@ -227,7 +237,27 @@ void ImGuiMenuView::draw()
                 // Show database stats
                 auto [total_bytes, suffix] =
                     human_readable(m_database.memory_usage(), 1024, {"KiB", "MiB", "GiB", "TiB"});
-                ImGui::Text("Memory Used: %.1f%s", total_bytes, suffix);
+                ImGui::Text("Resident: %.1f%s", total_bytes, suffix);
+
+                auto [spilled_bytes, spilled_suffix] =
+                    human_readable(m_database.spilled_bytes(), 1024, {"KiB", "MiB", "GiB", "TiB"});
+                ImGui::Text("Spilled to Disk: %.1f%s", spilled_bytes, spilled_suffix);
+
+                auto [logical_bytes, logical_suffix] = human_readable(
+                    m_database.logical_memory_usage(), 1024, {"KiB", "MiB", "GiB", "TiB"});
+                ImGui::Text("Uncompressed: %.1f%s", logical_bytes, logical_suffix);
+                ImGui::Text("Compression Ratio: %.2f",
+                            static_cast<double>(m_database.logical_memory_usage()) /
+                                static_cast<double>(m_database.memory_usage()));
+
+                // Storage taken from the OS, of which some may be sitting on free lists
+                const auto &arena = m_database.arena();
+                auto [reserved_bytes, reserved_suffix] =
+                    human_readable(arena->reserved_bytes(), 1024, {"KiB", "MiB", "GiB", "TiB"});
+                auto [allocated_bytes, allocated_suffix] =
+                    human_readable(arena->allocated_bytes(), 1024, {"KiB", "MiB", "GiB", "TiB"});
+                ImGui::Text("Arena Reserved: %.1f%s", reserved_bytes, reserved_suffix);
+                ImGui::Text("Arena In Use: %.1f%s", allocated_bytes, allocated_suffix);
 
                 auto [total_samples, samples_suffix] =
                     human_readable(m_database.num_samples(), 1000, {"K", "M", "B"});
@@ -236,6 +266,18 @@ void ImGuiMenuView::draw()
                 ImGui::Text("Bytes/sample: %.1f",
                             static_cast<double>(m_database.memory_usage()) /
                                 static_cast<double>(m_database.num_samples()));
+
+                const auto bins = m_graph_state.bin_cache_hits + m_graph_state.bin_cache_misses;
+                ImGui::Text("Bin Cache Hits: %zu", m_graph_state.bin_cache_hits);
+                ImGui::Text("Bin Cache Misses: %zu", m_graph_state.bin_cache_misses);
+                ImGui::Text("Bin Cache Hit Rate: %.1f%%",
+                            bins ? 100.0 * m_graph_state.bin_cache_hits / bins : 0.0);
+                ImGui::Text("Snap Error: %.2fpx", m_graph_state.snap_error);
+
+                if (!m_snapshot_status.empty())
+                {
+                    ImGui::Text("Snapshot: %s", m_snapshot_status.c_str());
+                }
             }
 
             m_plugin_manager.draw_dialogs();
@@ -245,6 +287,35 @@ void ImGuiMenuView::draw()
     }
 }
 
+void ImGuiMenuView::save_snapshot()
+{
+    // Saving reads every series as of one view of the database, which is safe to do while the
+    // plugins carry on pushing samples
+    m_snapshot_status = std::string("Saving to ") + SNAPSHOT_PATH + "...";
+    m_snapshot = std::async(std::launch::async, [this]() { m_database.save(SNAPSHOT_PATH); });
+}
+
+void ImGuiMenuView::poll_snapshot()
+{
+    using namespace std::chrono_literals;
+    if (!m_snapshot.valid() || m_snapshot.wait_for(0s) != std::future_status::ready)
+    {
+        return;
+    }
+
+    try
+    {
+        m_snapshot.get();
+        m_snapshot_status = std::string("Saved to ") + SNAPSHOT_PATH;
+        spdlog::info("Saved snapshot to {}", SNAPSHOT_PATH);
+    }
+    catch (const std::exception &e)
+    {
+        m_snapshot_status = std::string("Failed, ") + e.what();
+        spdlog::error("Unable to save snapshot: {}", e.what());
+    }
+}
+
 void ImGuiMenuView::update_vsync() const
 {
     glfwSwapInterval(m_enable_vsync ? 1 : 0);
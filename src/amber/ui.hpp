@@ -1,7 +1,9 @@
 #pragma once
 
 #include <database/database.hpp>
+#include <future>
 #include <imgui.h>
+#include <string>
 #include "view.hpp"
 #include "window_glfw.hpp"
 #include "plugin_manager.hpp"
@@ -21,6 +23,8 @@ class ImGuiMenuView : public View
 
   private:
     void draw() override;
+    void save_snapshot();
+    void poll_snapshot();
     void update_vsync() const;
     void update_call_glfinish();
     void update_multisampling();
@@ -49,6 +53,14 @@ class ImGuiMenuView : public View
                                                           std::vector<const char *> suffixes = {
                                                               "K", "M", "B", "T"});
 
+    // Where File > Save Snapshot writes to, pass this to amber on the command line to open it again
+    static constexpr const char *SNAPSHOT_PATH = "amber.snapshot";
+
+    // Snapshots are saved on a thread of their own so frames keep coming meanwhile, and the result
+    // is shown in the info window once it's done
+    std::future<void> m_snapshot;
+    std::string m_snapshot_status;
+
     bool m_enable_vsync = true;
     bool m_call_glfinish = false;
     bool m_enable_multisampling = true;
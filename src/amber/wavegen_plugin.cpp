@@ -5,6 +5,7 @@
 #include <imgui.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <stdexcept>
+#include <vector>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -17,8 +18,9 @@ WaveGenPlugin::WaveGenPlugin(PluginContext &ctx) : m_ctx(ctx)
     m_logger = spdlog::stdout_color_mt("WaveGenPlugin");
     m_logger->info("Initialized");
 
-    m_ts = std::make_shared<database::TimeSeriesDense>(0.0, 1.0 / m_sample_rate);
-    m_ctx.get_database().register_timeseries("wavegen/channelA", m_ts);
+    auto &db = m_ctx.get_database();
+    m_ts = std::make_shared<database::TimeSeriesDense<>>(0.0, 1.0 / m_sample_rate, db.arena());
+    db.register_timeseries("wavegen/channelA", m_ts);
 
     m_settings.amplitude = 1.0;
     m_settings.frequency = 1.0;
@@ -87,6 +89,7 @@ void WaveGenPlugin::thread_handler()
     const auto sample_period = std::chrono::duration<double>(1s) / m_sample_rate;
     auto prevtime = std::chrono::steady_clock::now();
     double x = 0.0;
+    std::vector<double> batch;
 
     while (m_running)
     {
@@ -105,9 +108,12 @@ void WaveGenPlugin::thread_handler()
         {
             x += settings.frequency / m_sample_rate;
             const auto value = settings.amplitude * sample_value(settings.type, x);
-            m_ts->push_sample(value);
+            batch.push_back(value);
             delta -= sample_period;
         }
+
+        m_ts->push_samples(batch.data(), batch.size());
+        batch.clear();
     }
 }
 
@@ -43,7 +43,7 @@ class WaveGenPlugin : public Plugin
     std::shared_ptr<spdlog::logger> m_logger;
     std::atomic<bool> m_running = false;
     std::thread m_thread;
-    std::shared_ptr<database::TimeSeriesDense> m_ts;
+    std::shared_ptr<database::TimeSeriesDense<>> m_ts;
     mutable std::mutex m_mutex;
     WaveSettings m_settings;
 };